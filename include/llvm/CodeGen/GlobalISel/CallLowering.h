@@ -29,6 +29,7 @@ namespace llvm {
 
 class DataLayout;
 class Function;
+class MachineInstr;
 class MachineIRBuilder;
 class MachineOperand;
 struct MachinePointerInfo;
@@ -188,6 +189,11 @@ public:
     return false;
   }
 
+  /// This hook lets the target carry information from the IR call site \p CS
+  /// over to its lowered call instruction \p Call, e.g., as metadata for later
+  /// passes. It is called after the call has been successfully lowered.
+  virtual void annotateCall(MachineInstr &Call, ImmutableCallSite CS) const {}
+
   /// Lower the given call instruction, including argument and return value
   /// marshalling.
   ///
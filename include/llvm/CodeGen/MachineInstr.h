@@ -80,7 +80,9 @@ public:
     FrameDestroy = 1 << 1,              // Instruction is used as a part of
                                         // function frame destruction code.
     BundledPred  = 1 << 2,              // Instruction has bundled predecessors.
-    BundledSucc  = 1 << 3               // Instruction has bundled successors.
+    BundledSucc  = 1 << 3,              // Instruction has bundled successors.
+    PartsInstr   = 1 << 4               // Instruction was emitted by PARTS
+                                        // instrumentation.
   };
 
 private:
@@ -176,6 +176,7 @@ private:
   MachineAtomicInfo AtomicInfo;
   AAMDNodes AAInfo;
   const MDNode *Ranges;
+  const MDNode *PartsType = nullptr;
 
 public:
   /// Construct a MachineMemOperand object with the specified PtrInfo, flags,
@@ -237,6 +238,12 @@ public:
   /// Return the range tag for the memory reference.
   const MDNode *getRanges() const { return Ranges; }
 
+  /// Return the PARTS type metadata of the accessed value, if any.
+  const MDNode *getPartsType() const { return PartsType; }
+
+  /// Attach PARTS type metadata so that it survives instruction selection.
+  void setPartsType(const MDNode *N) { PartsType = N; }
+
   /// Returns the synchronization scope ID for this memory operation.
   SyncScope::ID getSyncScopeID() const {
     return static_cast<SyncScope::ID>(AtomicInfo.SSID);
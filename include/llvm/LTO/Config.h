@@ -62,6 +62,11 @@ struct Config {
   // conjunction OptPipeline.
   std::string AAPipeline;
 
+  /// Shared libraries to load before the middle-end optimizer is set up, so
+  /// that they can register PassManagerBuilder extensions, e.g., for
+  /// EP_FullLinkTimeOptimizationEarly. Only used by the old pass manager.
+  std::vector<std::string> PassPlugins;
+
   /// Setting this field will replace target triples in input files with this
   /// triple.
   std::string OverrideTriple;
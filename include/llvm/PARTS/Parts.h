@@ -11,18 +11,38 @@
 #ifndef LLVM_PARTS_H
 #define LLVM_PARTS_H
 
+#include <string>
+
 #define Pauth_ModifierReg AArch64::X23
 
 namespace llvm {
 
 namespace PARTS {
 
+enum class TypeIdHash;
+
 bool useBeCfi();
 bool useFeCfi();
 bool useDpi();
+bool useDpiPreRA();
+bool useDpiSinkAut();
+bool useDpiEscapeAnalysis();
+bool useLazyGlobals();
 bool useAny();
 bool useDummy();
+bool useSoftPa();
 bool useRuntimeStats();
+bool useRuntimeStatsInline();
+bool useLogStats();
+bool useModifierOpt();
+bool usePipeline();
+bool useIcp();
+bool useWholeProgram();
+bool useTypeIdCollisionCheck();
+TypeIdHash getTypeIdHash();
+bool useOverheadReport();
+std::string getOverheadReportFile();
+bool needsModifierReg();
 
 } // PARTS
 
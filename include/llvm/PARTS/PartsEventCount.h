@@ -11,6 +11,7 @@
 #define LLVM_PARTSEVENTCOUNT_H
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Module.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineInstr.h"
@@ -23,6 +24,20 @@ namespace PARTS {
 class PartsEventCount {
 
 public:
+  /*! Event kinds, also the per-function index into the inline counter array */
+  enum EventKind {
+    CodePointerBranch = 0,
+    CodePointerCreate,
+    DataStr,
+    DataLdr,
+    NonleafCall,
+    LeafCall,
+    NumEventKinds
+  };
+
+  /*! Name of the section holding the inline counters, a valid C identifier so the linker emits __start/__stop */
+  static constexpr const char *CounterSection = "parts_counters";
+
   static Function *getFuncCodePointerBranch(Module &M) { return getCounterFunc(M, "__parts_count_code_ptr_branch"); };
   static Function *getFuncCodePointerCreate(Module &M) { return getCounterFunc(M, "__parts_count_code_ptr_create"); };
   static Function *getFuncDataStr(Module &M) { return getCounterFunc(M, "__parts_count_data_ptr_str"); };
@@ -30,6 +45,29 @@ public:
   static Function *getFuncNonleafCall(Module &M) { return getCounterFunc(M, "__parts_count_nonleaf_call"); };
   static Function *getFuncLeafCall(Module &M) { return getCounterFunc(M, "__parts_count_leaf_call"); };
 
+  static Function *getCounterFunc(Module &M, EventKind kind);
+
+  /*!
+   * Create the per-module inline counter array, with NumEventKinds i64 counters for each defined function, and a
+   * constructor that passes it to the runtime with:
+   *
+   *   void __parts_counters_register(uint64_t *counters, const char **names, uint64_t funcs, uint64_t kinds);
+   *
+   * The runtime is expected to dump the counters at exit. Must be called on IR before instruction selection, so that
+   * the constructor is compiled with the rest of the module, the AArch64 backend does so in PartsPassEventCounters.
+   * Repeated calls are no-ops.
+   */
+  static GlobalVariable *createInlineCounters(Module &M);
+
+  /*! Get the inline counter array, or nullptr if createInlineCounters has not been called */
+  static GlobalVariable *getInlineCounters(const Module &M);
+
+  /*! Check if F was given a slot in the inline counter array */
+  static bool hasInlineCounters(const Function &F);
+
+  /*! Get the byte offset of the counter for kind in F within the inline counter array */
+  static uint64_t getInlineCounterOffset(const Function &F, EventKind kind);
+
 private:
   static Function *getCounterFunc(Module &M, const std::string &fName);
 };
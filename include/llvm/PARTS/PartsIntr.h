@@ -24,10 +24,10 @@ class PartsIntr {
 
 public:
   static Value *pac_pointer(Function &F, Instruction &I, Value *V, const std::string &name = "");
-  static Value *pac_pointer(IRBuilder<> *builder, Module &M, Value *V, const std::string &name = "", PartsTypeMetadata_ptr = nullptr);
+  static Value *pac_pointer(IRBuilder<> *builder, Module &M, Value *V, const std::string &name = "", PartsTypeMetadata_opt PTMD = None);
 
-  static Value *load_aut_pointer(Function &F, Instruction &I, PartsTypeMetadata_ptr PTMD);
-  static Value *store_aut_pointer(Function &F, Instruction &I, PartsTypeMetadata_ptr PTMD);
+  static Value *load_aut_pointer(Function &F, Instruction &I, const PartsTypeMetadata &PTMD);
+  static Value *store_aut_pointer(Function &F, Instruction &I, const PartsTypeMetadata &PTMD);
 };
 
 } // PARTS
@@ -11,8 +11,13 @@
 #ifndef LLVM_PARTS_PARTSLOG_H
 #define LLVM_PARTS_PARTSLOG_H
 
-#include <string>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/PARTS/PartsLogStream.h"
 
@@ -34,9 +39,19 @@ typedef std::shared_ptr<PartsLog> PartsLog_ptr;
 
 class PartsLog {
 private:
+  /*!
+   * Process-wide statistics. Each thread counts into its own shard without contention, the shards are merged into
+   * the totals when their thread exits or when the statistics are dumped.
+   */
   class Stats {
   private:
+    class Shard;
+
+    mutable std::mutex m_mutex;
     std::map<std::string, int> m_stats;
+    std::set<Shard *> m_shards;
+
+    Shard &getShard();
 
   public:
     Stats();
@@ -46,6 +61,9 @@ private:
     void dump() const;
     void inc(const std::string &var, unsigned num=1);
     void dec(const std::string &var, unsigned num=1);
+
+    void addShard(Shard *shard);
+    void removeShard(Shard *shard);
   };
 
   const std::string m_name;
@@ -59,8 +77,9 @@ private:
 #endif
 
   static Stats &getStats();
-  inline raw_ostream &get_ostream(bool enabled, const raw_ostream::Colors c) const;
-  inline raw_ostream &get_ostream(bool enabled, const std::string &F, const raw_ostream::Colors c) const;
+  /*! Get the output stream, or nullptr if disabled so that the message is never formatted */
+  inline raw_ostream *get_ostream(bool enabled, const raw_ostream::Colors c) const;
+  inline raw_ostream *get_ostream(bool enabled, StringRef F, const raw_ostream::Colors c) const;
 
 protected:
 public:
@@ -72,15 +91,16 @@ public:
 
   void restrictToFunc(const std::string func);
 
-  PARTS::PartsLogStream inc(const std::string &var, unsigned num) { return inc(var, raw_ostream::BLUE, "", num); }
-  PARTS::PartsLogStream inc(const std::string &var, const std::string &F, unsigned num = 1) { return inc(var, raw_ostream::BLUE, F, num); }
-  PARTS::PartsLogStream inc(const std::string &var, bool b, const std::string &F = "", unsigned num = 1);
-  PARTS::PartsLogStream inc(const std::string &var,
+  // The stat names are Twines so that callers only pay for building them when -parts-log-stats is enabled
+  PARTS::PartsLogStream inc(const Twine &var, unsigned num) { return inc(var, raw_ostream::BLUE, "", num); }
+  PARTS::PartsLogStream inc(const Twine &var, StringRef F, unsigned num = 1) { return inc(var, raw_ostream::BLUE, F, num); }
+  PARTS::PartsLogStream inc(const Twine &var, bool b, StringRef F = "", unsigned num = 1);
+  PARTS::PartsLogStream inc(const Twine &var,
                             const raw_ostream::Colors c = raw_ostream::BLUE,
-                            const std::string &F = "",
+                            StringRef F = "",
                             const unsigned num  = 1);
-  PARTS::PartsLogStream dec(const std::string &var, bool b, const std::string &F = "");
-  PARTS::PartsLogStream dec(const std::string &var, const raw_ostream::Colors c = raw_ostream::BLUE, const std::string &F = "");
+  PARTS::PartsLogStream dec(const Twine &var, bool b, StringRef F = "");
+  PARTS::PartsLogStream dec(const Twine &var, const raw_ostream::Colors c = raw_ostream::BLUE, StringRef F = "");
 
   PARTS::PartsLogStream debug();
   PARTS::PartsLogStream info();
@@ -89,29 +109,30 @@ public:
   PARTS::PartsLogStream red();
   PARTS::PartsLogStream green();
 
-  PARTS::PartsLogStream debug(const std::string &F);
-  PARTS::PartsLogStream info(const std::string &F);
-  PARTS::PartsLogStream warn(const std::string &F);
-  PARTS::PartsLogStream error(const std::string &F);
-  PARTS::PartsLogStream red(const std::string &F);
-  PARTS::PartsLogStream green(const std::string &F);
+  PARTS::PartsLogStream debug(StringRef F);
+  PARTS::PartsLogStream info(StringRef F);
+  PARTS::PartsLogStream warn(StringRef F);
+  PARTS::PartsLogStream error(StringRef F);
+  PARTS::PartsLogStream red(StringRef F);
+  PARTS::PartsLogStream green(StringRef F);
 
+  /*! Create a new logger, each pass owns its logger so that concurrent pass instances share no state */
   static PartsLog_ptr getLogger(const std::string &name);
 };
 
-inline raw_ostream &PartsLog::get_ostream(bool enabled, const raw_ostream::Colors c) const {
+inline raw_ostream *PartsLog::get_ostream(bool enabled, const raw_ostream::Colors c) const {
   if (enabled)
-    return (errs().changeColor(c, false, false) << m_name << ": ");
+    return &(errs().changeColor(c, false, false) << m_name << ": ");
 
-  return nulls();
+  return nullptr;
 }
 
-inline raw_ostream &PartsLog::get_ostream(bool enabled, const std::string &F, const raw_ostream::Colors c) const {
-  if (enabled && (!m_onlyFunc || F.compare(m_onlyFuncName) == 0)) {
-    return (errs().changeColor(c, false, false) << m_name << ": ");
+inline raw_ostream *PartsLog::get_ostream(bool enabled, StringRef F, const raw_ostream::Colors c) const {
+  if (enabled && (!m_onlyFunc || F == m_onlyFuncName)) {
+    return &(errs().changeColor(c, false, false) << m_name << ": ");
   }
 
-  return nulls();
+  return nullptr;
 }
 
 inline PartsLog &PartsLog::enable() {
@@ -13,6 +13,8 @@
 
 #include <string>
 #include <memory>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Module.h"
 #include "llvm/PARTS/PartsLogStream.h"
@@ -21,20 +23,34 @@
 
 namespace llvm {
 
+class PartsTypeMetadata;
+
 namespace PARTS {
 
 class PartsLogStream {
 private:
   llvm::raw_ostream *m_ostream;
 
+  /*! Run print on the stream, if any, so that discarded messages are never formatted */
+  template <typename PrintFn>
+  PartsLogStream &forward(PrintFn print) {
+    if (m_ostream != nullptr)
+      print(*m_ostream);
+    return *this;
+  }
+
 public:
   explicit PartsLogStream(llvm::raw_ostream &ostream);
+  /*! A nullptr stream discards everything without formatting it */
+  explicit PartsLogStream(llvm::raw_ostream *ostream);
   ~PartsLogStream();
 
   PartsLogStream &resetColor();
   PartsLogStream &changeColor(enum raw_ostream::Colors colors, bool bold,bool bg);
 
   PartsLogStream &operator<<(const std::string &str);
+  PartsLogStream &operator<<(StringRef str);
+  PartsLogStream &operator<<(const Twine &str);
   PartsLogStream &operator<<(const unsigned long &str);
   PartsLogStream &operator<<(const char *str);
   PartsLogStream &operator<<(const long &str);
@@ -42,6 +58,7 @@ public:
   PartsLogStream &operator<<(const unsigned &str);
   PartsLogStream &operator<<(const Value *I);
   PartsLogStream &operator<<(const Type *T);
+  PartsLogStream &operator<<(const PartsTypeMetadata &PTMD);
   PartsLogStream &operator<<(const Instruction &I);
   PartsLogStream &operator<<(const Module::global_iterator &GV);
   PartsLogStream &operator<<(const GlobalVariable &GV);
@@ -0,0 +1,74 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PARTSSOFTPA_H
+#define LLVM_PARTSSOFTPA_H
+
+#include <cstdint>
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+namespace llvm {
+
+namespace PARTS {
+
+/*! Software implementation of ARMv8.3-A pointer authentication */
+/*!
+ * The PAC is computed with QARMA-64, following the ComputePAC pseudocode of the Arm ARM, and inserted into and
+ * checked against the pointer as AddPAC and Auth do for a 48-bit Linux user space address. Data pointers use
+ * top-byte-ignore, code pointers do not. Failed authentication sets the same error code bits as the hardware, so
+ * the pointer faults when used.
+ *
+ * Instrumented code calls the helpers, i64 (i64 ptr, i64 modifier), which are emitted into each module as
+ * linkonce_odr functions. Only the A keys are modelled. They are read from the weak global __parts_soft_pa_keys,
+ * { IA<63:0>, IA<127:64>, DA<63:0>, DA<127:64> }, which a runtime can override or rewrite at startup.
+ */
+class PartsSoftPa {
+public:
+  enum Op {
+    PACIA = 0,
+    PACDA,
+    AUTIA,
+    AUTDA,
+    NumOps
+  };
+
+  /*! Compute a 64-bit PAC as the ComputePAC pseudocode, key0 and key1 are the high and low halves of the key */
+  static uint64_t computePac(uint64_t data, uint64_t modifier, uint64_t key0, uint64_t key1);
+  /*! Add a PAC to ptr, as AddPAC with the given key */
+  static uint64_t addPac(uint64_t ptr, uint64_t modifier, uint64_t key0, uint64_t key1, bool isData);
+  /*! Authenticate and strip ptr, as Auth with the given A key */
+  static uint64_t auth(uint64_t ptr, uint64_t modifier, uint64_t key0, uint64_t key1, bool isData);
+
+  /*! Emit ComputePAC inline as IR, this shares its implementation with computePac */
+  static Value *emitComputePac(IRBuilder<> &B, Value *data, Value *modifier, Value *key0, Value *key1);
+
+  static const char *getHelperName(Op op);
+
+  /*!
+   * Get the helper for op, emitting it into M if needed. The helpers must be emitted on IR before instruction
+   * selection, so that they are compiled with the rest of the module, the AArch64 backend does so in
+   * PartsPassEventCounters.
+   */
+  static Function *getHelper(Module &M, Op op);
+
+  /*! Emit all helpers into M */
+  static void createHelpers(Module &M);
+
+  /*! Get the op implemented by F, or NumOps if F is not a helper */
+  static Op getHelperOp(const Function &F);
+};
+
+}
+
+}
+
+#endif //LLVM_PARTSSOFTPA_H
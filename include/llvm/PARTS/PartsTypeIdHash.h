@@ -0,0 +1,42 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PARTSTYPEIDHASH_H
+#define LLVM_PARTSTYPEIDHASH_H
+
+#include <cstdint>
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+
+namespace PARTS {
+
+/*! The hash functions that can be used to derive type_ids from type names */
+enum class TypeIdHash {
+  SHA3,
+  MD5,
+  XXHash,
+};
+
+/*!
+ * Hash a printed type to a 64-bit type_id.
+ *
+ * The result only depends on the hash function and the string, so it is the same across builds and hosts. All
+ * modules that are linked together must use the same hash function.
+ */
+uint64_t hashTypeId(TypeIdHash hash, StringRef type_str);
+
+StringRef getTypeIdHashName(TypeIdHash hash);
+
+} // PARTS
+
+} // llvm
+
+#endif //LLVM_PARTSTYPEIDHASH_H
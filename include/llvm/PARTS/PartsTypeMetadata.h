@@ -11,11 +11,15 @@
 #ifndef LLVM_IR_PARTSTYPEMETADATA_H
 #define LLVM_IR_PARTSTYPEMETADATA_H
 
+#include <set>
+#include "llvm/ADT/Optional.h"
 #include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/IR/Metadata.h"
 
 namespace llvm {
 
+class Module;
+
 namespace PARTS {
 
 typedef uint64_t type_id_t;
@@ -26,56 +30,66 @@ using namespace PARTS;
 
 class PartsTypeMetadata;
 
-typedef std::shared_ptr<PartsTypeMetadata> PartsTypeMetadata_ptr;
+typedef Optional<PartsTypeMetadata> PartsTypeMetadata_opt;
 
 /*! A encapsulating PARTS type_id and related metadata. */
 /*! This class encapsulates type_id information and related metadata, in particular, it also
  * keeps track of whether type_id is known, unknown, ignored, and whether the type_id corresponds
  * to a pointer of data or code type. The class also includes utility functions for embedding and retrieving the data
  * into an MDNode, this allows easy attaching and retrieval from various LLVM data-structures.
+ *
+ * The class is a small value type, the flags are packed into a single byte, and the MDNode holds
+ * only the type_id and the packed flags. MDNodes are uniqued by LLVM, so each distinct (type_id, flags)
+ * tuple gets exactly one MDNode per LLVMContext.
  */
 class PartsTypeMetadata {
-  type_id_t m_type_id = 0;
-  bool m_known = false;
-  bool m_pointer = false;
-  bool m_data = false;
-  bool m_ignored = false;
-  bool m_isPACed = false;
+  enum Flags : uint8_t {
+    FlagKnown   = 1 << 0,
+    FlagPointer = 1 << 1,
+    FlagData    = 1 << 2,
+    FlagIgnored = 1 << 3,
+    FlagPACed   = 1 << 4,
+  };
 
-  static constexpr const int numNodes = 7;
+  type_id_t m_type_id = 0;
+  uint8_t m_flags = 0;
 
-  static constexpr auto MetadataKindString = "PartsTypeMetadata";
+  static constexpr const int numNodes = 3;
 
   PartsTypeMetadata() = delete;
 
+  inline bool hasFlag(Flags flag) const { return (m_flags & flag) != 0; }
+  inline void setFlag(Flags flag, bool value);
+
 protected:
 public:
+  /*! Metadata kind used for attaching the type to IR instructions */
+  static constexpr auto MetadataKindString = "PartsTypeMetadata";
+
   /*! Constructor using type_id */
   explicit PartsTypeMetadata(type_id_t type_id);
   /*! Constructor used to restore PartsTypeMetadata from MDNode */
   explicit PartsTypeMetadata(const MDNode *MDN);
 
-  ~PartsTypeMetadata();
-
-  /*! Get a (new) MDNode containing necessary information to re-create this object */
-  MDNode *getMDNode(LLVMContext &C);
+  /*! Get the (uniqued) MDNode containing necessary information to re-create this object */
+  MDNode *getMDNode(LLVMContext &C) const;
 
   /*! Get type_id of associated LLVM Type */
   inline type_id_t getTypeId() const { return m_type_id; }
   Constant *getTypeIdConstant(LLVMContext &C) const;
 
   /*! Return true if the associated Value should be ignored */
-  inline bool isIgnored() const { return m_ignored; }
+  inline bool isIgnored() const { return hasFlag(FlagIgnored); }
   /*! Return true if the associated Value is already PACed */
-  inline bool isPACed() const { return m_isPACed; }
+  inline bool isPACed() const { return hasFlag(FlagPACed); }
   /*! Return true if type is known */
-  inline bool isKnown() const { return m_known; }
+  inline bool isKnown() const { return hasFlag(FlagKnown); }
   /*! Return true if type is a pointer */
-  inline bool isPointer() const { return m_pointer; }
+  inline bool isPointer() const { return hasFlag(FlagPointer); }
   /*! Return true if Type is a data pointer */
-  inline bool isDataPointer() const { return m_pointer && m_data; }
+  inline bool isDataPointer() const { return isPointer() && hasFlag(FlagData); }
   /*! Return true if Type is a code pointer */
-  inline bool isCodePointer() const { return m_pointer && !m_data; }
+  inline bool isCodePointer() const { return isPointer() && !hasFlag(FlagData); }
 
   inline void setIgnored(bool ignored);
   inline void setIsPACed(bool isPACed);
@@ -84,16 +98,21 @@ public:
   inline void setIsDataPointer(bool data);
   inline void setIsCodePointer(bool code);
 
-  void attach(LLVMContext &C, Instruction &I);
+  void attach(LLVMContext &C, Instruction &I) const;
 
-  std::string toString();
+  std::string toString() const;
 
-  static PartsTypeMetadata_ptr get(type_id_t type_id);
-  static PartsTypeMetadata_ptr get(const Type *type);
-  static PartsTypeMetadata_ptr getUnknown();
-  static PartsTypeMetadata_ptr getIgnored();
-  static const PartsTypeMetadata_ptr retrieve(const MachineInstr &MI);
-  static const PartsTypeMetadata_ptr retrieve(const MDNode *MDNp);
+  inline bool operator==(const PartsTypeMetadata &o) const {
+    return m_type_id == o.m_type_id && m_flags == o.m_flags;
+  }
+  inline bool operator!=(const PartsTypeMetadata &o) const { return !(*this == o); }
+
+  static PartsTypeMetadata get(type_id_t type_id);
+  static PartsTypeMetadata get(const Type *type);
+  static PartsTypeMetadata getUnknown();
+  static PartsTypeMetadata getIgnored();
+  static PartsTypeMetadata_opt retrieve(const MachineInstr &MI);
+  static PartsTypeMetadata_opt retrieve(const MDNode *MDNp);
 
   static bool isPartsTypeMetadataContainer(const MDNode *const MDN);
 
@@ -102,10 +121,28 @@ public:
   inline static bool TyIsCodePointer(const Type *const type);
   inline static bool TyIsPointer(const Type *const type);
 
+  /*! Get the (memoized) type_id of the given Type */
   static type_id_t idFromType(const Type *const type);
   static Constant *idConstantFromType(LLVMContext &context, const Type *const type);
 
-  friend raw_ostream &operator<<(raw_ostream &stream, const PartsTypeMetadata_ptr);
+  /*! Drop all memoized type_ids, and indirectly called type_id sets, belonging to the given LLVMContext */
+  static void releaseTypeIdCache(const LLVMContext &C);
+
+  /*!
+   * Record the type_ids of all indirect calls in M. This must only be done when M is the whole program, code
+   * pointers of any other type are then never authenticated and need not be PACed.
+   */
+  static void setIndirectlyCalledIds(Module &M, const std::set<type_id_t> &type_ids);
+  /*!
+   * Check if code pointers of the given type must be PACed. Always true unless setIndirectlyCalledIds was used and
+   * -parts-whole-program is given.
+   */
+  static bool needsCodePointerPac(const Module &M, type_id_t type_id);
+
+  friend raw_ostream &operator<<(raw_ostream &stream, const PartsTypeMetadata &PTMD);
+
+private:
+  static type_id_t computeIdFromType(const Type *const type);
 };
 
 inline bool PartsTypeMetadata::TyIsCodePointer(const Type *const type)
@@ -118,35 +155,43 @@ inline bool PartsTypeMetadata::TyIsPointer(const Type *const type)
   return type->isPointerTy();
 }
 
+inline void PartsTypeMetadata::setFlag(Flags flag, bool value)
+{
+  if (value)
+    m_flags |= flag;
+  else
+    m_flags &= ~flag;
+}
+
 inline void PartsTypeMetadata::setIgnored(bool ignored)
 {
-  m_ignored = ignored;
+  setFlag(FlagIgnored, ignored);
 }
 
 inline void PartsTypeMetadata::setIsPACed(bool isPACed) {
-  m_isPACed = isPACed;
+  setFlag(FlagPACed, isPACed);
 }
 
 inline void PartsTypeMetadata::setIsKnown(bool known)
 {
-  m_known = known;
+  setFlag(FlagKnown, known);
 }
 
 inline void PartsTypeMetadata::setIsPointer(bool pointer)
 {
-  m_known = true;
-  m_pointer = pointer;
+  setFlag(FlagKnown, true);
+  setFlag(FlagPointer, pointer);
 }
 
 inline void PartsTypeMetadata::setIsDataPointer(bool data)
 {
-  m_known = true;
-  m_data = data;
+  setFlag(FlagKnown, true);
+  setFlag(FlagData, data);
 }
 inline void PartsTypeMetadata::setIsCodePointer(bool code)
 {
-  m_known = true;
-  m_data = !code;
+  setFlag(FlagKnown, true);
+  setFlag(FlagData, !code);
 }
 
 } // namespace llvm
@@ -165,6 +165,9 @@ bool ExpandPostRA::LowerCopy(MachineInstr *MI) {
 
   if (MI->getNumOperands() > 2)
     TransferImplicitOperands(MI);
+  // Keep the copies inserted by PARTS attributed to it.
+  if (MI->getFlag(MachineInstr::PartsInstr))
+    std::prev(MI->getIterator())->setFlag(MachineInstr::PartsInstr);
   DEBUG({
     MachineBasicBlock::iterator dMI = MI;
     dbgs() << "replaced by: " << *(--dMI);
@@ -52,7 +52,19 @@ bool CallLowering::lowerCall(
   if (!OrigRet.Ty->isVoidTy())
     setArgFlags(OrigRet, AttributeList::ReturnIndex, DL, CS);
 
-  return lowerCall(MIRBuilder, CS.getCallingConv(), Callee, OrigRet, OrigArgs);
+  if (!lowerCall(MIRBuilder, CS.getCallingConv(), Callee, OrigRet, OrigArgs))
+    return false;
+
+  // The call is followed by the return value copies and the call frame
+  // teardown, so search backwards from the insertion point.
+  MachineBasicBlock &MBB = MIRBuilder.getMBB();
+  for (auto I = MIRBuilder.getInsertPt(); I != MBB.begin();) {
+    if ((--I)->isCall()) {
+      annotateCall(*I, CS);
+      break;
+    }
+  }
+  return true;
 }
 
 template <typename FuncInfoTy>
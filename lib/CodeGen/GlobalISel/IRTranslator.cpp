@@ -50,6 +50,7 @@
 #include "llvm/IR/User.h"
 #include "llvm/IR/Value.h"
 #include "llvm/MC/MCContext.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CodeGen.h"
@@ -345,12 +346,15 @@ bool IRTranslator::translateLoad(const User &U, MachineIRBuilder &MIRBuilder) {
   unsigned Res = getOrCreateVReg(LI);
   unsigned Addr = getOrCreateVReg(*LI.getPointerOperand());
 
-  MIRBuilder.buildLoad(
-      Res, Addr,
-      *MF->getMachineMemOperand(MachinePointerInfo(LI.getPointerOperand()),
-                                Flags, DL->getTypeStoreSize(LI.getType()),
-                                getMemOpAlignment(LI), AAMDNodes(), nullptr,
-                                LI.getSyncScopeID(), LI.getOrdering()));
+  auto *MMO =
+      MF->getMachineMemOperand(MachinePointerInfo(LI.getPointerOperand()),
+                               Flags, DL->getTypeStoreSize(LI.getType()),
+                               getMemOpAlignment(LI), AAMDNodes(), nullptr,
+                               LI.getSyncScopeID(), LI.getOrdering());
+  // Keep the PARTS type, the legalizer drops it if it splits the access.
+  MMO->setPartsType(LI.getMetadata(PartsTypeMetadata::MetadataKindString));
+
+  MIRBuilder.buildLoad(Res, Addr, *MMO);
   return true;
 }
 
@@ -366,13 +370,14 @@ bool IRTranslator::translateStore(const User &U, MachineIRBuilder &MIRBuilder) {
   unsigned Val = getOrCreateVReg(*SI.getValueOperand());
   unsigned Addr = getOrCreateVReg(*SI.getPointerOperand());
 
-  MIRBuilder.buildStore(
-      Val, Addr,
-      *MF->getMachineMemOperand(
-          MachinePointerInfo(SI.getPointerOperand()), Flags,
-          DL->getTypeStoreSize(SI.getValueOperand()->getType()),
-          getMemOpAlignment(SI), AAMDNodes(), nullptr, SI.getSyncScopeID(),
-          SI.getOrdering()));
+  auto *MMO = MF->getMachineMemOperand(
+      MachinePointerInfo(SI.getPointerOperand()), Flags,
+      DL->getTypeStoreSize(SI.getValueOperand()->getType()),
+      getMemOpAlignment(SI), AAMDNodes(), nullptr, SI.getSyncScopeID(),
+      SI.getOrdering());
+  MMO->setPartsType(SI.getMetadata(PartsTypeMetadata::MetadataKindString));
+
+  MIRBuilder.buildStore(Val, Addr, *MMO);
   return true;
 }
 
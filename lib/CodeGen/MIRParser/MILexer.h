@@ -63,6 +63,7 @@ struct MIToken {
     kw_renamable,
     kw_tied_def,
     kw_frame_setup,
+    kw_parts_instr,
     kw_debug_location,
     kw_cfi_same_value,
     kw_cfi_offset,
@@ -110,6 +111,7 @@ struct MIToken {
     md_alias_scope,
     md_noalias,
     md_range,
+    md_parts_type,
     md_diexpr,
 
     // Identifier tokens
@@ -926,6 +926,10 @@ bool MIParser::parseInstruction(unsigned &OpCode, unsigned &Flags) {
     Flags |= MachineInstr::FrameSetup;
     lex();
   }
+  if (Token.is(MIToken::kw_parts_instr)) {
+    Flags |= MachineInstr::PartsInstr;
+    lex();
+  }
   if (Token.isNot(MIToken::Identifier))
     return error("expected a machine instruction");
   StringRef InstrName = Token.stringValue();
@@ -2396,6 +2400,7 @@ bool MIParser::parseMachineMemoryOperand(MachineMemOperand *&Dest) {
   unsigned BaseAlignment = Size;
   AAMDNodes AAInfo;
   MDNode *Range = nullptr;
+  MDNode *PartsType = nullptr;
   while (consumeIfPresent(MIToken::comma)) {
     switch (Token.kind()) {
     case MIToken::kw_align:
@@ -2422,16 +2427,22 @@ bool MIParser::parseMachineMemoryOperand(MachineMemOperand *&Dest) {
       if (parseMDNode(Range))
         return true;
       break;
+    case MIToken::md_parts_type:
+      lex();
+      if (parseMDNode(PartsType))
+        return true;
+      break;
     // TODO: Report an error on duplicate metadata nodes.
     default:
       return error("expected 'align' or '!tbaa' or '!alias.scope' or "
-                   "'!noalias' or '!range'");
+                   "'!noalias' or '!range' or '!PartsTypeMetadata'");
     }
   }
   if (expectAndConsume(MIToken::rparen))
     return true;
   Dest = MF.getMachineMemOperand(Ptr, Flags, Size, BaseAlignment, AAInfo, Range,
                                  SSID, Order, FailureOrder);
+  Dest->setPartsType(PartsType);
   return false;
 }
 
@@ -670,6 +670,8 @@ void MIPrinter::print(const MachineInstr &MI) {
     OS << " = ";
   if (MI.getFlag(MachineInstr::FrameSetup))
     OS << "frame-setup ";
+  if (MI.getFlag(MachineInstr::PartsInstr))
+    OS << "parts-instr ";
   OS << TII->getName(MI.getOpcode());
   if (I < E)
     OS << ' ';
@@ -889,6 +891,10 @@ void MIPrinter::print(const LLVMContext &Context, const TargetInstrInfo &TII,
     OS << ", !range ";
     Op.getRanges()->printAsOperand(OS, MST);
   }
+  if (Op.getPartsType()) {
+    OS << ", !PartsTypeMetadata ";
+    Op.getPartsType()->printAsOperand(OS, MST);
+  }
   OS << ')';
 }
 
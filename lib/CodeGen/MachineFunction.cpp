@@ -369,19 +369,26 @@ MachineMemOperand *MachineFunction::getMachineMemOperand(
 MachineMemOperand *
 MachineFunction::getMachineMemOperand(const MachineMemOperand *MMO,
                                       int64_t Offset, uint64_t Size) {
+  MachineMemOperand *NewMMO;
   if (MMO->getValue())
-    return new (Allocator)
+    NewMMO = new (Allocator)
                MachineMemOperand(MachinePointerInfo(MMO->getValue(),
                                                     MMO->getOffset()+Offset),
                                  MMO->getFlags(), Size, MMO->getBaseAlignment(),
                                  AAMDNodes(), nullptr, MMO->getSyncScopeID(),
                                  MMO->getOrdering(), MMO->getFailureOrdering());
-  return new (Allocator)
+  else
+    NewMMO = new (Allocator)
              MachineMemOperand(MachinePointerInfo(MMO->getPseudoValue(),
                                                   MMO->getOffset()+Offset),
                                MMO->getFlags(), Size, MMO->getBaseAlignment(),
                                AAMDNodes(), nullptr, MMO->getSyncScopeID(),
                                MMO->getOrdering(), MMO->getFailureOrdering());
+
+  // The PARTS type describes the whole accessed value, not a part of it.
+  if (Offset == 0 && Size == MMO->getSize())
+    NewMMO->setPartsType(MMO->getPartsType());
+  return NewMMO;
 }
 
 MachineMemOperand *
@@ -391,11 +398,13 @@ MachineFunction::getMachineMemOperand(const MachineMemOperand *MMO,
              MachinePointerInfo(MMO->getValue(), MMO->getOffset()) :
              MachinePointerInfo(MMO->getPseudoValue(), MMO->getOffset());
 
-  return new (Allocator)
+  auto *NewMMO = new (Allocator)
              MachineMemOperand(MPI, MMO->getFlags(), MMO->getSize(),
                                MMO->getBaseAlignment(), AAInfo,
                                MMO->getRanges(), MMO->getSyncScopeID(),
                                MMO->getOrdering(), MMO->getFailureOrdering());
+  NewMMO->setPartsType(MMO->getPartsType());
+  return NewMMO;
 }
 
 MachineInstr::mmo_iterator
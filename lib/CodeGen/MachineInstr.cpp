@@ -1414,7 +1414,7 @@ void MachineInstr::print(raw_ostream &OS, ModuleSlotTracker &MST,
   }
 
   bool HaveSemi = false;
-  const unsigned PrintableFlags = FrameSetup | FrameDestroy;
+  const unsigned PrintableFlags = FrameSetup | FrameDestroy | PartsInstr;
   if (Flags & PrintableFlags) {
     if (!HaveSemi) {
       OS << ";";
@@ -1427,6 +1427,9 @@ void MachineInstr::print(raw_ostream &OS, ModuleSlotTracker &MST,
 
     if (Flags & FrameDestroy)
       OS << "FrameDestroy";
+
+    if (Flags & PartsInstr)
+      OS << "PartsInstr";
   }
 
   if (!memoperands_empty()) {
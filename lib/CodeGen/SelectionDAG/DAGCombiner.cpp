@@ -600,6 +600,13 @@ public:
 
 } // end anonymous namespace
 
+/// Carry the PARTS type metadata of \p Old over to the memory node \p New that
+/// replaces it.
+static void transferPartsType(const MemSDNode *Old, SDValue New) {
+  if (const MDNode *PartsType = Old->getMemOperand()->getPartsType())
+    cast<MemSDNode>(New)->getMemOperand()->setPartsType(PartsType);
+}
+
 //===----------------------------------------------------------------------===//
 //  TargetLowering::DAGCombinerInfo implementation
 //===----------------------------------------------------------------------===//
@@ -11778,6 +11785,7 @@ SDValue DAGCombiner::visitLOAD(SDNode *N) {
             LD->getExtensionType(), SDLoc(N), LD->getValueType(0), Chain, Ptr,
             LD->getPointerInfo(), LD->getMemoryVT(), Align,
             LD->getMemOperand()->getFlags(), LD->getAAInfo());
+        transferPartsType(LD, NewLoad);
         if (NewLoad.getNode() != N)
           return CombineTo(N, NewLoad, SDValue(NewLoad.getNode(), 1), true);
       }
@@ -13733,6 +13741,7 @@ SDValue DAGCombiner::visitSTORE(SDNode *N) {
             DAG.getTruncStore(Chain, SDLoc(N), Value, Ptr, ST->getPointerInfo(),
                               ST->getMemoryVT(), Align,
                               ST->getMemOperand()->getFlags(), ST->getAAInfo());
+        transferPartsType(ST, NewStore);
         if (NewStore.getNode() != N)
           return CombineTo(ST, NewStore, true);
       }
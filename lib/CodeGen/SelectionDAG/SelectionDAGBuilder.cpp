@@ -94,6 +94,7 @@
 #include "llvm/IR/Value.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCSymbol.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
 #include "llvm/Support/AtomicOrdering.h"
 #include "llvm/Support/BranchProbability.h"
 #include "llvm/Support/Casting.h"
@@ -3585,6 +3586,12 @@ void SelectionDAGBuilder::visitLoad(const LoadInst &I) {
   if (NumValues == 0)
     return;
 
+  // PARTS type metadata describes the loaded value as a whole, so only keep it
+  // for loads that are not split into parts.
+  const MDNode *PartsType =
+      NumValues == 1 ? I.getMetadata(PartsTypeMetadata::MetadataKindString)
+                     : nullptr;
+
   SDValue Root;
   bool ConstantMemory = false;
   if (isVolatile || NumValues > MaxParallelChains)
@@ -3646,6 +3653,8 @@ void SelectionDAGBuilder::visitLoad(const LoadInst &I) {
     SDValue L = DAG.getLoad(ValueVTs[i], dl, Root, A,
                             MachinePointerInfo(SV, Offsets[i]), Alignment,
                             MMOFlags, AAInfo, Ranges);
+    if (PartsType)
+      cast<MemSDNode>(L)->getMemOperand()->setPartsType(PartsType);
 
     Values[i] = L;
     Chains[ChainI] = L.getValue(1);
@@ -3773,6 +3782,11 @@ void SelectionDAGBuilder::visitStore(const StoreInst &I) {
     MMOFlags |= MachineMemOperand::MONonTemporal;
   MMOFlags |= TLI.getMMOFlags(I);
 
+  // See visitLoad comments.
+  const MDNode *PartsType =
+      NumValues == 1 ? I.getMetadata(PartsTypeMetadata::MetadataKindString)
+                     : nullptr;
+
   // An aggregate load cannot wrap around the address space, so offsets to its
   // parts don't wrap either.
   SDNodeFlags Flags;
@@ -3792,6 +3806,8 @@ void SelectionDAGBuilder::visitStore(const StoreInst &I) {
     SDValue St = DAG.getStore(
         Root, dl, SDValue(Src.getNode(), Src.getResNo() + i), Add,
         MachinePointerInfo(PtrV, Offsets[i]), Alignment, MMOFlags, AAInfo);
+    if (PartsType)
+      cast<MemSDNode>(St)->getMemOperand()->setPartsType(PartsType);
     Chains[ChainI] = St;
   }
 
@@ -130,6 +130,8 @@ static void computeCacheKey(
   AddUnsigned(Conf.UseNewPM);
   AddString(Conf.OptPipeline);
   AddString(Conf.AAPipeline);
+  for (auto &P : Conf.PassPlugins)
+    AddString(P);
   AddString(Conf.OverrideTriple);
   AddString(Conf.DefaultTriple);
 
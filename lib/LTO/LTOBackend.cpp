@@ -28,6 +28,7 @@
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Object/ModuleSymbolTable.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/TargetRegistry.h"
@@ -233,9 +234,21 @@ static void runNewPMCustomPasses(Module &Mod, TargetMachine *TM,
   MPM.run(Mod, MAM);
 }
 
+static void loadPassPlugins(const Config &Conf) {
+  // Loading an already loaded library is a no-op, so this is safe to repeat
+  // for every backend task.
+  for (auto &Plugin : Conf.PassPlugins) {
+    std::string Err;
+    if (sys::DynamicLibrary::LoadLibraryPermanently(Plugin.c_str(), &Err))
+      report_fatal_error("unable to load pass plugin '" + Plugin + "': " + Err);
+  }
+}
+
 static void runOldPMPasses(Config &Conf, Module &Mod, TargetMachine *TM,
                            bool IsThinLTO, ModuleSummaryIndex *ExportSummary,
                            const ModuleSummaryIndex *ImportSummary) {
+  loadPassPlugins(Conf);
+
   legacy::PassManager passes;
   passes.add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
 
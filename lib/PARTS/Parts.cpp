@@ -9,6 +9,7 @@
 //===----------------------------------------------------------------------===//
 
 #include <llvm/PARTS/Parts.h>
+#include <llvm/PARTS/PartsTypeIdHash.h>
 #include <llvm/Support/raw_ostream.h>
 #include "llvm/Support/CommandLine.h"
 
@@ -26,14 +27,78 @@ static cl::opt<bool> EnablePartsDpi("parts-dpi", cl::Hidden,
                                     cl::desc("PARTS backward-edge CFI"),
                                     cl::init(false));
 
+// Off until spill slots are instrumented, post-RA DPI also protects the spills
+static cl::opt<bool> EnablePartsDpiPreRA("parts-dpi-prera", cl::Hidden,
+                                         cl::desc("Instrument data pointers before register allocation"),
+                                         cl::init(false));
+
+static cl::opt<bool> EnablePartsDpiSinkAut("parts-dpi-sink-aut", cl::Hidden,
+                                          cl::desc("Authenticate loaded data pointers in the cheapest block "
+                                                   "dominating their uses instead of right after the load, "
+                                                   "comparisons of the pointer count as uses too"),
+                                          cl::init(false));
+
+static cl::opt<bool> EnablePartsDpiEscapeAnalysis("parts-dpi-escape-analysis", cl::Hidden,
+                                                  cl::desc("Skip DPI for pointers stored in non-escaping stack slots"),
+                                                  cl::init(false));
+
+static cl::opt<bool> EnablePartsLazyGlobals("parts-lazy-globals", cl::Hidden,
+                                            cl::desc("PAC pointer globals on first use instead of at startup"),
+                                            cl::init(false));
+
 static cl::opt<bool> UseDummyInstructions("parts-dummy", cl::Hidden,
                                           cl::desc("Use dummy instructions and XOR instead of PA"),
                                           cl::init(false));
 
+static cl::opt<bool> UseSoftPa("parts-soft-pa", cl::Hidden,
+                               cl::desc("Compute PACs in software with QARMA-64 instead of using PA instructions"),
+                               cl::init(false));
+
 static cl::opt<bool> EnablePartsRuntimeStats("parts-stats", cl::Hidden,
                                           cl::desc("Invoke stat counting functions to count various events"),
                                           cl::init(false));
 
+static cl::opt<bool> EnablePartsRuntimeStatsInline("parts-stats-inline", cl::Hidden,
+                                                   cl::desc("Count -parts-stats events in an inline counter array"),
+                                                   cl::init(false));
+
+static cl::opt<bool> EnablePartsLogStats("parts-log-stats", cl::Hidden,
+                                         cl::desc("Record the detailed PartsLog statistics and dump them at exit"),
+                                         cl::init(false));
+
+static cl::opt<bool> EnablePartsModifierOpt("parts-modifier-opt", cl::Hidden,
+                                            cl::desc("Remove and hoist redundant PA modifier materializations"),
+                                            cl::init(true));
+
+static cl::opt<bool> EnablePartsPipeline("parts-pipeline", cl::Hidden,
+                                         cl::desc("Add the PARTS IR passes to the standard and LTO pass pipelines"),
+                                         cl::init(true));
+
+static cl::opt<bool> EnablePartsIcp("parts-icp", cl::Hidden,
+                                    cl::desc("Promote indirect calls with few possible targets during LTO"),
+                                    cl::init(true));
+
+static cl::opt<bool> EnablePartsWholeProgram("parts-whole-program", cl::Hidden,
+                                            cl::desc("Treat the full LTO module as the whole program, code pointers "
+                                                     "of types never called indirectly in it are then not PACed"),
+                                            cl::init(false));
+
+static cl::opt<PARTS::TypeIdHash> PartsTypeIdHash("parts-typeid-hash", cl::Hidden,
+                                                  cl::desc("Hash function used to compute type_ids"),
+                                                  cl::values(clEnumValN(PARTS::TypeIdHash::SHA3, "sha3", "SHA3-256"),
+                                                             clEnumValN(PARTS::TypeIdHash::MD5, "md5", "MD5"),
+                                                             clEnumValN(PARTS::TypeIdHash::XXHash, "xxhash", "xxHash64")),
+                                                  cl::init(PARTS::TypeIdHash::SHA3));
+
+static cl::opt<std::string> PartsOverheadReport("parts-overhead-report", cl::Hidden,
+                                                cl::desc("Write a YAML report of the estimated PARTS overhead "
+                                                         "of each function to this file"),
+                                                cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool> EnablePartsTypeIdCollisionCheck("parts-typeid-collisions", cl::Hidden,
+                                                     cl::desc("Warn about distinct types with the same type_id"),
+                                                     cl::init(false));
+
 bool llvm::PARTS::useBeCfi() {
   return EnablePartsBeCfi;
 }
@@ -46,6 +111,22 @@ bool llvm::PARTS::useDpi() {
   return EnablePartsDpi;
 }
 
+bool llvm::PARTS::useDpiPreRA() {
+  return EnablePartsDpiPreRA;
+}
+
+bool llvm::PARTS::useDpiSinkAut() {
+  return EnablePartsDpiSinkAut;
+}
+
+bool llvm::PARTS::useDpiEscapeAnalysis() {
+  return EnablePartsDpiEscapeAnalysis;
+}
+
+bool llvm::PARTS::useLazyGlobals() {
+  return EnablePartsLazyGlobals;
+}
+
 bool llvm::PARTS::useAny() {
   return EnablePartsDpi || EnablePartsFeCfi || EnablePartsBeCfi;
 }
@@ -54,6 +135,55 @@ bool llvm::PARTS::useDummy() {
   return UseDummyInstructions;
 }
 
+bool llvm::PARTS::useSoftPa() {
+  return UseSoftPa;
+}
+
 bool llvm::PARTS::useRuntimeStats() {
   return EnablePartsRuntimeStats;
 }
+
+bool llvm::PARTS::useRuntimeStatsInline() {
+  return EnablePartsRuntimeStats && EnablePartsRuntimeStatsInline;
+}
+
+bool llvm::PARTS::useLogStats() {
+  return EnablePartsLogStats;
+}
+
+bool llvm::PARTS::useModifierOpt() {
+  return EnablePartsModifierOpt;
+}
+
+bool llvm::PARTS::usePipeline() {
+  return EnablePartsPipeline;
+}
+
+bool llvm::PARTS::useIcp() {
+  return EnablePartsIcp;
+}
+
+bool llvm::PARTS::useWholeProgram() {
+  return EnablePartsWholeProgram;
+}
+
+bool llvm::PARTS::useTypeIdCollisionCheck() {
+  return EnablePartsTypeIdCollisionCheck;
+}
+
+PARTS::TypeIdHash llvm::PARTS::getTypeIdHash() {
+  return PartsTypeIdHash;
+}
+
+bool llvm::PARTS::useOverheadReport() {
+  return !PartsOverheadReport.empty();
+}
+
+std::string llvm::PARTS::getOverheadReportFile() {
+  return PartsOverheadReport;
+}
+
+bool llvm::PARTS::needsModifierReg() {
+  // Only the post-RA instrumentation needs a fixed modifier register
+  return (EnablePartsDpi && !EnablePartsDpiPreRA) || EnablePartsBeCfi;
+}
@@ -10,12 +10,104 @@
 
 #include "llvm/PARTS/PartsEventCount.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/PARTS/Parts.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 namespace llvm {
 
 namespace PARTS {
 
+constexpr const char *PartsEventCount::CounterSection;
+
+static const char *InlineCountersName = "__parts_counters";
+static const char *InlineCounterNamesName = "__parts_counter_names";
+static const char *InlineCounterSlotAttr = "parts-counter-slot";
+
+Function *PartsEventCount::getCounterFunc(Module &M, EventKind kind) {
+  switch (kind) {
+    case CodePointerBranch: return getFuncCodePointerBranch(M);
+    case CodePointerCreate: return getFuncCodePointerCreate(M);
+    case DataStr: return getFuncDataStr(M);
+    case DataLdr: return getFuncDataLdr(M);
+    case NonleafCall: return getFuncNonleafCall(M);
+    case LeafCall: return getFuncLeafCall(M);
+    case NumEventKinds: break;
+  }
+  llvm_unreachable("invalid PARTS event kind");
+}
+
+GlobalVariable *PartsEventCount::getInlineCounters(const Module &M) {
+  return M.getGlobalVariable(InlineCountersName, true);
+}
+
+bool PartsEventCount::hasInlineCounters(const Function &F) {
+  return F.hasFnAttribute(InlineCounterSlotAttr);
+}
+
+uint64_t PartsEventCount::getInlineCounterOffset(const Function &F, EventKind kind) {
+  assert(hasInlineCounters(F) && "function has no inline counters");
+  uint64_t slot;
+  const auto failed = F.getFnAttribute(InlineCounterSlotAttr).getValueAsString().getAsInteger(10, slot);
+  assert(!failed && "malformed inline counter slot");
+  (void) failed;
+  return (slot * NumEventKinds + kind) * sizeof(uint64_t);
+}
+
+GlobalVariable *PartsEventCount::createInlineCounters(Module &M) {
+  if (auto counters = getInlineCounters(M))
+    return counters;
+
+  auto &C = M.getContext();
+  auto I64Ty = Type::getInt64Ty(C);
+  auto I8PtrTy = Type::getInt8PtrTy(C);
+
+  // Give each defined function its own slot, and record the function name for the runtime
+  std::vector<Constant *> names;
+  for (auto &F : M) {
+    if (F.isDeclaration() || F.getFnAttribute("no-parts").getValueAsString() == "true")
+      continue;
+    F.addFnAttr(InlineCounterSlotAttr, std::to_string(names.size()));
+    auto name = ConstantDataArray::getString(C, F.getName());
+    auto nameVar = new GlobalVariable(M, name->getType(), true, GlobalValue::PrivateLinkage, name);
+    nameVar->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    names.push_back(ConstantExpr::getPointerCast(nameVar, I8PtrTy));
+  }
+
+  auto countersTy = ArrayType::get(I64Ty, std::max<uint64_t>(1, names.size()) * NumEventKinds);
+  auto counters = new GlobalVariable(M, countersTy, false, GlobalValue::InternalLinkage,
+                                     ConstantAggregateZero::get(countersTy), InlineCountersName);
+  counters->setSection(CounterSection);
+  counters->setAlignment(64);
+
+  auto namesTy = ArrayType::get(I8PtrTy, names.size());
+  auto namesVar = new GlobalVariable(M, namesTy, true, GlobalValue::InternalLinkage,
+                                     ConstantArray::get(namesTy, names), InlineCounterNamesName);
+
+  // static void ctor() { __parts_counters_register(counters, names, funcs, kinds); }
+  auto registerTy = FunctionType::get(Type::getVoidTy(C),
+                                      { I64Ty->getPointerTo(), I8PtrTy->getPointerTo(), I64Ty, I64Ty }, false);
+  auto registerFunc = M.getOrInsertFunction("__parts_counters_register", registerTy);
+
+  auto ctor = Function::Create(FunctionType::get(Type::getVoidTy(C), false), GlobalValue::InternalLinkage,
+                               "__parts_counters_ctor", &M);
+  ctor->addFnAttr("no-parts", "true");
+
+  IRBuilder<> builder(BasicBlock::Create(C, "entry", ctor));
+  builder.CreateCall(registerFunc, {
+      builder.CreateConstInBoundsGEP2_64(counters, 0, 0),
+      builder.CreateConstInBoundsGEP2_64(namesVar, 0, 0),
+      builder.getInt64(names.size()),
+      builder.getInt64(NumEventKinds)
+  });
+  builder.CreateRetVoid();
+
+  appendToGlobalCtors(M, ctor, 65535);
+
+  return counters;
+}
+
 Function *PartsEventCount::getCounterFunc(Module &M, const std::string &fName) {
   if (auto f = M.getFunction(fName)) {
     assert(f != nullptr);
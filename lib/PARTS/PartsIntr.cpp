@@ -18,10 +18,10 @@
 using namespace llvm;
 using namespace llvm::PARTS;
 
-Value *PartsIntr::pac_pointer(IRBuilder<> *builder, Module &M, Value *V, const std::string &name, PartsTypeMetadata_ptr PTMD) {
+Value *PartsIntr::pac_pointer(IRBuilder<> *builder, Module &M, Value *V, const std::string &name, PartsTypeMetadata_opt PTMD) {
   // Get the intrinsic declaration based on our specific pointer type
   Type *arg_types[] = { V->getType() };
-  if (PTMD == nullptr)
+  if (!PTMD)
     PTMD = PartsTypeMetadata::get(V->getType());
 
   auto pacIntr = Intrinsic::getDeclaration(&M,
@@ -41,19 +41,19 @@ Value *PartsIntr::pac_pointer(Function &F, Instruction &I, Value *V, const std::
   return pac_pointer(&Builder, *F.getParent(), V, name);
 }
 
-Value *PartsIntr::load_aut_pointer(Function &F, Instruction &I, PartsTypeMetadata_ptr partsMD) {
-  assert(partsMD->isPointer());
+Value *PartsIntr::load_aut_pointer(Function &F, Instruction &I, const PartsTypeMetadata &partsMD) {
+  assert(partsMD.isPointer());
 
   IRBuilder<> Builder(&I);
 
   //auto *mod = Builder.CreateLoad(partsMD->getTypeIdConstant(F.getContext()));
-  auto *mod = partsMD->getTypeIdConstant(F.getContext());
+  auto *mod = partsMD.getTypeIdConstant(F.getContext());
   auto *ptr = Builder.Insert(I.clone());
 
   // Insert the unPAC/AUT intrinsic
 
   Type *arg_types[] = { I.getType() };
-  auto aut = partsMD->isCodePointer() ?
+  auto aut = partsMD.isCodePointer() ?
              Intrinsic::getDeclaration(F.getParent(), Intrinsic::pa_autia, arg_types) :
              Intrinsic::getDeclaration(F.getParent(), Intrinsic::pa_autda, arg_types);
 
@@ -70,19 +70,19 @@ Value *PartsIntr::load_aut_pointer(Function &F, Instruction &I, PartsTypeMetadat
   return nullptr;
 }
 
-Value *PartsIntr::store_aut_pointer(Function &F, Instruction &I, PartsTypeMetadata_ptr PTMD) {
-  assert(PTMD->isPointer());
+Value *PartsIntr::store_aut_pointer(Function &F, Instruction &I, const PartsTypeMetadata &PTMD) {
+  assert(PTMD.isPointer());
 
   IRBuilder<> Builder(&I);
 
   //auto *mod = Builder.CreateLoad(partsMD->getTypeIdConstant(F.getContext()));
-  auto *mod = PTMD->getTypeIdConstant(F.getContext());
+  auto *mod = PTMD.getTypeIdConstant(F.getContext());
   auto *ptr = Builder.Insert(I.clone());
 
   // Insert the unPAC/AUT intrinsic
 
   Type *arg_types[] = { I.getType() };
-  auto aut = PTMD->isCodePointer() ?
+  auto aut = PTMD.isCodePointer() ?
              Intrinsic::getDeclaration(F.getParent(), Intrinsic::pa_pacia, arg_types) :
              Intrinsic::getDeclaration(F.getParent(), Intrinsic::pa_pacda, arg_types);
 
@@ -10,9 +10,8 @@
 
 #include "llvm/PARTS/PartsLog.h"
 
-#include <mutex>
-#include <unordered_map>
 #include <unistd.h>
+#include "llvm/PARTS/Parts.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace llvm {
@@ -33,7 +32,7 @@ PARTS::PartsLogStream PartsLog::debug() {
   return PartsLogStream(get_ostream(m_enabled, raw_ostream::CYAN));
 }
 
-PARTS::PartsLogStream PartsLog::debug(const std::string &F) {
+PARTS::PartsLogStream PartsLog::debug(StringRef F) {
   return PartsLogStream(get_ostream(m_enabled, F, raw_ostream::CYAN));
 }
 
@@ -41,7 +40,7 @@ PARTS::PartsLogStream PartsLog::info() {
   return PartsLogStream(get_ostream(m_enabled, raw_ostream::WHITE));
 }
 
-PARTS::PartsLogStream PartsLog::info(const std::string &F) {
+PARTS::PartsLogStream PartsLog::info(StringRef F) {
   return PartsLogStream(get_ostream(m_enabled, F, raw_ostream::WHITE));
 }
 
@@ -61,45 +60,32 @@ PARTS::PartsLogStream PartsLog::error() {
   return PartsLogStream(get_ostream(true, raw_ostream::MAGENTA));
 }
 
-PARTS::PartsLogStream PartsLog::error(const std::string &F) {
+PARTS::PartsLogStream PartsLog::error(StringRef F) {
   return PartsLogStream(get_ostream(true, F, raw_ostream::MAGENTA));
 }
 
-std::mutex _mutex;
-
 PartsLog_ptr PartsLog::getLogger(const std::string &name)
 {
-  static auto loggers = std::unordered_map<std::string, std::shared_ptr<PartsLog>>();
-
-  std::unique_lock<std::mutex> lock(_mutex);
-
-  auto found = loggers.find(name);
-  if (found != loggers.end()) {
-    return found->second;
-  } else {
-    auto newLogger = std::make_shared<PartsLog>(name);
-    loggers.insert({name, newLogger});
-    return newLogger;
-  }
+  return std::make_shared<PartsLog>(name);
 }
 
-PartsLogStream PartsLog::inc(const std::string &var, bool b, const std::string &F, unsigned num) {
+PartsLogStream PartsLog::inc(const Twine &var, bool b, StringRef F, unsigned num) {
   return b ? inc(var, raw_ostream::GREEN, F, num) : inc(var, raw_ostream::RED, F, num);
 }
 
-PartsLogStream PartsLog::dec(const std::string &var, bool b, const std::string &F) {
+PartsLogStream PartsLog::dec(const Twine &var, bool b, StringRef F) {
   return b ? dec(var, raw_ostream::GREEN, F) : dec(var, raw_ostream::RED, F);
 }
 
-PartsLogStream PartsLog::inc(const std::string &var, const raw_ostream::Colors c, const std::string &F, unsigned num) {
-  auto &s = getStats();
-  s.inc(var, num);
+PartsLogStream PartsLog::inc(const Twine &var, const raw_ostream::Colors c, StringRef F, unsigned num) {
+  if (PARTS::useLogStats())
+    getStats().inc(var.str(), num);
   return PartsLogStream(get_ostream(m_enabled, F, c));
 }
 
-PartsLogStream PartsLog::dec(const std::string &var, const raw_ostream::Colors c, const std::string &F) {
-  auto &s = getStats();
-  s.dec(var);
+PartsLogStream PartsLog::dec(const Twine &var, const raw_ostream::Colors c, StringRef F) {
+  if (PARTS::useLogStats())
+    getStats().dec(var.str());
   return PartsLogStream(get_ostream(m_enabled, F, c));
 }
 
@@ -109,42 +95,76 @@ PartsLog::Stats &PartsLog::getStats() {
   return stats;
 }
 
-PartsLog::Stats::Stats() {
-  m_stats = std::map<std::string,int>();
-}
+/*! Counters of a single thread, the mutex is only contended when the statistics are dumped */
+class PartsLog::Stats::Shard {
+public:
+  Stats &owner;
+  std::mutex mutex;
+  std::map<std::string, int> counts;
+
+  explicit Shard(Stats &owner) : owner(owner) { owner.addShard(this); }
+  ~Shard() { owner.removeShard(this); }
+
+  void add(const std::string &var, int num) {
+    std::lock_guard<std::mutex> lock(mutex);
+    counts[var] += num;
+  }
+};
+
+PartsLog::Stats::Stats() = default;
 
 PartsLog::Stats::~Stats() {
-  dump();
+  // Nothing is recorded unless -parts-log-stats was given
+  if (!m_stats.empty() || !m_shards.empty())
+    dump();
+}
+
+PartsLog::Stats::Shard &PartsLog::Stats::getShard() {
+  static thread_local Shard shard(*this);
+  return shard;
+}
+
+void PartsLog::Stats::addShard(Shard *shard) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_shards.insert(shard);
+}
+
+void PartsLog::Stats::removeShard(Shard *shard) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::lock_guard<std::mutex> shardLock(shard->mutex);
+  for (const auto &p : shard->counts)
+    m_stats[p.first] += p.second;
+  m_shards.erase(shard);
 }
 
 void PartsLog::Stats::dump() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Aggregate the exited threads with the ones that are still around
+  auto totals = m_stats;
+  for (auto shard : m_shards) {
+    std::lock_guard<std::mutex> shardLock(shard->mutex);
+    for (const auto &p : shard->counts)
+      totals[p.first] += p.second;
+  }
+
   errs() << "\n//---------------- Dumping PartsLog::Stats --------------------//\n";
 
-  if (m_stats.empty())
+  if (totals.empty())
     errs() << "EMPTY!!!\n";
 
-  for (auto p : m_stats)
+  for (const auto &p : totals)
     errs() << p.first << ": " << p.second << "\n";
 
   errs() << "//---------------- done ---------------------------------------//\n\n";
 }
 
 void PartsLog::Stats::inc(const std::string &var, const unsigned num) {
-  auto found = m_stats.find(var);
-  if (found == m_stats.end()) {
-    m_stats.insert({var, num});
-  } else {
-    found->second++;
-  }
+  getShard().add(var, num);
 }
 
 void PartsLog::Stats::dec(const std::string &var, const unsigned num) {
-  auto found = m_stats.find(var);
-  if (found == m_stats.end()) {
-    m_stats.insert({var, -num});
-  } else {
-    found->second--;
-  }
+  getShard().add(var, -static_cast<int>(num));
 }
 
 
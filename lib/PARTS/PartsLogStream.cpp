@@ -11,6 +11,7 @@
 #include <llvm/PARTS/PartsLogStream.h>
 
 #include "llvm/PARTS/PartsLogStream.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
 
 namespace llvm {
 
@@ -19,80 +20,80 @@ namespace PARTS {
 PartsLogStream::PartsLogStream(llvm::raw_ostream &ostream)
     : m_ostream(&ostream) {}
 
+PartsLogStream::PartsLogStream(llvm::raw_ostream *ostream)
+    : m_ostream(ostream) {}
+
 PartsLogStream::~PartsLogStream() {
   resetColor();
 }
 
 PartsLogStream &PartsLogStream::operator<<(const std::string &str) {
-  *m_ostream << str;
-  return *this;
+  return forward([&](raw_ostream &os) { os << str; });
+}
+
+PartsLogStream &PartsLogStream::operator<<(StringRef str) {
+  return forward([&](raw_ostream &os) { os << str; });
+}
+
+PartsLogStream &PartsLogStream::operator<<(const Twine &str) {
+  return forward([&](raw_ostream &os) { os << str; });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const unsigned long &str) {
-  *m_ostream << str;
-  return *this;
+  return forward([&](raw_ostream &os) { os << str; });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const long &str) {
-  *m_ostream << str;
-  return *this;
+  return forward([&](raw_ostream &os) { os << str; });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const int &str) {
-  *m_ostream << str;
-  return *this;
+  return forward([&](raw_ostream &os) { os << str; });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const unsigned &str) {
-  *m_ostream << str;
-  return *this;
+  return forward([&](raw_ostream &os) { os << str; });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const Instruction &I) {
-  I.print(*m_ostream, true);
-  return *this;
+  return forward([&](raw_ostream &os) { I.print(os, true); });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const char *str) {
-  *m_ostream << str;
-  return *this;
+  return forward([&](raw_ostream &os) { os << str; });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const Module::global_iterator &GV) {
-  GV->print(*m_ostream, true);
-  return *this;
+  return forward([&](raw_ostream &os) { GV->print(os, true); });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const GlobalVariable &GV) {
-  GV.print(*m_ostream, true);
-  return *this;
+  return forward([&](raw_ostream &os) { GV.print(os, true); });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const MachineBasicBlock::instr_iterator &MI) {
-  MI->print(*m_ostream);
-  return *this;
+  return forward([&](raw_ostream &os) { MI->print(os); });
 }
 
 PartsLogStream &PartsLogStream::resetColor() {
-  m_ostream->resetColor();
-  return *this;
+  return forward([](raw_ostream &os) { os.resetColor(); });
 }
 
 PartsLogStream &PartsLogStream::changeColor(enum raw_ostream::Colors color, bool bold, bool bg) {
-  m_ostream->changeColor(color, bold, bg);
-  return *this;
+  return forward([&](raw_ostream &os) { os.changeColor(color, bold, bg); });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const Value *I) {
-  I->print(*m_ostream);
-  return *this;
+  return forward([&](raw_ostream &os) { I->print(os); });
 }
 
 PartsLogStream &PartsLogStream::operator<<(const Type *T) {
-  T->print(*m_ostream);
-  return *this;
+  return forward([&](raw_ostream &os) { T->print(os); });
 }
 
+PartsLogStream &PartsLogStream::operator<<(const PartsTypeMetadata &PTMD) {
+  return forward([&](raw_ostream &os) { os << PTMD.toString(); });
+}
 
 } // namespace PARTS
 
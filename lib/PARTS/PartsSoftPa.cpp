@@ -0,0 +1,397 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// QARMA-64 and the AddPAC/Auth pointer layout of the Arm ARM pseudocode. The
+// algorithm is written once over a small set of operations, which are either
+// evaluated directly or emitted as IR for the helpers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/PARTS/PartsSoftPa.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+
+namespace llvm {
+
+namespace PARTS {
+
+namespace {
+
+const char *HelperNames[PartsSoftPa::NumOps] = {
+    "__parts_soft_pacia",
+    "__parts_soft_pacda",
+    "__parts_soft_autia",
+    "__parts_soft_autda",
+};
+const char *ComputePacName = "__parts_soft_computepac";
+const char *KeysName = "__parts_soft_pa_keys";
+
+/* Used until a runtime provides the keys, { IA<63:0>, IA<127:64>, DA<63:0>, DA<127:64> } */
+const uint64_t DefaultKeys[4] = { 0x84be85ce9804e94bULL, 0xec2802d4e0a488e9ULL,
+                                  0x477d469dec0b8762ULL, 0xfb623599da6e8127ULL };
+
+const uint64_t Alpha = 0xC0AC29B7C97C50DDULL;
+const uint64_t RC[5] = { 0x0000000000000000ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL,
+                         0x082EFA98EC4E6C89ULL, 0x452821E638D01377ULL };
+
+/* The S-box and its inverse, with output i in cell i */
+const uint64_t Sub = 0xA12D5473E90CF86BULL;
+const uint64_t InvSub = 0x37C40F6291BA8DE5ULL;
+
+/* The input cell of each output cell of PACCellShuffle and PACCellInvShuffle */
+const uint8_t CellShuffle[16] = { 13, 6, 11, 0, 7, 12, 1, 10, 8, 3, 14, 5, 2, 9, 4, 15 };
+const uint8_t CellInvShuffle[16] = { 3, 6, 12, 9, 14, 11, 1, 4, 8, 13, 7, 2, 5, 0, 10, 15 };
+
+/* The input cell of each output cell of TweakShuffle and TweakInvShuffle, and whether the cell is also rotated */
+const uint8_t TweakShuffle[16] = { 4, 5, 6, 7, 11, 2, 3, 8, 12, 13, 14, 15, 0, 1, 10, 9 };
+const bool TweakShuffleRot[16] = { false, false, true, false, true, false, false, true,
+                                   false, false, false, true, true, false, true, true };
+const uint8_t TweakInvShuffle[16] = { 12, 13, 5, 6, 0, 1, 2, 3, 7, 15, 14, 4, 8, 9, 10, 11 };
+const bool TweakInvShuffleRot[16] = { true, false, false, false, false, false, true, false,
+                                      true, true, true, true, false, false, false, true };
+
+/* The PAC starts above a 48-bit virtual address */
+const unsigned BottomPacBit = 48;
+const uint64_t VaMask = (1ULL << BottomPacBit) - 1;
+
+/* Evaluates the operations directly */
+struct ConstOps {
+  typedef uint64_t V;
+
+  V imm(uint64_t v) { return v; }
+  V eor(V a, V b) { return a ^ b; }
+  V orr(V a, V b) { return a | b; }
+  V andi(V a, uint64_t mask) { return a & mask; }
+  V shl(V a, unsigned n) { return a << n; }
+  V lshr(V a, unsigned n) { return a >> n; }
+  V lshrv(V a, V n) { return a >> n; }
+  V selectEq(V a, V b, V t, V f) { return a == b ? t : f; }
+  V computePac(V data, V modifier, V key0, V key1);
+};
+
+/* Emits the operations as IR, ComputePAC is called instead of inlined */
+struct IROps {
+  typedef Value *V;
+
+  IRBuilder<> &B;
+  Function *ComputePac;
+
+  V imm(uint64_t v) { return B.getInt64(v); }
+  V eor(V a, V b) { return B.CreateXor(a, b); }
+  V orr(V a, V b) { return B.CreateOr(a, b); }
+  V andi(V a, uint64_t mask) { return B.CreateAnd(a, mask); }
+  V shl(V a, unsigned n) { return B.CreateShl(a, n); }
+  V lshr(V a, unsigned n) { return B.CreateLShr(a, n); }
+  V lshrv(V a, V n) { return B.CreateLShr(a, n); }
+  V selectEq(V a, V b, V t, V f) { return B.CreateSelect(B.CreateICmpEQ(a, b), t, f); }
+  V computePac(V data, V modifier, V key0, V key1) {
+    return B.CreateCall(ComputePac, { data, modifier, key0, key1 });
+  }
+};
+
+template <typename Ops, typename V = typename Ops::V>
+V getCell(Ops &O, V x, unsigned i) {
+  return O.andi(O.lshr(x, 4 * i), 0xf);
+}
+
+/* RotCell, rotate a cell left by n */
+template <typename Ops, typename V = typename Ops::V>
+V rotCell(Ops &O, V cell, unsigned n) {
+  return O.andi(O.orr(O.shl(cell, n), O.lshr(cell, 4 - n)), 0xf);
+}
+
+/* TweakCellRot, outcell<3> = incell<0> EOR incell<1>, outcell<2:0> = incell<3:1> */
+template <typename Ops, typename V = typename Ops::V>
+V tweakCellRot(Ops &O, V cell) {
+  return O.orr(O.lshr(cell, 1), O.shl(O.andi(O.eor(cell, O.lshr(cell, 1)), 1), 3));
+}
+
+/* TweakCellInvRot, outcell<3:1> = incell<2:0>, outcell<0> = incell<0> EOR incell<3> */
+template <typename Ops, typename V = typename Ops::V>
+V tweakCellInvRot(Ops &O, V cell) {
+  return O.orr(O.andi(O.shl(cell, 1), 0xf), O.eor(O.andi(cell, 1), O.lshr(cell, 3)));
+}
+
+template <typename Ops, typename V = typename Ops::V>
+V shuffleCells(Ops &O, V x, const uint8_t (&src)[16]) {
+  V out = O.imm(0);
+  for (unsigned i = 0; i < 16; i++)
+    out = O.orr(out, O.shl(getCell(O, x, src[i]), 4 * i));
+  return out;
+}
+
+template <typename Ops, typename V = typename Ops::V>
+V shuffleTweak(Ops &O, V x, const uint8_t (&src)[16], const bool (&rot)[16], bool inverse) {
+  V out = O.imm(0);
+  for (unsigned i = 0; i < 16; i++) {
+    V cell = getCell(O, x, src[i]);
+    if (rot[i])
+      cell = inverse ? tweakCellInvRot(O, cell) : tweakCellRot(O, cell);
+    out = O.orr(out, O.shl(cell, 4 * i));
+  }
+  return out;
+}
+
+/* PACSub and PACInvSub, the S-box is looked up by shifting the packed table */
+template <typename Ops, typename V = typename Ops::V>
+V subCells(Ops &O, V x, uint64_t sbox) {
+  V out = O.imm(0);
+  for (unsigned i = 0; i < 16; i++) {
+    V cell = O.andi(O.lshrv(O.imm(sbox), O.shl(getCell(O, x, i), 2)), 0xf);
+    out = O.orr(out, O.shl(cell, 4 * i));
+  }
+  return out;
+}
+
+/* PACMult, the MixColumns-like involution */
+template <typename Ops, typename V = typename Ops::V>
+V mult(Ops &O, V x) {
+  V out = O.imm(0);
+  for (unsigned i = 0; i < 4; i++) {
+    V c0 = getCell(O, x, i);
+    V c4 = getCell(O, x, i + 4);
+    V c8 = getCell(O, x, i + 8);
+    V c12 = getCell(O, x, i + 12);
+
+    V t0 = O.eor(O.eor(rotCell(O, c8, 1), rotCell(O, c4, 2)), rotCell(O, c0, 1));
+    V t1 = O.eor(O.eor(rotCell(O, c12, 1), rotCell(O, c4, 1)), rotCell(O, c0, 2));
+    V t2 = O.eor(O.eor(rotCell(O, c12, 2), rotCell(O, c8, 1)), rotCell(O, c0, 1));
+    V t3 = O.eor(O.eor(rotCell(O, c12, 1), rotCell(O, c8, 2)), rotCell(O, c4, 1));
+
+    out = O.orr(out, O.shl(t3, 4 * i));
+    out = O.orr(out, O.shl(t2, 4 * (i + 4)));
+    out = O.orr(out, O.shl(t1, 4 * (i + 8)));
+    out = O.orr(out, O.shl(t0, 4 * (i + 12)));
+  }
+  return out;
+}
+
+template <typename Ops, typename V = typename Ops::V>
+V computePacImpl(Ops &O, V data, V modifier, V key0, V key1) {
+  // modk0 = key0<0>:key0<63:2>:(key0<63> EOR key0<1>)
+  V modk0 = O.orr(O.shl(key0, 63), O.eor(O.lshr(key0, 1), O.lshr(key0, 63)));
+  V runningMod = modifier;
+  V workingVal = O.eor(data, key0);
+
+  for (unsigned i = 0; i <= 4; i++) {
+    workingVal = O.eor(workingVal, O.eor(key1, runningMod));
+    workingVal = O.eor(workingVal, O.imm(RC[i]));
+    if (i > 0) {
+      workingVal = shuffleCells(O, workingVal, CellShuffle);
+      workingVal = mult(O, workingVal);
+    }
+    workingVal = subCells(O, workingVal, Sub);
+    runningMod = shuffleTweak(O, runningMod, TweakShuffle, TweakShuffleRot, false);
+  }
+
+  workingVal = O.eor(workingVal, O.eor(modk0, runningMod));
+  workingVal = shuffleCells(O, workingVal, CellShuffle);
+  workingVal = mult(O, workingVal);
+  workingVal = subCells(O, workingVal, Sub);
+  workingVal = shuffleCells(O, workingVal, CellShuffle);
+  workingVal = mult(O, workingVal);
+  workingVal = O.eor(key1, workingVal);
+  workingVal = shuffleCells(O, workingVal, CellInvShuffle);
+  workingVal = subCells(O, workingVal, InvSub);
+  workingVal = mult(O, workingVal);
+  workingVal = shuffleCells(O, workingVal, CellInvShuffle);
+  workingVal = O.eor(workingVal, key0);
+  workingVal = O.eor(workingVal, runningMod);
+
+  for (unsigned i = 0; i <= 4; i++) {
+    workingVal = subCells(O, workingVal, InvSub);
+    if (i < 4) {
+      workingVal = mult(O, workingVal);
+      workingVal = shuffleCells(O, workingVal, CellInvShuffle);
+    }
+    runningMod = shuffleTweak(O, runningMod, TweakInvShuffle, TweakInvShuffleRot, true);
+    workingVal = O.eor(workingVal, O.imm(RC[4 - i]));
+    workingVal = O.eor(workingVal, O.eor(key1, runningMod));
+    workingVal = O.eor(workingVal, O.imm(Alpha));
+  }
+
+  return O.eor(workingVal, modk0);
+}
+
+/* Bit 55 selects between the upper and lower address range for both code and data */
+constexpr unsigned SelectBit = 55;
+
+/* Data pointers use top-byte-ignore, so their extension bits end below the top byte */
+inline unsigned getTopBit(bool isData) { return isData ? 55 : 63; }
+
+/* The extension bits, from the bottom PAC bit up to and including the top bit */
+inline uint64_t getExtMask(bool isData) { return (isData ? 0xffULL : 0xffffULL) << BottomPacBit; }
+
+/* The bits that hold the PAC, everything in the extension bits except the select bit */
+inline uint64_t getPacMask(bool isData) { return (isData ? 0x7fULL : 0xff7fULL) << BottomPacBit; }
+
+/* Replace the extension bits of ptr with copies of bit selBit */
+template <typename Ops, typename V = typename Ops::V>
+V extendPointer(Ops &O, V ptr, unsigned selBit, bool isData) {
+  const auto extMask = getExtMask(isData);
+  V ext = O.selectEq(O.andi(O.lshr(ptr, selBit), 1), O.imm(0), O.imm(0), O.imm(extMask));
+  return O.orr(O.andi(ptr, ~extMask), ext);
+}
+
+template <typename Ops, typename V = typename Ops::V>
+V addPacImpl(Ops &O, V ptr, V modifier, V key0, V key1, bool isData) {
+  const auto topBit = getTopBit(isData);
+  const auto pacMask = getPacMask(isData);
+  const auto rangeMask = getExtMask(isData) >> BottomPacBit;
+
+  V pac = O.computePac(extendPointer(O, ptr, SelectBit, isData), modifier, key0, key1);
+
+  // Corrupt the PAC of a pointer without good extension bits, so that it can never be authenticated
+  V range = O.andi(O.lshr(ptr, BottomPacBit), rangeMask);
+  V badPac = O.eor(pac, O.imm(1ULL << (topBit - 1)));
+  pac = O.selectEq(range, O.imm(0), pac, O.selectEq(range, O.imm(rangeMask), pac, badPac));
+
+  // ptr<63:56>:selbit:PAC<54:48>:ptr<47:0> for data, PAC<63:56>:selbit:PAC<54:48>:ptr<47:0> for code
+  V keep = O.andi(ptr, (isData ? (0xffULL << 56) | VaMask : VaMask) | (1ULL << SelectBit));
+  return O.orr(keep, O.andi(pac, pacMask));
+}
+
+template <typename Ops, typename V = typename Ops::V>
+V authImpl(Ops &O, V ptr, V modifier, V key0, V key1, bool isData) {
+  const auto pacMask = getPacMask(isData);
+
+  V original = extendPointer(O, ptr, SelectBit, isData);
+  V pac = O.computePac(original, modifier, key0, key1);
+
+  // On failure, the error code of key A (0b01) goes to the two bits below the top bit
+  const auto errorBit = getTopBit(isData) - 2;
+  V failed = O.orr(O.andi(original, ~(3ULL << errorBit)), O.imm(1ULL << errorBit));
+  return O.selectEq(O.andi(pac, pacMask), O.andi(ptr, pacMask), original, failed);
+}
+
+ConstOps::V ConstOps::computePac(V data, V modifier, V key0, V key1) {
+  return computePacImpl(*this, data, modifier, key0, key1);
+}
+
+/* Get an empty definition for a helper i64 (i64, ...), reusing an earlier declaration */
+Function *createHelperFunction(Module &M, StringRef name, unsigned numArgs) {
+  auto &C = M.getContext();
+  auto I64Ty = Type::getInt64Ty(C);
+
+  auto F = M.getFunction(name);
+  if (F == nullptr) {
+    auto FTy = FunctionType::get(I64Ty, SmallVector<Type *, 4>(numArgs, I64Ty), false);
+    F = Function::Create(FTy, GlobalValue::LinkOnceODRLinkage, name, &M);
+  }
+  assert(F->isDeclaration() && F->arg_size() == numArgs && "conflicting soft PA helper");
+
+  F->setLinkage(GlobalValue::LinkOnceODRLinkage);
+  F->setVisibility(GlobalValue::HiddenVisibility);
+  F->addFnAttr(Attribute::NoUnwind);
+  F->addFnAttr("no-parts", "true");
+  return F;
+}
+
+GlobalVariable *getKeys(Module &M) {
+  if (auto keys = M.getGlobalVariable(KeysName))
+    return keys;
+
+  auto &C = M.getContext();
+  auto init = ConstantDataArray::get(C, DefaultKeys);
+  return new GlobalVariable(M, init->getType(), false, GlobalValue::WeakAnyLinkage, init, KeysName);
+}
+
+Function *getComputePacFunction(Module &M) {
+  auto F = M.getFunction(ComputePacName);
+  if (F != nullptr && !F->isDeclaration())
+    return F;
+
+  // One copy is enough, the helpers only differ in how they place the PAC
+  F = createHelperFunction(M, ComputePacName, 4);
+  F->addFnAttr(Attribute::NoInline);
+  F->addFnAttr(Attribute::ReadNone);
+
+  IRBuilder<> B(BasicBlock::Create(M.getContext(), "entry", F));
+  auto args = F->arg_begin();
+  Value *data = &*args++;
+  Value *modifier = &*args++;
+  Value *key0 = &*args++;
+  Value *key1 = &*args++;
+  B.CreateRet(PartsSoftPa::emitComputePac(B, data, modifier, key0, key1));
+  return F;
+}
+
+} // anonymous namespace
+
+uint64_t PartsSoftPa::computePac(uint64_t data, uint64_t modifier, uint64_t key0, uint64_t key1) {
+  ConstOps O;
+  return computePacImpl(O, data, modifier, key0, key1);
+}
+
+uint64_t PartsSoftPa::addPac(uint64_t ptr, uint64_t modifier, uint64_t key0, uint64_t key1, bool isData) {
+  ConstOps O;
+  return addPacImpl(O, ptr, modifier, key0, key1, isData);
+}
+
+uint64_t PartsSoftPa::auth(uint64_t ptr, uint64_t modifier, uint64_t key0, uint64_t key1, bool isData) {
+  ConstOps O;
+  return authImpl(O, ptr, modifier, key0, key1, isData);
+}
+
+Value *PartsSoftPa::emitComputePac(IRBuilder<> &B, Value *data, Value *modifier, Value *key0, Value *key1) {
+  IROps O{ B, nullptr };
+  return computePacImpl(O, data, modifier, key0, key1);
+}
+
+const char *PartsSoftPa::getHelperName(Op op) {
+  assert(op < NumOps && "invalid soft PA op");
+  return HelperNames[op];
+}
+
+Function *PartsSoftPa::getHelper(Module &M, Op op) {
+  auto F = M.getFunction(getHelperName(op));
+  if (F != nullptr && !F->isDeclaration())
+    return F;
+
+  const bool isData = (op == PACDA || op == AUTDA);
+  const bool isAut = (op == AUTIA || op == AUTDA);
+
+  auto computePacFunc = getComputePacFunction(M);
+  auto keys = getKeys(M);
+
+  F = createHelperFunction(M, getHelperName(op), 2);
+  F->addFnAttr(Attribute::ReadOnly);
+
+  IRBuilder<> B(BasicBlock::Create(M.getContext(), "entry", F));
+  auto args = F->arg_begin();
+  Value *ptr = &*args++;
+  Value *modifier = &*args++;
+  // K<63:0> and K<127:64>, ComputePAC takes the high half first
+  Value *key1 = B.CreateLoad(B.CreateConstInBoundsGEP2_64(keys, 0, isData ? 2 : 0));
+  Value *key0 = B.CreateLoad(B.CreateConstInBoundsGEP2_64(keys, 0, isData ? 3 : 1));
+
+  IROps O{ B, computePacFunc };
+  B.CreateRet(isAut ? authImpl(O, ptr, modifier, key0, key1, isData)
+                    : addPacImpl(O, ptr, modifier, key0, key1, isData));
+  return F;
+}
+
+void PartsSoftPa::createHelpers(Module &M) {
+  for (unsigned op = 0; op < NumOps; op++)
+    getHelper(M, static_cast<Op>(op));
+}
+
+PartsSoftPa::Op PartsSoftPa::getHelperOp(const Function &F) {
+  for (unsigned op = 0; op < NumOps; op++) {
+    if (F.getName() == HelperNames[op])
+      return static_cast<Op>(op);
+  }
+  return NumOps;
+}
+
+}
+
+}
@@ -0,0 +1,66 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/PARTS/PartsTypeIdHash.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/xxhash.h"
+
+extern "C" {
+// A bit ugly, but works...
+#include "../PARTS-sha3/include/sha3.h"
+}
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+static uint64_t hashSHA3(StringRef str) {
+  // Prepare SHA3 generation
+  mbedtls_sha3_context sha3_context;
+  mbedtls_sha3_type_t sha3_type = MBEDTLS_SHA3_256;
+  mbedtls_sha3_init(&sha3_context);
+
+  // Prepare input and output variables
+  auto *input = reinterpret_cast<const unsigned char*>(str.data());
+  unsigned char output[32] = {};
+
+  // Generate hash
+  auto result = mbedtls_sha3(input, str.size(), sha3_type, output);
+  if (result != 0)
+    llvm_unreachable("SHA3 hashing failed :(");
+
+  // Only the first 64 bits are used, read them in a fixed byte order so that the type_ids do not depend on the host
+  return support::endian::read64le(output);
+}
+
+uint64_t llvm::PARTS::hashTypeId(TypeIdHash hash, StringRef type_str) {
+  switch (hash) {
+    case TypeIdHash::SHA3:
+      return hashSHA3(type_str);
+    case TypeIdHash::MD5:
+      return MD5Hash(type_str);
+    case TypeIdHash::XXHash:
+      return xxHash64(type_str);
+  }
+  llvm_unreachable("unknown type_id hash");
+}
+
+StringRef llvm::PARTS::getTypeIdHashName(TypeIdHash hash) {
+  switch (hash) {
+    case TypeIdHash::SHA3:
+      return "sha3";
+    case TypeIdHash::MD5:
+      return "md5";
+    case TypeIdHash::XXHash:
+      return "xxhash";
+  }
+  llvm_unreachable("unknown type_id hash");
+}
@@ -12,15 +12,61 @@
 #include <llvm/PARTS/PartsTypeMetadata.h>
 
 #include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineMemOperand.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsTypeIdHash.h"
+#include "llvm/Support/RWMutex.h"
+#include <unordered_set>
+
+#define DEBUG_TYPE "parts-type-id"
 
-extern "C" {
-// A bit ugly, but works...
-#include "../PARTS-sha3/include/sha3.h"
+using namespace llvm;
+
+static constexpr auto IndirectlyCalledIdsName = "parts.indirectly_called_ids";
+
+STATISTIC(NumTypeIdCacheHits, "Number of type_id lookups served from the cache");
+STATISTIC(NumTypeIdCacheMisses, "Number of type_ids hashed from scratch");
+
+namespace {
+
+/*! Memoized type_ids, Types are uniqued so we can key on the Type pointer within each LLVMContext */
+struct TypeIdCache {
+  sys::RWMutex lock;
+  DenseMap<const LLVMContext *, DenseMap<const Type *, type_id_t>> ids;
+};
+
+TypeIdCache &getTypeIdCache() {
+  static TypeIdCache cache;
+  return cache;
 }
 
-#define PARTS_USE_SHA3
+/*!
+ * The parts.indirectly_called_ids of each Module as a set, so that queries need not scan the named metadata. An entry
+ * is only valid for the NamedMDNode, and operand count, it was built from.
+ */
+struct CalledIdsCache {
+  struct Entry {
+    const LLVMContext *context;
+    const NamedMDNode *NMD;
+    unsigned numOperands;
+    std::unordered_set<type_id_t> ids;
+  };
 
-using namespace llvm;
+  sys::RWMutex lock;
+  DenseMap<const Module *, Entry> modules;
+};
+
+CalledIdsCache &getCalledIdsCache() {
+  static CalledIdsCache cache;
+  return cache;
+}
+
+} // anonymous namespace
 
 PartsTypeMetadata::PartsTypeMetadata(type_id_t type_id)
     : m_type_id(type_id) {
@@ -31,37 +77,25 @@ PartsTypeMetadata::PartsTypeMetadata(const MDNode *MDN) {
   assert(MDN != nullptr && "cannot construct from nullptr");
   assert(isPartsTypeMetadataContainer(MDN) && "Constructor must have valid MDNode");
 
-  unsigned i = 1;
-  m_type_id = dyn_cast<ConstantAsMetadata>(MDN->getOperand(i++))->getValue()->getUniqueInteger().getLimitedValue(UINT64_MAX);
-  m_known = 1 == (dyn_cast<ConstantAsMetadata>(MDN->getOperand(i++))->getValue()->getUniqueInteger().getLimitedValue(1));
-  m_pointer = 1 == (dyn_cast<ConstantAsMetadata>(MDN->getOperand(i++))->getValue()->getUniqueInteger().getLimitedValue(1));
-  m_data = 1 == (dyn_cast<ConstantAsMetadata>(MDN->getOperand(i++))->getValue()->getUniqueInteger().getLimitedValue(1));
-  m_ignored = 1 == (dyn_cast<ConstantAsMetadata>(MDN->getOperand(i++))->getValue()->getUniqueInteger().getLimitedValue(1));
-  m_isPACed = 1 == (dyn_cast<ConstantAsMetadata>(MDN->getOperand(i++))->getValue()->getUniqueInteger().getLimitedValue(1));
-}
-
-PartsTypeMetadata::~PartsTypeMetadata() {
+  m_type_id = mdconst::extract<ConstantInt>(MDN->getOperand(1))->getZExtValue();
+  m_flags = static_cast<uint8_t>(mdconst::extract<ConstantInt>(MDN->getOperand(2))->getZExtValue());
 }
 
-MDNode *PartsTypeMetadata::getMDNode(LLVMContext &C) {
-
+MDNode *PartsTypeMetadata::getMDNode(LLVMContext &C) const {
+  // MDNode::get uniques the node, so this only allocates the first time a tuple is seen
   Metadata* vals[numNodes] = {
       MDString::get(C, MetadataKindString),
-      ConstantAsMetadata::get(Constant::getIntegerValue(Type::getInt64Ty(C), APInt(64, m_type_id))),
-      ConstantAsMetadata::get(Constant::getIntegerValue(Type::getInt64Ty(C), APInt(1, m_known ? 1 : 0))),
-      ConstantAsMetadata::get(Constant::getIntegerValue(Type::getInt64Ty(C), APInt(1, m_pointer ? 1 : 0))),
-      ConstantAsMetadata::get(Constant::getIntegerValue(Type::getInt64Ty(C), APInt(1, m_data ? 1 : 0))),
-      ConstantAsMetadata::get(Constant::getIntegerValue(Type::getInt64Ty(C), APInt(1, m_ignored ? 1 : 0))),
-      ConstantAsMetadata::get(Constant::getIntegerValue(Type::getInt64Ty(C), APInt(1, m_isPACed ? 1 : 0))),
+      ConstantAsMetadata::get(ConstantInt::get(Type::getInt64Ty(C), m_type_id)),
+      ConstantAsMetadata::get(ConstantInt::get(Type::getInt8Ty(C), m_flags)),
   };
   return MDNode::get(C, vals);
 }
 
-void PartsTypeMetadata::attach(LLVMContext &C, Instruction &I) {
+void PartsTypeMetadata::attach(LLVMContext &C, Instruction &I) const {
   I.setMetadata(MetadataKindString, getMDNode(C));
 }
 
-std::string PartsTypeMetadata::toString() {
+std::string PartsTypeMetadata::toString() const {
   return "[ignored:" + std::to_string((isIgnored() ? 1 : 0)) +
          "[PACed:" + std::to_string((isPACed() ? 1 : 0)) +
          "," + (isPointer() ? (isCodePointer() ? "codePointer" : "dataPointer") : "not-a-pointer") +
@@ -80,71 +114,77 @@ MDNode *PartsTypeMetadata::retrieveAsMDNode(const Instruction *I) {
   return nullptr;
 }
 
-const PartsTypeMetadata_ptr PartsTypeMetadata::retrieve(const MachineInstr &MI)
+PartsTypeMetadata_opt PartsTypeMetadata::retrieve(const MachineInstr &MI)
 {
   const auto numOps = MI.getNumOperands();
 
   for (unsigned i = 0; i < numOps; i++) {
-    const auto op = MI.getOperand(i);
+    const auto &op = MI.getOperand(i);
 
     if (op.isMetadata()) {
-      if (const PartsTypeMetadata_ptr n = retrieve(op.getMetadata()))
+      if (const auto n = retrieve(op.getMetadata()))
         return n;
     }
   }
-  return nullptr;
+
+  // SelectionDAG carries the type in the memory operand instead of a metadata operand
+  if (MI.hasOneMemOperand())
+    return retrieve((*MI.memoperands_begin())->getPartsType());
+
+  return None;
 }
 
-const PartsTypeMetadata_ptr PartsTypeMetadata::retrieve(const MDNode *MDNp)
+PartsTypeMetadata_opt PartsTypeMetadata::retrieve(const MDNode *MDNp)
 {
   if (isPartsTypeMetadataContainer(MDNp)) {
-    return std::make_shared<PartsTypeMetadata>(MDNp);
+    return PartsTypeMetadata(MDNp);
   }
 
-  if (MDNp->getNumOperands() == 1) {
+  if (MDNp != nullptr && MDNp->getNumOperands() == 1) {
     const auto &op = MDNp->getOperand(0);
     if (isa<MDNode>(op))
       return retrieve(dyn_cast<MDNode>(op));
   }
 
-  return nullptr;
+  return None;
 }
 
-PartsTypeMetadata_ptr PartsTypeMetadata::get(const type_id_t type_id) {
-  return std::make_shared<PartsTypeMetadata>(type_id);
+PartsTypeMetadata PartsTypeMetadata::get(const type_id_t type_id) {
+  return PartsTypeMetadata(type_id);
 }
 
-PartsTypeMetadata_ptr PartsTypeMetadata::get(const Type *const type)
+PartsTypeMetadata PartsTypeMetadata::get(const Type *const type)
 {
   auto TMD = get(idFromType(type));
-  TMD->setIsKnown(true);
+  TMD.setIsKnown(true);
 
   if (TyIsPointer(type)) {
-    TMD->setIsPointer(true);
-    TMD->setIsCodePointer(TyIsCodePointer(type));
+    TMD.setIsPointer(true);
+    TMD.setIsCodePointer(TyIsCodePointer(type));
   } else {
-    TMD->setIsPointer(false);
+    TMD.setIsPointer(false);
   }
 
   return TMD;
 }
 
-PartsTypeMetadata_ptr PartsTypeMetadata::getUnknown()
+PartsTypeMetadata PartsTypeMetadata::getUnknown()
 {
-  return std::make_shared<PartsTypeMetadata>(0);
+  return PartsTypeMetadata(type_id_t(0));
 }
 
-PartsTypeMetadata_ptr PartsTypeMetadata::getIgnored()
+PartsTypeMetadata PartsTypeMetadata::getIgnored()
 {
-  auto TMD =  std::make_shared<PartsTypeMetadata>(0);
-  TMD->setIgnored(true);
-  
+  auto TMD = PartsTypeMetadata(type_id_t(0));
+  TMD.setIgnored(true);
+
   return TMD;
 }
 
 bool PartsTypeMetadata::isPartsTypeMetadataContainer(const MDNode *const MDN) {
   return (MDN != nullptr && MDN->getNumOperands() == numNodes &&
           isa<MDString>(MDN->getOperand(0)) && isa<ConstantAsMetadata>(MDN->getOperand(1)) &&
+          isa<ConstantAsMetadata>(MDN->getOperand(2)) &&
           dyn_cast<MDString>(MDN->getOperand(0))->getString() == MetadataKindString);
 }
 
@@ -154,55 +194,117 @@ type_id_t PartsTypeMetadata::idFromType(const Type *const type)
   if (!TyIsPointer(type))
     return 0;
 
-  type_id_t type_id = 0;
-  // Generate a std::string from type
-  std::string type_str;
-  llvm::raw_string_ostream rso(type_str);
-  type->print(rso);
+  auto &cache = getTypeIdCache();
+  const auto *C = &type->getContext();
+
+  {
+    sys::ScopedReader reader(cache.lock);
+    auto found = cache.ids.find(C);
+    if (found != cache.ids.end()) {
+      auto id = found->second.find(type);
+      if (id != found->second.end()) {
+        ++NumTypeIdCacheHits;
+        return id->second;
+      }
+    }
+  }
+
+  ++NumTypeIdCacheMisses;
+  const auto type_id = computeIdFromType(type);
 
-  auto c_string = rso.str().c_str();
+  sys::ScopedWriter writer(cache.lock);
+  cache.ids[C].insert({type, type_id});
+  return type_id;
+}
 
-#ifdef PARTS_USE_SHA3
+void PartsTypeMetadata::releaseTypeIdCache(const LLVMContext &C)
+{
+  auto &cache = getTypeIdCache();
 
+  // The context might be destroyed after this, so we must not keep any of its Types around
+  {
+    sys::ScopedWriter writer(cache.lock);
+    cache.ids.erase(&C);
+  }
 
-  // Prepare SHA3 generation
-  mbedtls_sha3_context sha3_context;
-  mbedtls_sha3_type_t sha3_type = MBEDTLS_SHA3_256;
-  mbedtls_sha3_init(&sha3_context);
+  // Nor its Modules
+  auto &called = getCalledIdsCache();
+  sys::ScopedWriter writer(called.lock);
+  SmallVector<const Module *, 4> stale;
+  for (const auto &entry : called.modules) {
+    if (entry.second.context == &C)
+      stale.push_back(entry.first);
+  }
+  for (const auto *M : stale)
+    called.modules.erase(M);
+}
 
-  // Prepare input and output variables
-  auto *input = reinterpret_cast<const unsigned char*>(c_string);
-  auto *output= new unsigned char[32]();
+void PartsTypeMetadata::setIndirectlyCalledIds(Module &M, const std::set<type_id_t> &type_ids)
+{
+  auto &C = M.getContext();
+  auto *NMD = M.getOrInsertNamedMetadata(IndirectlyCalledIdsName);
 
-  // Generate hash
-  auto result = mbedtls_sha3(input, type_str.length(), sha3_type, output);
-  if (result != 0)
-    llvm_unreachable("SHA3 hashing failed :(");
+  NMD->clearOperands();
+  for (auto type_id : type_ids)
+    NMD->addOperand(MDNode::get(C, ConstantAsMetadata::get(ConstantInt::get(Type::getInt64Ty(C), type_id))));
 
-  memcpy(&type_id, output, sizeof(type_id_t));
+  auto &cache = getCalledIdsCache();
+  sys::ScopedWriter writer(cache.lock);
+  cache.modules.erase(&M);
+}
 
-  // FIXME: Support proper PA modifiers (this is a workaround for PartsUtils inability to move larger immediate value)
-  //const auto original_type_id = type_id;
-  //type_id = type_id % UINT8_MAX;
+bool PartsTypeMetadata::needsCodePointerPac(const Module &M, type_id_t type_id)
+{
+  const auto *NMD = M.getNamedMetadata(IndirectlyCalledIdsName);
 
-#else
-  if (TyIsCodePointer(type))
-    type_id = 7;
-  else
-    type_id = 3;
-#endif
-  return type_id;
+  // Without whole-program information any code pointer might end up being called
+  if (!PARTS::useWholeProgram() || NMD == nullptr)
+    return true;
+
+  auto &cache = getCalledIdsCache();
+
+  {
+    sys::ScopedReader reader(cache.lock);
+    auto found = cache.modules.find(&M);
+    if (found != cache.modules.end() && found->second.NMD == NMD &&
+        found->second.numOperands == NMD->getNumOperands())
+      return found->second.ids.count(type_id) != 0;
+  }
+
+  CalledIdsCache::Entry entry { &M.getContext(), NMD, NMD->getNumOperands(), {} };
+  for (const auto *MDN : NMD->operands())
+    entry.ids.insert(mdconst::extract<ConstantInt>(MDN->getOperand(0))->getZExtValue());
+
+  const auto needed = entry.ids.count(type_id) != 0;
+
+  sys::ScopedWriter writer(cache.lock);
+  cache.modules[&M] = std::move(entry);
+  return needed;
+}
+
+type_id_t PartsTypeMetadata::computeIdFromType(const Type *const type)
+{
+  // Generate a std::string from type
+  std::string type_str;
+  llvm::raw_string_ostream rso(type_str);
+  type->print(rso);
+
+  return hashTypeId(PARTS::getTypeIdHash(), rso.str());
 }
 
 Constant *PartsTypeMetadata::idConstantFromType(LLVMContext &C, const Type *const type) {
   return Constant::getIntegerValue(Type::getInt64Ty(C), APInt(64, idFromType(type)));
 }
 
-raw_ostream &operator<<(raw_ostream &stream, const PartsTypeMetadata_ptr pmd) {
-  stream << "PartsTypeMetadata(" << pmd->getTypeId();
+namespace llvm {
+
+raw_ostream &operator<<(raw_ostream &stream, const PartsTypeMetadata &PTMD) {
+  stream << "PartsTypeMetadata(" << PTMD.getTypeId() << ")";
   return stream;
 }
 
+} // namespace llvm
+
 Constant *PartsTypeMetadata::getTypeIdConstant(LLVMContext &C) const {
   return Constant::getIntegerValue(Type::getInt64Ty(C), APInt(64, getTypeId()));
 }
@@ -56,7 +56,11 @@ createAArch64InstructionSelector(const AArch64TargetMachine &,
 
 FunctionPass *createPartsPassIntrinsics();
 FunctionPass *createPartsPassDpi();
+FunctionPass *createPartsPassDpiPreRA();
 FunctionPass *createPartsPassCpi();
+FunctionPass *createPartsPassModifierOpt();
+FunctionPass *createPartsPassOverheadReport();
+ModulePass *createPartsPassEventCounters();
 
 void initializeAArch64A53Fix835769Pass(PassRegistry&);
 void initializeAArch64A57FPLoadBalancingPass(PassRegistry&);
@@ -74,6 +78,9 @@ void initializeAArch64RedundantCopyEliminationPass(PassRegistry&);
 void initializeAArch64StorePairSuppressPass(PassRegistry&);
 void initializeFalkorHWPFFixPass(PassRegistry&);
 void initializeFalkorMarkStridedAccessesLegacyPass(PassRegistry&);
+void initializePartsPassDpiPass(PassRegistry&);
+void initializePartsPassDpiPreRAPass(PassRegistry&);
+void initializePartsPassModifierOptPass(PassRegistry&);
 void initializeLDTLSCleanupPass(PassRegistry&);
 } // end namespace llvm
 
@@ -40,6 +40,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
@@ -402,3 +403,17 @@ bool AArch64CallLowering::lowerCall(MachineIRBuilder &MIRBuilder,
 
   return true;
 }
+
+void AArch64CallLowering::annotateCall(MachineInstr &Call,
+                                       ImmutableCallSite CS) const {
+  // Like FastISel, give indirect calls the PARTS type of the called pointer so
+  // that they can be turned into authenticating calls. Direct calls are
+  // marked as ignored.
+  MachineFunction &MF = *Call.getParent()->getParent();
+  LLVMContext &C = MF.getFunction().getContext();
+  const auto PartsType =
+      Call.getOpcode() == AArch64::BLR
+          ? PartsTypeMetadata::get(CS.getCalledValue()->getType())
+          : PartsTypeMetadata::getIgnored();
+  MachineInstrBuilder(MF, Call).addMetadata(PartsType.getMDNode(C));
+}
@@ -18,7 +18,9 @@
 #include "AArch64Subtarget.h"
 #include "MCTargetDesc/AArch64AddressingModes.h"
 #include "Utils/AArch64BaseInfo.h"
+#include "AArch64PARTS/PartsUtils.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
@@ -30,8 +32,10 @@
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/IR/DebugLoc.h"
 #include "llvm/MC/MCInstrDesc.h"
+#include "llvm/PARTS/Parts.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CodeGen.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Target/TargetMachine.h"
 #include <cassert>
@@ -42,6 +46,11 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "aarch64-expand-pseudo"
+
+STATISTIC(NumPartsPACs, "Number of PARTS_PAC* pseudos expanded");
+STATISTIC(NumPartsAUTs, "Number of PARTS_AUT* pseudos expanded");
+
 #define AARCH64_EXPAND_PSEUDO_NAME "AArch64 pseudo instruction expansion pass"
 
 namespace {
@@ -74,6 +83,8 @@ private:
   bool expandCMP_SWAP_128(MachineBasicBlock &MBB,
                           MachineBasicBlock::iterator MBBI,
                           MachineBasicBlock::iterator &NextMBBI);
+  bool expandPartsPA(MachineBasicBlock &MBB,
+                     MachineBasicBlock::iterator MBBI);
 };
 
 } // end anonymous namespace
@@ -778,6 +789,71 @@ bool AArch64ExpandPseudo::expandCMP_SWAP_128(
   return true;
 }
 
+/// \brief Expand a PARTS PA pseudo into the PA instruction, which signs or
+/// authenticates its pointer register in place. The pointer is tied to the
+/// result, so the register allocator has already coalesced or inserted any
+/// copy that is needed and there is nothing to move here.
+bool AArch64ExpandPseudo::expandPartsPA(MachineBasicBlock &MBB,
+                                        MachineBasicBlock::iterator MBBI) {
+  MachineInstr &MI = *MBBI;
+  const DebugLoc &DL = MI.getDebugLoc();
+  unsigned DstReg = MI.getOperand(0).getReg();
+  assert(DstReg == MI.getOperand(1).getReg() &&
+         "PARTS PA pseudo pointer not tied to the result!");
+  const MachineOperand &ModOp = MI.getOperand(2);
+
+  unsigned Opc;
+  PARTS::PartsEventCount::EventKind Event;
+  switch (MI.getOpcode()) {
+  default:
+    llvm_unreachable("unexpected PARTS PA pseudo");
+  case AArch64::PARTS_PACIA:
+    Opc = AArch64::PACIA;
+    Event = PARTS::PartsEventCount::CodePointerCreate;
+    ++NumPartsPACs;
+    break;
+  case AArch64::PARTS_PACDA:
+    Opc = AArch64::PACDA;
+    Event = PARTS::PartsEventCount::DataStr;
+    ++NumPartsPACs;
+    break;
+  case AArch64::PARTS_AUTIA:
+    // Only used for the callee checks of promoted indirect calls, not counted
+    Opc = AArch64::AUTIA;
+    Event = PARTS::PartsEventCount::NumEventKinds;
+    ++NumPartsAUTs;
+    break;
+  case AArch64::PARTS_AUTDA:
+    Opc = AArch64::AUTDA;
+    Event = PARTS::PartsEventCount::DataLdr;
+    ++NumPartsAUTs;
+    break;
+  }
+
+  // The soft PA helpers cannot be called after register allocation, so the
+  // llvm.pa.* intrinsics must have been lowered to helper calls on IR
+  if (PARTS::useSoftPa() && !PARTS::useDummy())
+    report_fatal_error("PARTS PA pseudo left for expansion with -parts-soft-pa, "
+                       "lower the llvm.pa.* intrinsics with -parts-lower-soft-pa first");
+
+  auto PartsUtils = PARTS::PartsUtils::get(&TII->getRegisterInfo(), TII);
+  if (PARTS::useDummy()) {
+    PartsUtils->insertPAInstr(MBB, &MI, DstReg, ModOp.getReg(), TII->get(Opc),
+                              DL);
+  } else {
+    // The PA instructions do not list their in-place operand as a use
+    BuildMI(MBB, MBBI, DL, TII->get(Opc), DstReg)
+        .addReg(ModOp.getReg(), getKillRegState(ModOp.isKill()))
+        .addReg(DstReg, RegState::Implicit)
+        .setMIFlag(MachineInstr::PartsInstr);
+  }
+  if (Event != PARTS::PartsEventCount::NumEventKinds)
+    PartsUtils->addEventCount(MBB, MI, DL, Event);
+
+  MI.eraseFromParent();
+  return true;
+}
+
 /// \brief If MBBI references a pseudo instruction that should be expanded here,
 /// do the expansion and return true.  Otherwise return false.
 bool AArch64ExpandPseudo::expandMI(MachineBasicBlock &MBB,
@@ -941,6 +1017,11 @@ bool AArch64ExpandPseudo::expandMI(MachineBasicBlock &MBB,
     MI.eraseFromParent();
     return true;
   }
+  case AArch64::PARTS_PACIA:
+  case AArch64::PARTS_PACDA:
+  case AArch64::PARTS_AUTIA:
+  case AArch64::PARTS_AUTDA:
+    return expandPartsPA(MBB, MBBI);
   case AArch64::CMP_SWAP_8:
     return expandCMP_SWAP(MBB, MBBI, AArch64::LDAXRB, AArch64::STLXRB,
                           AArch64::SUBSWrx,
@@ -988,7 +1069,15 @@ bool AArch64ExpandPseudo::expandMBB(MachineBasicBlock &MBB) {
   MachineBasicBlock::iterator MBBI = MBB.begin(), E = MBB.end();
   while (MBBI != E) {
     MachineBasicBlock::iterator NMBBI = std::next(MBBI);
+    // Keep the PARTS tag on whatever replaces a PARTS pseudo, such as the
+    // MOVZ/MOVK sequence of a pre-RA modifier
+    const bool IsParts = MBBI->getFlag(MachineInstr::PartsInstr);
+    const bool AtBegin = MBBI == MBB.begin();
+    MachineBasicBlock::iterator PrevMBBI = AtBegin ? MBBI : std::prev(MBBI);
     Modified |= expandMI(MBB, MBBI, NMBBI);
+    if (IsParts)
+      for (auto I = AtBegin ? MBB.begin() : std::next(PrevMBBI); I != NMBBI; ++I)
+        I->setFlag(MachineInstr::PartsInstr);
     MBBI = NMBBI;
   }
 
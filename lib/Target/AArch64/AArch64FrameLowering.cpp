@@ -98,6 +98,7 @@
 #include "AArch64Subtarget.h"
 #include "AArch64TargetMachine.h"
 #include "MCTargetDesc/AArch64AddressingModes.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/LivePhysRegs.h"
@@ -526,7 +527,8 @@ void AArch64FrameLowering::emitPrologue(MachineFunction &MF,
     return;
   }
 
-  if (PARTS::useBeCfi()) // Insert pauth for LR
+  // Insert pauth for LR, at the shrink-wrapped save point and only if LR is actually spilled
+  if (PARTS::useBeCfi() && PARTS->needsBeCfi(MF))
     PARTS->instrumentPrologue(TII, Subtarget.getRegisterInfo(), MBB, MBBI, DebugLoc());
 
   bool IsWin64 =
@@ -798,6 +800,16 @@ void AArch64FrameLowering::emitEpilogue(MachineFunction &MF,
     ArgumentPopSize = AFI->getArgumentStackToRestore();
   }
 
+  // Authenticate LR right before leaving the block, once the rest of the epilogue is in place. This must happen on
+  // all the early exits below, and by then SP is above its entry value by the popped arguments.
+  auto InstrumentBeCfi = make_scope_exit([&]() {
+    if (PARTS::useBeCfi() && PARTS->needsBeCfi(MF)) {
+      auto Terminator = MBB.getFirstTerminator();
+      PARTS->instrumentEpilogue(TII, Subtarget.getRegisterInfo(), MBB, Terminator, DL, IsTailCallReturn,
+                                ArgumentPopSize);
+    }
+  });
+
   // The stack frame should be like below,
   //
   //      ----------------------                     ---
@@ -853,12 +865,6 @@ void AArch64FrameLowering::emitEpilogue(MachineFunction &MF,
     emitFrameOffset(MBB, MBB.getFirstTerminator(), DL, AArch64::SP, AArch64::SP,
                     NumBytes + ArgumentPopSize, TII,
                     MachineInstr::FrameDestroy);
-
-    // Insert pauth instruction to authenticate LR
-    if (PARTS::useBeCfi() && (MF.getInfo<AArch64FunctionInfo>()->hasStackFrame() ||
-                               windowsRequiresStackProbe(MF, NumBytes))) {
-      PARTS->instrumentEpilogue(TII, Subtarget.getRegisterInfo(), MBB, MBBI, DL, IsTailCallReturn);
-    }
     return;
   }
 
@@ -904,15 +910,6 @@ void AArch64FrameLowering::emitEpilogue(MachineFunction &MF,
   if (ArgumentPopSize)
     emitFrameOffset(MBB, MBB.getFirstTerminator(), DL, AArch64::SP, AArch64::SP,
                     ArgumentPopSize, TII, MachineInstr::FrameDestroy);
-
-  if (PARTS::useBeCfi()) {
-    if (MBBI == MBB.end() || MBBI->getParent() == &MBB) {
-      PARTS->instrumentEpilogue(TII, Subtarget.getRegisterInfo(), MBB, MBBI, DL, IsTailCallReturn);
-    } else {
-      auto tmpMBBI = MBB.getFirstTerminator();
-      PARTS->instrumentEpilogue(TII, Subtarget.getRegisterInfo(), MBB, tmpMBBI, DL, IsTailCallReturn);
-    }
-  }
 }
 
 /// getFrameIndexReference - Provide a base+offset reference to an FI slot for
@@ -129,6 +129,52 @@ public:
     }
   }
 
+  /// Return true if this instruction adds, checks or strips a pointer
+  /// authentication code, i.e., if it is scheduled as WritePAC.
+  static bool isPAuthInst(const MachineInstr &MI) {
+    switch (MI.getOpcode()) {
+    default:
+      return false;
+    case AArch64::PACIA:
+    case AArch64::PACIB:
+    case AArch64::PACDA:
+    case AArch64::PACDB:
+    case AArch64::PACIZA:
+    case AArch64::PACIZB:
+    case AArch64::PACDZA:
+    case AArch64::PACDZB:
+    case AArch64::AUTIA:
+    case AArch64::AUTIB:
+    case AArch64::AUTDA:
+    case AArch64::AUTDB:
+    case AArch64::AUTIZA:
+    case AArch64::AUTIZB:
+    case AArch64::AUTDZA:
+    case AArch64::AUTDZB:
+    case AArch64::XPACI:
+    case AArch64::XPACD:
+    case AArch64::PACGA:
+    case AArch64::PACIAZ:
+    case AArch64::PACIBZ:
+    case AArch64::AUTIAZ:
+    case AArch64::AUTIBZ:
+    case AArch64::PACIASP:
+    case AArch64::PACIBSP:
+    case AArch64::AUTIASP:
+    case AArch64::AUTIBSP:
+    case AArch64::PACIA1716:
+    case AArch64::PACIB1716:
+    case AArch64::AUTIA1716:
+    case AArch64::AUTIB1716:
+    case AArch64::XPACLRI:
+    case AArch64::PARTS_PACIA:
+    case AArch64::PARTS_PACDA:
+    case AArch64::PARTS_AUTIA:
+    case AArch64::PARTS_AUTDA:
+      return true;
+    }
+  }
+
   /// \brief Return the opcode that set flags when possible.  The caller is
   /// responsible for ensuring the opc has a flag setting equivalent.
   static unsigned convertToFlagSettingOpc(unsigned Opc, bool &Is64Bit) {
@@ -28,6 +28,7 @@
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineOperand.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
@@ -749,6 +750,41 @@ bool AArch64InstructionSelector::select(MachineInstr &I,
     return constrainSelectedInstRegOperands(I, TII, TRI, RBI);
   }
 
+  case TargetOpcode::G_INTRINSIC: {
+    // The imported PARTS patterns expect i64, but GlobalISel keeps the signed
+    // and authenticated values as pointers.
+    unsigned NewOpc;
+    switch (I.getOperand(1).getIntrinsicID()) {
+    case Intrinsic::pa_pacia:
+      NewOpc = AArch64::PARTS_PACIA;
+      break;
+    case Intrinsic::pa_pacda:
+      NewOpc = AArch64::PARTS_PACDA;
+      break;
+    case Intrinsic::pa_autia:
+      NewOpc = AArch64::PARTS_AUTIA;
+      break;
+    case Intrinsic::pa_autda:
+      NewOpc = AArch64::PARTS_AUTDA;
+      break;
+    default:
+      return false;
+    }
+
+    if (Ty != LLT::pointer(0, 64)) {
+      DEBUG(dbgs() << "PARTS intrinsic has type: " << Ty
+                   << ", expected: " << LLT::pointer(0, 64) << '\n');
+      return false;
+    }
+
+    auto MIB = BuildMI(MBB, I, I.getDebugLoc(), TII.get(NewOpc))
+                   .addDef(I.getOperand(0).getReg())
+                   .addUse(I.getOperand(2).getReg())
+                   .addUse(I.getOperand(3).getReg());
+    I.eraseFromParent();
+    return constrainSelectedInstRegOperands(*MIB, TII, TRI, RBI);
+  }
+
   case TargetOpcode::G_FCONSTANT:
   case TargetOpcode::G_CONSTANT: {
     const bool isFP = Opcode == TargetOpcode::G_FCONSTANT;
@@ -70,18 +70,14 @@ void PartsFastISel::addMetadataToCall(MachineInstrBuilder &MIB, FastISel::CallLo
 {
   // prep for pauth instrumentation by transferring type_id info to emitted BLR
 
-  PartsTypeMetadata_ptr partsType = nullptr;
-
   auto &C = FuncInfo.Fn->getContext();
   const Value *Callee = CLI.Callee;
 
   if (reg) {
     DEBUG_PA(log->debug(FuncInfo.Fn->getName()) << "\t\t\t*** preparing metadata to emitted branch instruction\n");
-    partsType = PartsTypeMetadata::get(Callee->getType());
+    addPartsTypeMetadata(MIB, PartsTypeMetadata::get(Callee->getType()).getMDNode(C));
   } else {
     DEBUG_PA(log->debug(FuncInfo.Fn->getName()) << "\t\t\t*** setting ignore metadata to emitted branch instruction\n");
-    partsType = PartsTypeMetadata::getIgnored();
+    addPartsTypeMetadata(MIB, PartsTypeMetadata::getIgnored().getMDNode(C));
   }
-
-  addPartsTypeMetadata(MIB, partsType->getMDNode(C));
 }
@@ -9,27 +9,51 @@
 //===----------------------------------------------------------------------===//
 
 #include "PartsFrameLowering.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "AArch64RegisterInfo.h"
 #include "AArch64InstrInfo.h"
 #include "llvm/PARTS/Parts.h"
 #include "PartsUtils.h"
 
+#define DEBUG_TYPE "PartsFrameLowering"
+
+STATISTIC(NumBeCfiPrologues, "Number of prologues signing LR");
+STATISTIC(NumBeCfiEpilogues, "Number of epilogues authenticating LR");
+
 using namespace llvm;
 
 PartsFrameLowering_ptr PartsFrameLowering::get() {
   return std::make_shared<PartsFrameLowering>();
 }
 
+bool PartsFrameLowering::needsBeCfi(const MachineFunction &MF) {
+  const auto &MFI = MF.getFrameInfo();
+  assert(MFI.isCalleeSavedInfoValid());
+
+  for (const auto &CSI : MFI.getCalleeSavedInfo())
+    if (CSI.getReg() == AArch64::LR)
+      return true;
+
+  return false;
+}
+
 void PartsFrameLowering::instrumentEpilogue(const TargetInstrInfo *TII, const TargetRegisterInfo *TRI,
                                   MachineBasicBlock &MBB, MachineBasicBlock::iterator &MBBI,
-                                  const DebugLoc &DL, const bool IsTailCallReturn) {
-  //FIXME: I assume there was a reason for IsTailCallReturn, but its no longer used at all!?!
+                                  const DebugLoc &DL, const bool IsTailCallReturn, const uint64_t SPAdjust) {
   auto partsUtils = PartsUtils::get(TRI, TII);
   auto modReg = PARTS::getModifierReg();
   auto loc = (MBBI != MBB.end() ? &*MBBI : nullptr);
+  const auto fName = MBB.getParent()->getName();
 
-  partsUtils->createBeCfiModifier(MBB, loc, modReg, DebugLoc());
+  ++NumBeCfiEpilogues;
+  log->inc("BeCfi.Epilogue", true, fName) << "authenticating LR in " << MBB.getName() << "\n";
+  // LR is authenticated before the branch, the callee signs it again against its own entry SP
+  if (IsTailCallReturn)
+    log->inc("BeCfi.TailCallEpilogue", true, fName) << "authenticating LR before a tail call\n";
+
+  partsUtils->createBeCfiModifier(MBB, loc, modReg, DebugLoc(), -(int64_t) SPAdjust);
   partsUtils->insertPAInstr(MBB, loc, AArch64::LR, modReg, TII->get(AArch64::AUTIB), DebugLoc());
 }
 
@@ -39,6 +63,9 @@ void PartsFrameLowering::instrumentPrologue(const TargetInstrInfo *TII, const Ta
   auto partsUtils = PartsUtils::get(TRI, TII);
   auto modReg = PARTS::getModifierReg();
 
+  ++NumBeCfiPrologues;
+  log->inc("BeCfi.Prologue", true, MBB.getParent()->getName()) << "signing LR in " << MBB.getName() << "\n";
+
   partsUtils->createBeCfiModifier(MBB, &*MBBI, modReg, DebugLoc());
   partsUtils->insertPAInstr(MBB, &*MBBI, AArch64::LR, modReg, TII->get(AArch64::PACIB), DebugLoc());
 }
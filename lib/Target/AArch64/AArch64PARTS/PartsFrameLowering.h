@@ -31,9 +31,20 @@ public:
 
   static PartsFrameLowering_ptr get();
 
+  /*!
+   * Check if LR needs to be signed. This is only the case when LR is spilled, a function that never stores LR, e.g.,
+   * a leaf or one that only tail calls, has nothing to protect. The answer is the same in the prologue and all
+   * epilogues, which are placed at the save and restore points chosen by shrink-wrapping.
+   */
+  bool needsBeCfi(const MachineFunction &MF);
+
+  /*!
+   * Authenticate LR before MBBI. SPAdjust is how far SP is above its value at function entry, e.g., because of
+   * stack arguments popped by the callee, the modifier must be computed from the entry SP to match the prologue.
+   */
   void instrumentEpilogue(const TargetInstrInfo *TII, const TargetRegisterInfo *TRI,
                           MachineBasicBlock &MBB, MachineBasicBlock::iterator &MBBI,
-                          const DebugLoc &DL, bool IsTailCallReturn);
+                          const DebugLoc &DL, bool IsTailCallReturn, uint64_t SPAdjust);
 
   void instrumentPrologue(const TargetInstrInfo *TII, const TargetRegisterInfo *TRI,
                           MachineBasicBlock &MBB, MachineBasicBlock::iterator &MBBI,
@@ -13,6 +13,7 @@
 #include "AArch64.h"
 #include "AArch64Subtarget.h"
 #include "AArch64RegisterInfo.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
@@ -33,12 +34,16 @@
 
 #define DEBUG_TYPE "aarch64-parts-cpi"
 
+STATISTIC(NumBranches, "Number of indirect branches converted to authenticated branches");
+STATISTIC(NumSkipped, "Number of indirect branches left uninstrumented");
+
 using namespace llvm;
 using namespace llvm::PARTS;
 
 #define skipIfB(ifx, stat, b, string) do {  \
     if ((ifx)) {                            \
       log->inc(stat, b) << string;          \
+      ++NumSkipped;                         \
       return false;                         \
     }                                       \
 } while(false)
@@ -46,6 +51,7 @@ using namespace llvm::PARTS;
 #define skipIfN(ifx, stat, string) do {     \
     if ((ifx)) {                            \
       log->inc(stat) << string;             \
+      ++NumSkipped;                         \
       return false;                         \
     }                                       \
 } while (false)
@@ -79,8 +85,6 @@ namespace {
    const AArch64InstrInfo *TII = nullptr;
    const AArch64RegisterInfo *TRI = nullptr;
    PartsUtils_ptr  partsUtils = nullptr;
-
-   Function *funcCountCodePtrBranch = nullptr;
  };
 } // end anonymous namespace
 
@@ -91,7 +95,6 @@ FunctionPass *llvm::createPartsPassCpi() {
 char PartsPassCpi::ID = 0;
 
 bool PartsPassCpi::doInitialization(Module &M) {
-  funcCountCodePtrBranch = PartsEventCount::getFuncCodePointerBranch(M);
   return true;
 }
 
@@ -129,7 +132,7 @@ bool PartsPassCpi::instrumentBranches(MachineFunction &MF,
     return false;
 
   const auto MIOpcode = MIi->getOpcode();
-  const auto MIName = TII->getName(MIOpcode).str();
+  const auto MIName = TII->getName(MIOpcode);
   auto partsType = PartsTypeMetadata::retrieve(*MIi);
 
   skipIfN(MIOpcode == AArch64::BL ||
@@ -145,7 +148,7 @@ bool PartsPassCpi::instrumentBranches(MachineFunction &MF,
   /* ----------------------------- BL/BLR ---------------------------------------- */
   DEBUG_PA(log->debug(MF.getName()) << "      found a BL/BLR (" << TII->getName(MIOpcode) << ")\n");
 
-  if (partsType == nullptr) {
+  if (!partsType) {
     DEBUG_PA(log->debug(MF.getName()) << "      trying to figure out type_id\n");
 
     assert(MIi->getNumOperands() >= 1);
@@ -179,7 +182,7 @@ bool PartsPassCpi::instrumentBranches(MachineFunction &MF,
     }
 
 
-    if (partsType == nullptr)
+    if (!partsType)
       partsType = PartsTypeMetadata::getUnknown();
   }
 
@@ -189,31 +192,40 @@ bool PartsPassCpi::instrumentBranches(MachineFunction &MF,
 
   assert(MIOpcode != AArch64::BL && "Whoops, thought this was never, maybe, gonna happen. I guess?");
 
-  log->inc("Branch.Instrumented_" + MIName,  true) << "instrumenting call " << partsType->toString() << "\n";
+  ++NumBranches;
+  log->inc("Branch.Instrumented_" + MIName,  true) << "instrumenting call " << *partsType << "\n";
 
+  // The pass runs before register allocation, so the modifier lives in a virtual register
   const auto ptrRegOperand = MIi->getOperand(0);
   const auto DL = MIi->getDebugLoc();
-  const auto modReg = PARTS::getModifierReg();
-
-
-  partsUtils->addEventCallFunction(MBB, *MIi, DL, funcCountCodePtrBranch);
+  const auto modReg = PARTS::getModifierReg(MF);
 
   // Create the PAC modifier
   partsUtils->moveTypeIdToReg(MBB, MIi, modReg, partsType->getTypeId(), DL);
 
   // Swap out the branch to a auth+branch variant
-  if (!PARTS::useDummy()) {
-    auto BMI = BuildMI(MBB, *MIi, DL, TII->get(AArch64::BLRAA));
-    BMI.add(ptrRegOperand);
-    BMI.addReg(modReg);
+  if (PARTS::useSoftPa()) {
+    // Authenticate in software and keep the plain branch
+    const auto ptrReg = partsUtils->softPaCallVirt(MBB, MIi, ptrRegOperand.getReg(), modReg, PartsSoftPa::AUTIA, DL);
+    MIi->getOperand(0).setReg(ptrReg);
+  } else if (!PARTS::useDummy()) {
+    // Keep the remaining operands (regmask, implicit arguments and defs) so that the register allocator still
+    // sees the call clobbers and argument registers.
+    auto *BMI = MF.CreateMachineInstr(TII->get(AArch64::BLRAA), DL, true);
+    MachineInstrBuilder(MF, BMI).add(ptrRegOperand).addReg(modReg);
+    for (unsigned i = 1; i < MIi->getNumOperands(); i++)
+      BMI->addOperand(MF, MIi->getOperand(i));
+    BMI->setMemRefs(MIi->memoperands_begin(), MIi->memoperands_end());
+    BMI->setFlag(MachineInstr::PartsInstr);
+    MBB.insert(MIi, BMI);
 
     // Remove the old instruction!
     auto &MI = *MIi;
     MIi--;
-    MI.removeFromParent();
+    MI.eraseFromParent();
   } else {
-    const auto ptrReg = ptrRegOperand.getReg();
-    partsUtils->addNops(MBB, MIi == MBB.instr_end() ? nullptr : &*MIi, ptrReg, modReg, DL);
+    const auto ptrReg = partsUtils->addNopsVirt(MBB, *MIi, ptrRegOperand.getReg(), modReg, DL);
+    MIi->getOperand(0).setReg(ptrReg);
   }
 
   return true;
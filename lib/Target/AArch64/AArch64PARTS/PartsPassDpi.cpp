@@ -13,6 +13,7 @@
 #include "AArch64.h"
 #include "AArch64Subtarget.h"
 #include "AArch64RegisterInfo.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
@@ -30,9 +31,14 @@
 #include "llvm/PARTS/PartsEventCount.h"
 #include "llvm/PARTS/Parts.h"
 #include "PartsUtils.h"
+#include "PartsTypeInference.h"
 
 #define DEBUG_TYPE "aarch64-parts-dpi"
 
+STATISTIC(NumDataStores, "Number of data pointer stores instrumented after register allocation");
+STATISTIC(NumDataLoads, "Number of data pointer loads instrumented after register allocation");
+STATISTIC(NumSkipped, "Number of loads and stores left uninstrumented");
+
 //#undef DEBUG_PA
 //#define DEBUG_PA(x) x
 
@@ -42,6 +48,7 @@ using namespace llvm::PARTS;
 #define skipIfB(ifx, fName, stat, b, string) do {  \
     if ((ifx)) {                            \
       log->inc(stat, b, fName) << string;          \
+      ++NumSkipped;                         \
       return false;                         \
     }                                       \
 } while(false)
@@ -49,6 +56,7 @@ using namespace llvm::PARTS;
 #define skipIfN(ifx, fName, stat, string) do {     \
     if ((ifx)) {                            \
       log->inc(stat, fName) << string;             \
+      ++NumSkipped;                         \
       return false;                         \
     }                                       \
 } while (false)
@@ -71,6 +79,9 @@ namespace {
    bool doInitialization(Module &M) override;
    bool runOnMachineFunction(MachineFunction &) override;
    bool instrumentLoadStore(MachineFunction &MF, MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator &MIi);
+   /*! Instrument the lane:th register of a possibly paired load or store */
+   bool instrumentLoadStoreLane(MachineFunction &MF, MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator &MIi,
+                                unsigned lane);
    bool instrumentBranches(MachineFunction &MF, MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator &MIi);
 
  private:
@@ -82,11 +93,7 @@ namespace {
    const AArch64InstrInfo *TII = nullptr;
    const AArch64RegisterInfo *TRI = nullptr;
    PartsUtils_ptr  partsUtils = nullptr;
-   int m_PACed_me_a_live_one = false; // FIXME: horrible hack!
-   MachineOperand *m_the_live_one = nullptr;
-
-   Function *funcCountDataStr = nullptr;
-   Function *funcCountDataLdr = nullptr;
+   std::unique_ptr<PartsTypeInference> typeInference;
  };
 } // end anonymous namespace
 
@@ -96,9 +103,16 @@ FunctionPass *llvm::createPartsPassDpi() {
 
 char PartsPassDpi::ID = 0;
 
+// Registered so that MIR tests can run the pass on its own
+INITIALIZE_PASS(PartsPassDpi, DEBUG_TYPE, "PARTS post-RA data pointer instrumentation", false, false)
+
 bool PartsPassDpi::doInitialization(Module &M) {
-  funcCountDataStr = PartsEventCount::getFuncDataStr(M);
-  funcCountDataLdr = PartsEventCount::getFuncDataLdr(M);
+  // The inline counters are created by PartsPassEventCounters
+  if (PARTS::useRuntimeStatsInline())
+    return false;
+
+  PartsEventCount::getFuncDataStr(M);
+  PartsEventCount::getFuncDataLdr(M);
   return true;
 }
 
@@ -112,6 +126,10 @@ bool PartsPassDpi::runOnMachineFunction(MachineFunction &MF) {
 
   if (MF.getFunction().getFnAttribute("no-parts").getValueAsString() == "true") return false;
 
+  // Infer the types of all loads and stores without metadata once, up front
+  typeInference = make_unique<PartsTypeInference>(TII, TRI);
+  typeInference->run(MF);
+
   for (auto &MBB : MF) {
     for (auto MIi = MBB.instr_begin(); MIi != MBB.instr_end(); MIi++) {
       DEBUG_PA(log->debug(MF.getName()) << MF.getName() << "->" << MBB.getName() << "->" << MIi);
@@ -119,14 +137,6 @@ bool PartsPassDpi::runOnMachineFunction(MachineFunction &MF) {
       if (partsUtils->isLoadOrStore(*MIi)) {
         instrumentLoadStore(MF, MBB, MIi);
       }
-
-      if (m_PACed_me_a_live_one > 1) {
-        // llvm_unreachable("didn't immediately get rid of un-killed PACed store");
-        m_PACed_me_a_live_one = 0;
-        m_the_live_one = nullptr;
-      } else if (m_PACed_me_a_live_one > 0) {
-        m_PACed_me_a_live_one++;
-      }
     }
   }
 
@@ -137,59 +147,65 @@ bool PartsPassDpi::instrumentLoadStore(MachineFunction &MF, MachineBasicBlock &M
                                          MachineBasicBlock::instr_iterator &MIi) {
   assert(partsUtils->isLoadOrStore(*MIi));
 
-  auto partsType = PartsTypeMetadata::retrieve(*MIi);
-  auto &C = MF.getFunction().getContext();
+  const auto numRegs = PartsUtils::getNumDataRegs(MIi->getOpcode());
+
+  DEBUG_PA(log->debug(MF.getName()) << "found a load/store (" << TII->getName(MIi->getOpcode()) << ")\n");
+
+  // The load/store optimizer merges accesses into pairs, so each lane may hold a pointer of its own type
+  bool instrumented = false;
+  for (unsigned lane = 0; lane < numRegs; lane++)
+    instrumented |= instrumentLoadStoreLane(MF, MBB, MIi, lane);
+
+  return instrumented;
+}
+
+bool PartsPassDpi::instrumentLoadStoreLane(MachineFunction &MF, MachineBasicBlock &MBB,
+                                           MachineBasicBlock::instr_iterator &MIi, unsigned lane) {
   const auto fName = MF.getName();
 
   const auto MIOpcode = MIi->getOpcode();
-  const auto MIName = TII->getName(MIOpcode).str();
+  const auto MIName = TII->getName(MIOpcode);
+  const auto numRegs = PartsUtils::getNumDataRegs(MIOpcode);
+
+  // Attaching the inferred type below adds an operand, so do not hold on to a reference to the data operand
+  const auto &Op = MIi->getOperand(PartsUtils::getDataOperandIdx(MIOpcode, lane));
+  const auto reg = Op.getReg();
+  const auto isKill = Op.isKill();
+  const auto baseReg = MIi->getOperand(PartsUtils::getBaseOperandIdx(MIOpcode)).getReg();
 
-  DEBUG_PA(log->debug(fName) << "found a load/store (" << TII->getName(MIOpcode) << ")\n");
+  auto partsType = PartsUtils::retrieveLaneType(*MIi, lane);
 
-  if (partsType == nullptr) {
+  if (!partsType) {
     DEBUG_PA(log->debug(fName) << "trying to figure out type_id\n");
-    auto Op = MIi->getOperand(0);
-    const auto targetReg = Op.getReg();
 
-    //if (!partsUtils->checkIfRegInstrumentable(targetReg)) {
-    if (!TRI->getPointerRegClass(MF)->contains(Op.getReg())) {
+    //if (!partsUtils->checkIfRegInstrumentable(reg)) {
+    if (!TRI->getPointerRegClass(MF)->contains(reg)) {
       partsType = PartsTypeMetadata::getIgnored();
       // Just to make sure this behaves as expected...
-      assert(Op.getReg() != AArch64::X0 && Op.getReg() != AArch64::X1 && Op.getReg() != AArch64::X2 &&
-             Op.getReg() != AArch64::X3 && Op.getReg() != AArch64::X4 && Op.getReg() != AArch64::X5 &&
-             Op.getReg() != AArch64::X6 && Op.getReg() != AArch64::X7 && Op.getReg() != AArch64::X8 &&
-             Op.getReg() != AArch64::X9 && Op.getReg() != AArch64::X11 && Op.getReg() != AArch64::X12 &&
-             Op.getReg() != AArch64::X13 && Op.getReg() != AArch64::X14 && Op.getReg() != AArch64::X15 &&
-             Op.getReg() != AArch64::X16 && Op.getReg() != AArch64::X17 && Op.getReg() != AArch64::X18 &&
-             Op.getReg() != AArch64::X19 && Op.getReg() != AArch64::X21 && Op.getReg() != AArch64::X22 &&
-             Op.getReg() != AArch64::X23 && Op.getReg() != AArch64::X24 && Op.getReg() != AArch64::X25 &&
-             Op.getReg() != AArch64::X26 && Op.getReg() != AArch64::X27 && Op.getReg() != AArch64::X28 &&
-             Op.getReg() != AArch64::FP && Op.getReg() != AArch64::LR);
-    } else if (Op.getReg() == AArch64::FP || Op.getReg() == AArch64::LR) {
+      assert(reg != AArch64::X0 && reg != AArch64::X1 && reg != AArch64::X2 &&
+             reg != AArch64::X3 && reg != AArch64::X4 && reg != AArch64::X5 &&
+             reg != AArch64::X6 && reg != AArch64::X7 && reg != AArch64::X8 &&
+             reg != AArch64::X9 && reg != AArch64::X11 && reg != AArch64::X12 &&
+             reg != AArch64::X13 && reg != AArch64::X14 && reg != AArch64::X15 &&
+             reg != AArch64::X16 && reg != AArch64::X17 && reg != AArch64::X18 &&
+             reg != AArch64::X19 && reg != AArch64::X21 && reg != AArch64::X22 &&
+             reg != AArch64::X23 && reg != AArch64::X24 && reg != AArch64::X25 &&
+             reg != AArch64::X26 && reg != AArch64::X27 && reg != AArch64::X28 &&
+             reg != AArch64::FP && reg != AArch64::LR);
+    } else if (reg == AArch64::FP || reg == AArch64::LR) {
       // Ignore FP and LR, they are handled elsewhre
       partsType = PartsTypeMetadata::getIgnored();
     } else {
       // remove this call at some point, checkIfRegInstrumentable is crappy...
-      assert(partsUtils->checkIfRegInstrumentable(targetReg));
-
-      if (partsUtils->isStore(*MIi)) {
-        partsType = partsUtils->inferPauthTypeIdRegBackwards(MF, MBB, *MIi, targetReg);
-      } else {
-        // FIXME: this only supports loads of type load reg [reg, imm]
-        if (MIi->getOperand(2).isImm()) {
-          partsType = partsUtils->inferPauthTypeIdStackBackwards(MF, MBB, *MIi, targetReg,
-                                                                 MIi->getOperand(1).getReg(),
-                                                                 MIi->getOperand(2).getImm());
-        } else {
-          log->error() << __FUNCTION__ << ": OMG! unexpected operands, is this a pair store thingy?\n";
-          partsType = PartsTypeMetadata::getUnknown();
-        }
-      }
-    }
-    partsUtils->attach(MF.getFunction().getContext(), partsType, &*MIi);
+      assert(partsUtils->checkIfRegInstrumentable(reg));
 
-    MIi->addOperand(MachineOperand::CreateMetadata(partsType->getMDNode(C)));
-    log->inc("StoreLoad.Inferred") << "      storing type_id " << partsType->toString() << ") in current MI\n";
+      // Stored register or loaded stack slot, as computed by the dataflow analysis
+      partsType = typeInference->lookup(*MIi, lane);
+    }
+    // A single metadata operand cannot describe both lanes of a pair
+    if (numRegs == 1)
+      partsUtils->attach(MF.getFunction().getContext(), *partsType, &*MIi);
+    log->inc("StoreLoad.Inferred") << "      storing type_id " << *partsType << ") in current MI\n";
   }
 
   skipIfN(partsType->isIgnored(), fName, "StoreLoad.Ignored_" + MIName, "marked as ignored, skipping!\n");
@@ -198,8 +214,8 @@ bool PartsPassDpi::instrumentLoadStore(MachineFunction &MF, MachineBasicBlock &M
       MIi->getFlag(MachineInstr::MIFlag::FrameSetup) ||
       MIi->getFlag(MachineInstr::MIFlag::FrameDestroy))) {
     // We're assuming this is a callee saved registerThing, so therefore this op should be relative to SP...
-    assert(MIi->getOperand(1).getReg() == AArch64::SP || MIi->getOperand(2).getReg() == AArch64::SP);
-    log->inc("StoreLoad.CalleeSaved_" + MIName, true, "skipping callee saved register!\n");
+    assert(baseReg == AArch64::SP);
+    log->inc("StoreLoad.CalleeSaved_" + MIName, true, fName) << "skipping callee saved register!\n";
     return false;
   }
 
@@ -207,41 +223,39 @@ bool PartsPassDpi::instrumentLoadStore(MachineFunction &MF, MachineBasicBlock &M
   skipIfN(!partsType->isPointer(), fName, "StoreLoad.NotAPointer_" + MIName, "not a pointer, skipping!\n");
   skipIfN(partsType->isCodePointer(), fName, "PartsPassDpi.StoreLoad.IgnoringCodePointer_" + MIName, "ignoring code pointer\n");
 
-  auto reg = MIi->getOperand(0).getReg();
   const auto modReg = PARTS::getModifierReg();
   const auto type_id = partsType->getTypeId();
+  const auto &DL = MIi->getDebugLoc();
 
   if (partsUtils->isStore(*MIi)) {
+    // PACing the pointer would also change the address it is stored to
+    skipIfN(reg == baseReg, fName, "StoreLoad.StoredBase_" + MIName, "stored pointer is also the base, skipping!\n");
+
+    if (lane > 0 && reg == MIi->getOperand(PartsUtils::getDataOperandIdx(MIOpcode, 0)).getReg()) {
+      log->inc("StoreLoad.PairSameRegister", true, fName) << "already PACed for the first lane\n";
+      return false;
+    }
+
     if (PARTS::useDpi()) {
-      log->inc("StoreLoad.InstrumentedDataStore", true) << "instrumenting store" << partsType->toString() << "\n";
-
-      // FIXME: Horrible hack for double define!
-      if (m_PACed_me_a_live_one == 0) {
-        const auto &DL = MIi->getDebugLoc();
-        partsUtils->pacDataPointer(MBB, MIi, reg, modReg, type_id, DL);
-        partsUtils->addEventCallFunction(MBB, *MIi, DL, funcCountDataStr);
-      } else {
-        assert(m_the_live_one->getReg() == MIi->getOperand(0).getReg());
-      }
+      ++NumDataStores;
+      log->inc("StoreLoad.InstrumentedDataStore", true) << "instrumenting store" << *partsType << "\n";
 
-      if (MIi->getOperand(0).isKill()) {
-        m_PACed_me_a_live_one = 0;
-      } else {
-        m_PACed_me_a_live_one = 1;
-        m_the_live_one = &(MIi->getOperand(0));
-      }
+      partsUtils->pacDataPointer(MBB, MIi, reg, modReg, type_id, DL);
+      partsUtils->addEventCount(MBB, *MIi, DL, PartsEventCount::DataStr);
+
+      // The register is still used after the store, so give the later users back the plain pointer
+      if (!isKill)
+        partsUtils->autDataPointer(MBB, std::next(MIi), reg, modReg, type_id, DL);
 
       return true;
     }
   } else {
-    auto loc = MIi;
-    loc++;
     if (PARTS::useDpi()) {
-      log->inc("StoreLoad.InstrumentedDataLoad", true, fName) << "instrumenting load with " << partsType->toString() << "\n";
+      ++NumDataLoads;
+      log->inc("StoreLoad.InstrumentedDataLoad", true, fName) << "instrumenting load with " << *partsType << "\n";
 
-      const auto &DL = loc->getDebugLoc();
-      partsUtils->autDataPointer(MBB, loc, reg, modReg, type_id, DL);
-      partsUtils->addEventCallFunction(MBB, *MIi, DL, funcCountDataLdr);
+      partsUtils->autDataPointer(MBB, std::next(MIi), reg, modReg, type_id, DL);
+      partsUtils->addEventCount(MBB, *MIi, DL, PartsEventCount::DataLdr);
       return true;
     }
   }
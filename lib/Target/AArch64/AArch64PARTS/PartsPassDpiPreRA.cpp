@@ -0,0 +1,336 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SSA variant of the PARTS data pointer instrumentation. This runs before
+// register allocation and emits PARTS_PACDA/PARTS_AUTDA pseudos on virtual
+// registers, so that the MachineScheduler sees the PA latency and can overlap
+// it with independent work. The pseudos are expanded by AArch64ExpandPseudo.
+//
+// With -parts-dpi-sink-aut, the authentication of a loaded pointer is moved
+// from right after the load to the least frequently executed block that
+// still dominates all users of the pointer. Pointers that are only used on
+// cold paths then stay signed on the hot path. Comparisons count as users,
+// since a signed null pointer is not zero.
+//
+// With -parts-soft-pa, the pseudos are replaced by calls to the software PA
+// helpers, see PartsSoftPa.h.
+//
+//===----------------------------------------------------------------------===//
+
+// LLVM includes
+#include "AArch64.h"
+#include "AArch64Subtarget.h"
+#include "AArch64RegisterInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineDominators.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachinePostDominators.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+// PARTS includes
+#include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/Parts.h"
+#include "PartsUtils.h"
+
+#define DEBUG_TYPE "aarch64-parts-dpi-prera"
+
+STATISTIC(NumDataStores, "Number of data pointer stores instrumented before register allocation");
+STATISTIC(NumDataLoads, "Number of data pointer loads instrumented before register allocation");
+STATISTIC(NumSkipped, "Number of loads and stores left uninstrumented");
+STATISTIC(NumLoadAutsSunk, "Number of data pointer authentications sunk below the load block");
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+#define skipIfB(ifx, fName, stat, b, string) do {  \
+    if ((ifx)) {                            \
+      log->inc(stat, b, fName) << string;          \
+      ++NumSkipped;                         \
+      return false;                         \
+    }                                       \
+} while(false)
+
+#define skipIfN(ifx, fName, stat, string) do {     \
+    if ((ifx)) {                            \
+      log->inc(stat, fName) << string;             \
+      ++NumSkipped;                         \
+      return false;                         \
+    }                                       \
+} while (false)
+
+namespace {
+ class PartsPassDpiPreRA : public MachineFunctionPass {
+
+ public:
+   static char ID;
+
+   PartsPassDpiPreRA() :
+       MachineFunctionPass(ID),
+       log(PARTS::PartsLog::getLogger(DEBUG_TYPE))
+   {
+     DEBUG_PA(log->enable());
+   }
+
+   StringRef getPassName() const override { return DEBUG_TYPE; }
+
+   bool runOnMachineFunction(MachineFunction &) override;
+
+   void getAnalysisUsage(AnalysisUsage &AU) const override {
+     if (PARTS::useDpiSinkAut()) {
+       AU.addRequired<MachineDominatorTree>();
+       AU.addRequired<MachinePostDominatorTree>();
+       AU.addRequired<MachineBlockFrequencyInfo>();
+     }
+     AU.setPreservesCFG();
+     MachineFunctionPass::getAnalysisUsage(AU);
+   }
+
+ private:
+
+   PartsLog_ptr log;
+
+   const AArch64InstrInfo *TII = nullptr;
+   const AArch64RegisterInfo *TRI = nullptr;
+   MachineRegisterInfo *MRI = nullptr;
+   PartsUtils_ptr partsUtils = nullptr;
+   MachineDominatorTree *MDT = nullptr;
+   MachinePostDominatorTree *MPDT = nullptr;
+   MachineBlockFrequencyInfo *MBFI = nullptr;
+
+   bool instrumentLoadStore(MachineFunction &MF, MachineBasicBlock &MBB, MachineInstr &MI);
+   void instrumentStore(MachineBasicBlock &MBB, MachineInstr &MI, type_id_t type_id);
+   void instrumentLoad(MachineBasicBlock &MBB, MachineInstr &MI, type_id_t type_id);
+
+   /*!
+    * Find where to authenticate the pointer loaded into dstReg by MI. This is right after the load, unless
+    * -parts-dpi-sink-aut finds a less frequently executed block that dominates all uses of dstReg.
+    */
+   MachineBasicBlock::instr_iterator findAutPoint(MachineInstr &MI, unsigned dstReg, MachineBasicBlock *&autMBB);
+
+   /*!
+    * Only single 64-bit GPR loads and stores, incl. writeback variants, are handled here. Pairs are
+    * only formed after register allocation and are left to the post-RA pass.
+    */
+   static bool isInstrumentable(const MachineInstr &MI);
+
+   /*! Get the operand holding the loaded or stored pointer */
+   static MachineOperand &getPointerOperand(MachineInstr &MI) {
+     return MI.getOperand(PartsUtils::getDataOperandIdx(MI.getOpcode(), 0));
+   }
+ };
+} // end anonymous namespace
+
+FunctionPass *llvm::createPartsPassDpiPreRA() {
+  return new PartsPassDpiPreRA();
+}
+
+char PartsPassDpiPreRA::ID = 0;
+
+// Registered so that MIR tests can run the pass on its own
+INITIALIZE_PASS_BEGIN(PartsPassDpiPreRA, DEBUG_TYPE, "PARTS pre-RA data pointer instrumentation", false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineDominatorTree)
+INITIALIZE_PASS_DEPENDENCY(MachinePostDominatorTree)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
+INITIALIZE_PASS_END(PartsPassDpiPreRA, DEBUG_TYPE, "PARTS pre-RA data pointer instrumentation", false, false)
+
+bool PartsPassDpiPreRA::isInstrumentable(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+    default:
+      return false;
+    case AArch64::LDRXui:
+    case AArch64::LDURXi:
+    case AArch64::LDRXroX:
+    case AArch64::LDRXroW:
+    case AArch64::STRXui:
+    case AArch64::STURXi:
+    case AArch64::STRXroX:
+    case AArch64::STRXroW:
+    case AArch64::LDRXpre:
+    case AArch64::LDRXpost:
+    case AArch64::STRXpre:
+    case AArch64::STRXpost: {
+      const auto &ptrOp = MI.getOperand(PartsUtils::getDataOperandIdx(MI.getOpcode(), 0));
+      return ptrOp.isReg() && TargetRegisterInfo::isVirtualRegister(ptrOp.getReg());
+    }
+  }
+}
+
+bool PartsPassDpiPreRA::runOnMachineFunction(MachineFunction &MF) {
+  if (!PARTS::useDpi())
+    return false;
+  if (MF.getFunction().getFnAttribute("no-parts").getValueAsString() == "true")
+    return false;
+
+  DEBUG(dbgs() << getPassName() << ", function " << MF.getName() << '\n');
+
+  const auto &STI = MF.getSubtarget<AArch64Subtarget>();
+  TII = STI.getInstrInfo();
+  TRI = STI.getRegisterInfo();
+  MRI = &MF.getRegInfo();
+  partsUtils = PartsUtils::get(TRI, TII);
+
+  if (PARTS::useDpiSinkAut()) {
+    MDT = &getAnalysis<MachineDominatorTree>();
+    MPDT = &getAnalysis<MachinePostDominatorTree>();
+    MBFI = &getAnalysis<MachineBlockFrequencyInfo>();
+  }
+
+  assert(MRI->isSSA() && "pre-RA DPI expects SSA form");
+
+  bool found = false;
+
+  for (auto &MBB : MF) {
+    for (auto MIi = MBB.instr_begin(), MIe = MBB.instr_end(); MIi != MIe; ) {
+      // Instrumentation is inserted around the current instruction, so step past it first
+      auto &MI = *MIi++;
+      DEBUG_PA(log->debug(MF.getName()) << MF.getName() << "->" << MBB.getName() << "->" << MI);
+
+      if (partsUtils->isLoadOrStore(MI))
+        found |= instrumentLoadStore(MF, MBB, MI);
+    }
+  }
+
+  return found;
+}
+
+bool PartsPassDpiPreRA::instrumentLoadStore(MachineFunction &MF, MachineBasicBlock &MBB, MachineInstr &MI) {
+  const auto fName = MF.getName();
+  const auto MIName = TII->getName(MI.getOpcode());
+  const auto partsType = PartsTypeMetadata::retrieve(MI);
+
+  // Without spills there is nothing to infer from, missing metadata means we cannot know the type
+  skipIfB(!partsType, fName, "StoreLoad.Unknown_" + MIName, false, "no type_id metadata!\n");
+  skipIfN(partsType->isIgnored(), fName, "StoreLoad.Ignored_" + MIName, "marked as ignored, skipping!\n");
+  skipIfB(!partsType->isKnown(), fName, "StoreLoad.Unknown_" + MIName, false, "type_id is unknown!\n");
+  skipIfN(!partsType->isPointer(), fName, "StoreLoad.NotAPointer_" + MIName, "not a pointer, skipping!\n");
+  skipIfN(partsType->isCodePointer(), fName, "StoreLoad.IgnoringCodePointer_" + MIName, "ignoring code pointer\n");
+  skipIfN(!isInstrumentable(MI), fName, "StoreLoad.Unsupported_" + MIName, "unsupported load/store form\n");
+  skipIfN(!MRI->constrainRegClass(getPointerOperand(MI).getReg(), &AArch64::GPR64RegClass), fName,
+          "StoreLoad.BadRegClass_" + MIName, "pointer not in a GPR64 register\n");
+
+  if (partsUtils->isStore(MI)) {
+    ++NumDataStores;
+    log->inc("StoreLoad.InstrumentedDataStore", true, fName) << "instrumenting store " << *partsType << "\n";
+    instrumentStore(MBB, MI, partsType->getTypeId());
+  } else {
+    ++NumDataLoads;
+    log->inc("StoreLoad.InstrumentedDataLoad", true, fName) << "instrumenting load " << *partsType << "\n";
+    instrumentLoad(MBB, MI, partsType->getTypeId());
+  }
+
+  return true;
+}
+
+void PartsPassDpiPreRA::instrumentStore(MachineBasicBlock &MBB, MachineInstr &MI, type_id_t type_id) {
+  const auto &DL = MI.getDebugLoc();
+  auto &ptrOp = getPointerOperand(MI);
+  const auto modReg = PARTS::getModifierReg(*MBB.getParent());
+
+  // %mod = type_id; %pac = PACDA %ptr, %mod; STR %pac, ...
+  partsUtils->moveTypeIdToReg(MBB, &MI, modReg, type_id, DL);
+  if (PARTS::useSoftPa()) {
+    ptrOp.setReg(partsUtils->softPaCallVirt(MBB, MI.getIterator(), ptrOp.getReg(), modReg, PartsSoftPa::PACDA, DL));
+    return;
+  }
+
+  const auto pacReg = MRI->createVirtualRegister(&AArch64::GPR64RegClass);
+  BuildMI(MBB, MI, DL, TII->get(AArch64::PARTS_PACDA), pacReg)
+      .addReg(ptrOp.getReg())
+      .addReg(modReg, RegState::Kill)
+      .setMIFlag(MachineInstr::PartsInstr);
+
+  // Any kill flag on the store now applies to the signed copy
+  ptrOp.setReg(pacReg);
+}
+
+void PartsPassDpiPreRA::instrumentLoad(MachineBasicBlock &MBB, MachineInstr &MI, type_id_t type_id) {
+  const auto &DL = MI.getDebugLoc();
+  auto &dstOp = getPointerOperand(MI);
+  const auto dstReg = dstOp.getReg();
+  const auto modReg = PARTS::getModifierReg(*MBB.getParent());
+  const auto rawReg = MRI->createVirtualRegister(&AArch64::GPR64RegClass);
+
+  MachineBasicBlock *autMBB = nullptr;
+  const auto insertPoint = findAutPoint(MI, dstReg, autMBB);
+
+  // %raw = LDR ...; %mod = type_id; %dst = AUTDA %raw, %mod
+  dstOp.setReg(rawReg);
+
+  partsUtils->moveTypeIdToReg(*autMBB, insertPoint, modReg, type_id, DL);
+  if (PARTS::useSoftPa()) {
+    const auto autReg = partsUtils->softPaCallVirt(*autMBB, insertPoint, rawReg, modReg, PartsSoftPa::AUTDA, DL);
+    BuildMI(*autMBB, insertPoint, DL, TII->get(TargetOpcode::COPY), dstReg)
+        .addReg(autReg, RegState::Kill)
+        .setMIFlag(MachineInstr::PartsInstr);
+    return;
+  }
+
+  BuildMI(*autMBB, insertPoint, DL, TII->get(AArch64::PARTS_AUTDA), dstReg)
+      .addReg(rawReg, RegState::Kill)
+      .addReg(modReg, RegState::Kill)
+      .setMIFlag(MachineInstr::PartsInstr);
+}
+
+MachineBasicBlock::instr_iterator PartsPassDpiPreRA::findAutPoint(MachineInstr &MI, unsigned dstReg,
+                                                                  MachineBasicBlock *&autMBB) {
+  auto *loadMBB = MI.getParent();
+  autMBB = loadMBB;
+
+  if (!PARTS::useDpiSinkAut())
+    return std::next(MachineBasicBlock::instr_iterator(MI));
+
+  // The authentication must dominate all uses, for a PHI that is the end of the incoming block
+  MachineBasicBlock *useMBB = nullptr;
+  for (auto &MO : MRI->use_nodbg_operands(dstReg)) {
+    auto *UseMI = MO.getParent();
+    auto *MBB = UseMI->getParent();
+    if (UseMI->isPHI())
+      MBB = UseMI->getOperand(UseMI->getOperandNo(&MO) + 1).getMBB();
+    // Unreachable blocks are not in the dominator tree, and never run the use anyway
+    if (MDT->getNode(MBB) == nullptr)
+      continue;
+    useMBB = (useMBB == nullptr ? MBB : MDT->findNearestCommonDominator(useMBB, MBB));
+  }
+
+  // Walk up the dominator tree towards the load and pick the least frequently executed block
+  auto bestFreq = MBFI->getBlockFreq(loadMBB);
+  for (auto *MBB = useMBB; MBB != nullptr && MBB != loadMBB; MBB = MDT->getNode(MBB)->getIDom()->getBlock()) {
+    // A block post-dominating the load runs whenever the load does, so there would be nothing to save
+    if (MBB->isEHPad() || MPDT->dominates(MBB, loadMBB))
+      continue;
+
+    const auto freq = MBFI->getBlockFreq(MBB);
+    if (freq < bestFreq) {
+      autMBB = MBB;
+      bestFreq = freq;
+    }
+  }
+
+  if (autMBB == loadMBB)
+    return std::next(MachineBasicBlock::instr_iterator(MI));
+
+  ++NumLoadAutsSunk;
+  log->inc("StoreLoad.SunkDataLoadAut", true, MI.getParent()->getParent()->getName())
+      << "authenticating load in " << autMBB->getName() << "\n";
+
+  // Authenticate right before the first use, or at the end of the block if it only dominates the uses
+  for (auto it = autMBB->getFirstNonPHI(); it != autMBB->end(); ++it) {
+    if (it->isTerminator())
+      break;
+    if (it->readsVirtualRegister(dstReg))
+      return it.getInstrIterator();
+  }
+  return autMBB->getFirstInstrTerminator();
+}
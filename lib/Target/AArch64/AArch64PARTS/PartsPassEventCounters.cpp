@@ -0,0 +1,78 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Create the -parts-stats-inline counter array and its constructor, and the
+// -parts-soft-pa helpers, while the backend still runs on IR. The machine
+// passes only look them up, so they go through the same code generation as
+// everything else.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "AArch64.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsEventCount.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsSoftPa.h"
+
+#define DEBUG_TYPE "aarch64-parts-event-counters"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+namespace {
+class PartsPassEventCounters : public ModulePass {
+public:
+  static char ID;
+
+  PartsPassEventCounters() :
+      ModulePass(ID),
+      log(PARTS::PartsLog::getLogger(DEBUG_TYPE))
+  {
+    DEBUG_PA(log->enable());
+  }
+
+  StringRef getPassName() const override { return "parts-event-counters"; }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  PartsLog_ptr log;
+};
+} // end anonymous namespace
+
+ModulePass *llvm::createPartsPassEventCounters() {
+  return new PartsPassEventCounters();
+}
+
+char PartsPassEventCounters::ID = 0;
+
+bool PartsPassEventCounters::runOnModule(Module &M) {
+  bool changed = false;
+
+  // The pre-RA passes call the soft PA helpers, create them before any counter slots so they get none
+  if (PARTS::useSoftPa()) {
+    PartsSoftPa::createHelpers(M);
+    changed = true;
+  }
+
+  if (PARTS::useRuntimeStatsInline() && PartsEventCount::getInlineCounters(M) == nullptr) {
+    PartsEventCount::createInlineCounters(M);
+    log->inc("EventCounters.Created", true) << "created inline counters for " << M.getName() << "\n";
+    changed = true;
+  }
+
+  return changed;
+}
@@ -26,10 +26,11 @@
 #include "llvm/PARTS/Parts.h"
 #include "llvm/PARTS/PartsTypeMetadata.h"
 #include "llvm/PARTS/PartsEventCount.h"
+#include "llvm/PARTS/PartsSoftPa.h"
 #include "PartsUtils.h"
 
 #define DEBUG_TYPE "aarch64-parts-intrinsics"
-#define TAG "PartsPasSIntrinsics"
+
 
 using namespace llvm;
 using namespace llvm::PARTS;
@@ -49,22 +50,21 @@ public:
   StringRef getPassName() const override { return "parts-intrinsics"; }
 
   bool doInitialization(Module &M) override;
+  bool doFinalization(Module &M) override;
   bool runOnMachineFunction(MachineFunction &) override;
 
 private:
 
   PartsLog_ptr log;
 
+  /*! Count the event of a call to a soft PA helper, returns false if op is not a helper */
+  bool countSoftPaCall(MachineBasicBlock &MBB, MachineInstr &MI, PartsSoftPa::Op op);
+
   //const TargetMachine *TM = nullptr;
   const AArch64Subtarget *STI = nullptr;
   const AArch64InstrInfo *TII = nullptr;
   const AArch64RegisterInfo *TRI = nullptr;
   PartsUtils_ptr partsUtils;
-
-  Function *funcCountCodePtrCreate = nullptr;
-  Function *funcCountDataStr = nullptr;
-  Function *funcCountNonleafCall = nullptr;
-  Function *funcCountLeafCall = nullptr;
 };
 } // end anonymous namespace
 
@@ -75,13 +75,21 @@ FunctionPass *llvm::createPartsPassIntrinsics() {
 char PartsPassIntrinsics::ID = 0;
 
 bool PartsPassIntrinsics::doInitialization(Module &M) {
-  funcCountCodePtrCreate = PartsEventCount::getFuncCodePointerCreate(M);
-  funcCountDataStr = PartsEventCount::getFuncDataStr(M);
-  funcCountNonleafCall = PartsEventCount::getFuncNonleafCall(M);
-  funcCountLeafCall = PartsEventCount::getFuncLeafCall(M);
+  // The inline counters and the soft PA helpers are created by PartsPassEventCounters
+  if (PARTS::useRuntimeStatsInline())
+    return false;
+
+  for (unsigned kind = 0; kind < PartsEventCount::NumEventKinds; kind++)
+    PartsEventCount::getCounterFunc(M, static_cast<PartsEventCount::EventKind>(kind));
   return true;
 }
 
+bool PartsPassIntrinsics::doFinalization(Module &M) {
+  // This is the last PARTS pass in the backend, so drop the type_ids memoized during codegen
+  PartsTypeMetadata::releaseTypeIdCache(M.getContext());
+  return false;
+}
+
 bool PartsPassIntrinsics::runOnMachineFunction(MachineFunction &MF) {
   bool found = false;
 
@@ -107,57 +115,29 @@ bool PartsPassIntrinsics::runOnMachineFunction(MachineFunction &MF) {
           // Should however work as long as we only use PACIB for return address signing.
           if (PARTS::useRuntimeStats()) {
             const auto &DL = MIi->getDebugLoc();
-            partsUtils->addEventCallFunction(MBB, *MIi, DL, funcCountNonleafCall);
+            partsUtils->addEventCount(MBB, *MIi, DL, PartsEventCount::NonleafCall);
             foundReturnSign = true;
             found = true;
           }
           break;
         }
-        case AArch64::PARTS_PACIA:
-        case AArch64::PARTS_PACDA:
-        case AArch64::PARTS_AUTIA:
-        case AArch64::PARTS_AUTDA:
-          const auto &DL = MIi->getDebugLoc();
-          const unsigned dst = MIi->getOperand(0).getReg();
-          const unsigned src = MIi->getOperand(1).getReg();
-          unsigned mod = MIi->getOperand(2).getReg();
-
-          // Save the mod register if it is marked as killable!
-          if (MIi->getOperand(2).isKill()) {
-            unsigned oldMod = mod;
-            mod = PARTS::getModifierReg();
-            BuildMI(MBB, MIi, DL, TII->get(AArch64::ADDXri), mod).addReg(oldMod).addImm(0).addImm(0);
+        case AArch64::BLRAA: {
+          // PartsPassCpi runs before register allocation, so count the authenticated branches here
+          if (PARTS::useRuntimeStats()) {
+            partsUtils->addEventCount(MBB, *MIi, MIi->getDebugLoc(), PartsEventCount::CodePointerBranch);
+            found = true;
           }
-          // Move the pointer to destination register
-          BuildMI(MBB, MIi, DL, TII->get(AArch64::ADDXri), dst).addReg(src).addImm(0).addImm(0);
-
-          // Insert appropriate PA instruction
-          if (MIOpcode == AArch64::PARTS_PACIA) {
-            log->inc(TAG ".pacia", true) << "converting PARTS_PACIA\n";
-            partsUtils->insertPAInstr(MBB, MIi, dst, mod, TII->get(AArch64::PACIA), DL);
-            partsUtils->addEventCallFunction(MBB, *MIi, DL, funcCountCodePtrCreate);
-          } else if (MIOpcode == AArch64::PARTS_PACDA) {
-            log->inc(TAG ".pacda", true) << "converting PARTS_PACDA\n";
-            partsUtils->insertPAInstr(MBB, MIi, dst, mod, TII->get(AArch64::PACDA), DL);
-            partsUtils->addEventCallFunction(MBB, *MIi, DL, funcCountDataStr);
-          } else if (MIOpcode == AArch64::PARTS_AUTIA) {
-            assert(false && "should never(?) be AUTIAing instruction pointers");
-            log->inc(TAG ".autia", true) << "converting PARTS_AUTIA\n";
-            partsUtils->insertPAInstr(MBB, MIi, dst, mod, TII->get(AArch64::AUTIA), DL);
-          } else if (MIOpcode == AArch64::PARTS_AUTDA) {
-            assert(false && "this isn't currently used, and should be updated if its gonna be");
-            log->inc(TAG ".autda", true) << "converting PARTS_AUTDA\n";
-            partsUtils->insertPAInstr(MBB, MIi, dst, mod, TII->get(AArch64::AUTDA), DL);
+          break;
+        }
+        case AArch64::BL: {
+          // With -parts-soft-pa, the PA instructions and BLRAA are replaced by calls to the helpers
+          if (PARTS::useRuntimeStats() && PARTS::useSoftPa() && MIi->getOperand(0).isGlobal()) {
+            const auto *callee = dyn_cast<Function>(MIi->getOperand(0).getGlobal());
+            if (callee != nullptr && countSoftPaCall(MBB, *MIi, PartsSoftPa::getHelperOp(*callee)))
+              found = true;
           }
-
-          // And finally, remove the intrinsic
-          auto tmp = MIi;
-          MIi--;
-          tmp->removeFromParent();
-
-          found = true; // make sure we return true when we modify stuff
-
           break;
+        }
       }
 
     }
@@ -171,7 +151,7 @@ bool PartsPassIntrinsics::runOnMachineFunction(MachineFunction &MF) {
       for (auto &MBB : MF) {
         for (auto MIi = MBB.instr_begin(); MIi != MBB.instr_end(); MIi++) {
           if (MIi->isReturn()) {
-            partsUtils->addEventCallFunction(MBB, *MIi, MIi->getDebugLoc(), funcCountLeafCall);
+            partsUtils->addEventCount(MBB, *MIi, MIi->getDebugLoc(), PartsEventCount::LeafCall);
             found = true;
           }
         }
@@ -181,3 +161,26 @@ bool PartsPassIntrinsics::runOnMachineFunction(MachineFunction &MF) {
 
   return found;
 }
+
+bool PartsPassIntrinsics::countSoftPaCall(MachineBasicBlock &MBB, MachineInstr &MI, PartsSoftPa::Op op) {
+  PartsEventCount::EventKind kind;
+  switch (op) {
+    default:
+      return false;
+    case PartsSoftPa::PACIA:
+      kind = PartsEventCount::CodePointerCreate;
+      break;
+    case PartsSoftPa::PACDA:
+      kind = PartsEventCount::DataStr;
+      break;
+    case PartsSoftPa::AUTIA:
+      kind = PartsEventCount::CodePointerBranch;
+      break;
+    case PartsSoftPa::AUTDA:
+      kind = PartsEventCount::DataLdr;
+      break;
+  }
+
+  partsUtils->addEventCount(MBB, MI, MI.getDebugLoc(), kind);
+  return true;
+}
@@ -0,0 +1,407 @@
+//===----------------------------------------------------------------------===//
+//
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The DPI and CPI passes materialize the full 64-bit type_id into the PA
+// modifier register with four MOVKs before every single PA instruction. This
+// pass tracks the known 16-bit chunks of the modifier register across
+// instructions and basic blocks and then:
+//
+//  * removes materializations of a value that is already in the register,
+//  * only rewrites the chunks that differ from the known value,
+//  * uses MOVZ and skips zero chunks when the value must be built from scratch,
+//  * hoists the materialization out of loops that only ever use one modifier,
+//    unless the loop only uses it on paths taken less often than the loop is entered.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AArch64.h"
+#include "AArch64Subtarget.h"
+#include "AArch64RegisterInfo.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+// PARTS includes
+#include "llvm/PARTS/Parts.h"
+#include "PartsUtils.h"
+
+#define DEBUG_TYPE "aarch64-parts-modifier-opt"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+STATISTIC(NumMaterializationsRemoved, "Number of redundant modifier materializations removed");
+STATISTIC(NumMaterializationsHoisted, "Number of modifier materializations hoisted out of loops");
+STATISTIC(NumMovesRemoved, "Number of MOVZ/MOVK instructions removed from modifier materializations");
+
+namespace {
+
+/// The known 16-bit chunks of the modifier register at some program point.
+struct ModifierState {
+  bool Top = true;      // Not yet reached by the dataflow (identity for meet)
+  uint8_t KnownMask = 0; // Bit i set when chunk i (bits 16*i..16*i+15) is known
+  uint64_t Value = 0;
+
+  static ModifierState getUnknown() {
+    ModifierState S;
+    S.Top = false;
+    return S;
+  }
+
+  static ModifierState getFull(uint64_t Value) {
+    ModifierState S = getUnknown();
+    S.KnownMask = 0xf;
+    S.Value = Value;
+    return S;
+  }
+
+  bool isFullyKnown() const { return !Top && KnownMask == 0xf; }
+
+  bool knowsChunk(unsigned Chunk, uint64_t Imm) const {
+    return !Top && (KnownMask & (1 << Chunk)) && chunk(Value, Chunk) == Imm;
+  }
+
+  void setChunk(unsigned Chunk, uint64_t Imm) {
+    Top = false;
+    KnownMask |= 1 << Chunk;
+    Value = (Value & ~(uint64_t(UINT16_MAX) << (16 * Chunk))) | (Imm << (16 * Chunk));
+  }
+
+  void meet(const ModifierState &Other) {
+    if (Other.Top)
+      return;
+    if (Top) {
+      *this = Other;
+      return;
+    }
+    for (unsigned Chunk = 0; Chunk < 4; Chunk++)
+      if (chunk(Value, Chunk) != chunk(Other.Value, Chunk))
+        KnownMask &= ~(1 << Chunk);
+    KnownMask &= Other.KnownMask;
+  }
+
+  bool operator==(const ModifierState &Other) const {
+    return Top == Other.Top && KnownMask == Other.KnownMask &&
+           ((Value ^ Other.Value) & maskOf(KnownMask)) == 0;
+  }
+  bool operator!=(const ModifierState &Other) const { return !(*this == Other); }
+
+  static uint64_t chunk(uint64_t Value, unsigned Chunk) {
+    return (Value >> (16 * Chunk)) & UINT16_MAX;
+  }
+
+  static uint64_t maskOf(uint8_t KnownMask) {
+    uint64_t Mask = 0;
+    for (unsigned Chunk = 0; Chunk < 4; Chunk++)
+      if (KnownMask & (1 << Chunk))
+        Mask |= uint64_t(UINT16_MAX) << (16 * Chunk);
+    return Mask;
+  }
+};
+
+class PartsPassModifierOpt : public MachineFunctionPass {
+public:
+  static char ID;
+
+  PartsPassModifierOpt() : MachineFunctionPass(ID) {}
+
+  StringRef getPassName() const override { return DEBUG_TYPE; }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+    AU.addRequired<MachineLoopInfo>();
+    AU.addPreserved<MachineLoopInfo>();
+    AU.addRequired<MachineBlockFrequencyInfo>();
+    AU.addPreserved<MachineBlockFrequencyInfo>();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  bool runOnMachineFunction(MachineFunction &) override;
+
+private:
+  const AArch64InstrInfo *TII = nullptr;
+  const AArch64RegisterInfo *TRI = nullptr;
+  unsigned ModReg = 0;
+  MachineBlockFrequencyInfo *MBFI = nullptr;
+
+  DenseMap<const MachineBasicBlock *, ModifierState> BlockIn;
+  DenseMap<const MachineBasicBlock *, ModifierState> BlockOut;
+
+  bool isModifierMove(const MachineInstr &MI) const;
+  bool clobbersModifier(const MachineInstr &MI) const;
+  void transfer(const MachineInstr &MI, ModifierState &S) const;
+  void computeBlockStates(MachineFunction &MF);
+
+  bool hoistFromLoop(MachineLoop &L);
+  bool findLoopModifier(MachineLoop &L, uint64_t &Value, BlockFrequency &Freq) const;
+
+  bool optimizeBlock(MachineBasicBlock &MBB);
+  bool planMaterialization(const ModifierState &S, uint64_t Value, SmallVectorImpl<unsigned> &Chunks) const;
+  void emitMaterialization(MachineBasicBlock &MBB, MachineBasicBlock::iterator InsertPt,
+                           const ModifierState &S, uint64_t Value, const DebugLoc &DL);
+};
+
+} // end anonymous namespace
+
+FunctionPass *llvm::createPartsPassModifierOpt() {
+  return new PartsPassModifierOpt();
+}
+
+char PartsPassModifierOpt::ID = 0;
+
+// Registered so that MIR tests can run the pass on its own
+INITIALIZE_PASS_BEGIN(PartsPassModifierOpt, DEBUG_TYPE, "PARTS modifier materialization optimization", false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfo)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
+INITIALIZE_PASS_END(PartsPassModifierOpt, DEBUG_TYPE, "PARTS modifier materialization optimization", false, false)
+
+bool PartsPassModifierOpt::isModifierMove(const MachineInstr &MI) const {
+  return (MI.getOpcode() == AArch64::MOVKXi || MI.getOpcode() == AArch64::MOVZXi) &&
+         MI.getOperand(0).getReg() == ModReg;
+}
+
+bool PartsPassModifierOpt::clobbersModifier(const MachineInstr &MI) const {
+  // Callees are instrumented too, and the reserved modifier is not saved across calls
+  return MI.isCall() || MI.isInlineAsm() || MI.modifiesRegister(ModReg, TRI);
+}
+
+void PartsPassModifierOpt::transfer(const MachineInstr &MI, ModifierState &S) const {
+  if (isModifierMove(MI)) {
+    const unsigned Imm = MI.getOperand(MI.getNumExplicitOperands() - 2).getImm();
+    const unsigned Chunk = MI.getOperand(MI.getNumExplicitOperands() - 1).getImm() / 16;
+
+    if (MI.getOpcode() == AArch64::MOVZXi)
+      S = ModifierState::getFull(0);
+    S.setChunk(Chunk, Imm);
+  } else if (clobbersModifier(MI)) {
+    S = ModifierState::getUnknown();
+  }
+}
+
+void PartsPassModifierOpt::computeBlockStates(MachineFunction &MF) {
+  BlockIn.clear();
+  BlockOut.clear();
+
+  ReversePostOrderTraversal<MachineFunction *> RPOT(&MF);
+
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+
+    for (auto *MBB : RPOT) {
+      ModifierState In;
+
+      if (MBB->pred_empty() || MBB->isEHPad() || MBB == &MF.front()) {
+        In = ModifierState::getUnknown();
+      } else {
+        for (auto *Pred : MBB->predecessors())
+          In.meet(BlockOut.lookup(Pred));
+      }
+
+      auto Found = BlockIn.find(MBB);
+      if (Found != BlockIn.end() && Found->second == In)
+        continue;
+
+      BlockIn[MBB] = In;
+      if (!In.Top)
+        for (auto &MI : *MBB)
+          transfer(MI, In);
+      BlockOut[MBB] = In;
+      Changed = true;
+    }
+  }
+}
+
+bool PartsPassModifierOpt::findLoopModifier(MachineLoop &L, uint64_t &Value, BlockFrequency &Freq) const {
+  bool Found = false;
+
+  for (auto *MBB : L.blocks()) {
+    bool InBlock = false;
+
+    for (auto MII = MBB->begin(); MII != MBB->end(); ++MII) {
+      if (!isModifierMove(*MII)) {
+        if (clobbersModifier(*MII))
+          return false;
+        continue;
+      }
+
+      // Only accept complete materializations, i.e., a run of moves defining all four chunks
+      ModifierState S = ModifierState::getUnknown();
+      auto End = MII;
+      for (; End != MBB->end() && isModifierMove(*End); ++End)
+        transfer(*End, S);
+      if (!S.isFullyKnown())
+        return false;
+      if (Found && S.Value != Value)
+        return false;
+
+      Found = true;
+      InBlock = true;
+      Value = S.Value;
+      MII = std::prev(End);
+    }
+
+    if (InBlock)
+      Freq += MBFI->getBlockFreq(MBB);
+  }
+
+  return Found;
+}
+
+bool PartsPassModifierOpt::hoistFromLoop(MachineLoop &L) {
+  uint64_t Value;
+  BlockFrequency Freq;
+  auto *Preheader = L.getLoopPreheader();
+
+  // Materializing on every loop entry only pays off if the loop does so at least as often itself
+  if (Preheader != nullptr && findLoopModifier(L, Value, Freq) && Freq >= MBFI->getBlockFreq(Preheader)) {
+    // The loop only ever uses one modifier, so define it once before the loop and let
+    // optimizeBlock remove the now redundant materializations inside the loop.
+    emitMaterialization(*Preheader, Preheader->getFirstTerminator(), ModifierState::getUnknown(),
+                        Value, DebugLoc());
+    ++NumMaterializationsHoisted;
+    return true;
+  }
+
+  bool Changed = false;
+  for (auto *SubLoop : L)
+    Changed |= hoistFromLoop(*SubLoop);
+  return Changed;
+}
+
+bool PartsPassModifierOpt::planMaterialization(const ModifierState &S, uint64_t Value,
+                                               SmallVectorImpl<unsigned> &Chunks) const {
+  // Either patch up only the chunks that differ from the known value...
+  SmallVector<unsigned, 4> Patch;
+  for (unsigned Chunk = 0; Chunk < 4; Chunk++)
+    if (!S.knowsChunk(Chunk, ModifierState::chunk(Value, Chunk)))
+      Patch.push_back(Chunk);
+
+  // ...or start from a MOVZ and only set the non-zero chunks.
+  SmallVector<unsigned, 4> Fresh;
+  for (unsigned Chunk = 0; Chunk < 4; Chunk++)
+    if (ModifierState::chunk(Value, Chunk) != 0)
+      Fresh.push_back(Chunk);
+  if (Fresh.empty())
+    Fresh.push_back(0);
+
+  const bool UseMovz = Fresh.size() < Patch.size();
+  Chunks.assign(UseMovz ? Fresh.begin() : Patch.begin(), UseMovz ? Fresh.end() : Patch.end());
+  return UseMovz;
+}
+
+void PartsPassModifierOpt::emitMaterialization(MachineBasicBlock &MBB,
+                                               MachineBasicBlock::iterator InsertPt,
+                                               const ModifierState &S, uint64_t Value,
+                                               const DebugLoc &DL) {
+  SmallVector<unsigned, 4> Chunks;
+  bool UseMovz = planMaterialization(S, Value, Chunks);
+
+  for (auto Chunk : Chunks) {
+    const auto Imm = ModifierState::chunk(Value, Chunk);
+    if (UseMovz) {
+      BuildMI(MBB, InsertPt, DL, TII->get(AArch64::MOVZXi), ModReg)
+          .addImm(Imm)
+          .addImm(16 * Chunk)
+          .setMIFlag(MachineInstr::PartsInstr);
+      UseMovz = false;
+    } else {
+      BuildMI(MBB, InsertPt, DL, TII->get(AArch64::MOVKXi), ModReg)
+          .addReg(ModReg)
+          .addImm(Imm)
+          .addImm(16 * Chunk)
+          .setMIFlag(MachineInstr::PartsInstr);
+    }
+  }
+}
+
+bool PartsPassModifierOpt::optimizeBlock(MachineBasicBlock &MBB) {
+  bool Changed = false;
+  ModifierState S = BlockIn.lookup(&MBB);
+
+  if (S.Top) // Unreachable, leave it alone
+    return false;
+
+  for (auto MII = MBB.begin(); MII != MBB.end();) {
+    if (!isModifierMove(*MII)) {
+      transfer(*MII, S);
+      ++MII;
+      continue;
+    }
+
+    // Collect the whole run of moves into the modifier
+    auto Begin = MII;
+    ModifierState Def = ModifierState::getUnknown();
+    unsigned NumMoves = 0;
+    for (; MII != MBB.end() && isModifierMove(*MII); ++MII, ++NumMoves)
+      transfer(*MII, Def);
+
+    if (!Def.isFullyKnown()) {
+      // A partial update, e.g., of a backward-edge CFI modifier, just keep track of it
+      for (auto I = Begin; I != MII; ++I)
+        transfer(*I, S);
+      continue;
+    }
+
+    SmallVector<unsigned, 4> Chunks;
+    planMaterialization(S, Def.Value, Chunks);
+
+    if (Chunks.size() < NumMoves) {
+      emitMaterialization(MBB, Begin, S, Def.Value, Begin->getDebugLoc());
+
+      if (Chunks.empty())
+        ++NumMaterializationsRemoved;
+      NumMovesRemoved += NumMoves - Chunks.size();
+
+      for (auto I = Begin; I != MII;)
+        (I++)->eraseFromParent();
+      Changed = true;
+    }
+
+    S = ModifierState::getFull(Def.Value);
+  }
+
+  return Changed;
+}
+
+bool PartsPassModifierOpt::runOnMachineFunction(MachineFunction &MF) {
+  if (MF.getFunction().getFnAttribute("no-parts").getValueAsString() == "true")
+    return false;
+
+  DEBUG(dbgs() << getPassName() << ", function " << MF.getName() << '\n');
+
+  const auto &STI = MF.getSubtarget<AArch64Subtarget>();
+  TII = STI.getInstrInfo();
+  TRI = STI.getRegisterInfo();
+  ModReg = PARTS::getModifierReg();
+
+  // Without post-RA instrumentation the modifier register is allocatable and holds ordinary values
+  if (!MF.getRegInfo().isReserved(ModReg))
+    return false;
+
+  bool Changed = false;
+
+  auto &MLI = getAnalysis<MachineLoopInfo>();
+  MBFI = &getAnalysis<MachineBlockFrequencyInfo>();
+  for (auto *L : MLI)
+    Changed |= hoistFromLoop(*L);
+
+  computeBlockStates(MF);
+
+  for (auto &MBB : MF)
+    Changed |= optimizeBlock(MBB);
+
+  return Changed;
+}
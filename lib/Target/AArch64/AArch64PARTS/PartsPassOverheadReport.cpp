@@ -0,0 +1,353 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Estimates the static cost of the PARTS instrumentation without PA-capable
+// hardware. Enabled with -parts-overhead-report=<file>, this pass runs last
+// before emission and writes one YAML document per function with:
+//
+//  * the estimated cycles of the whole function, i.e., the sum of the
+//    scheduling model latencies of its instructions weighted by their block
+//    frequency relative to the function entry,
+//  * the estimated cycles of the instructions added by PARTS, and
+//  * each added instruction with its kind, block, loop depth and cost.
+//
+// The added instructions are those tagged with MachineInstr::PartsInstr when
+// PARTS emitted them: the PA instructions themselves, the modifiers and moves
+// that feed them, the -parts-dummy and -parts-soft-pa replacements, and the
+// -parts-stats counter code. Modifiers of llvm.pa.* intrinsics are selected
+// like any other constant and may be shared with the program, so they are
+// not counted.
+// Compiling the same module without any -parts-* options gives the baseline,
+// whose TotalCycles can be compared with those of the instrumented build.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AArch64.h"
+#include "AArch64Subtarget.h"
+#include "AArch64RegisterInfo.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/TargetSchedule.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+// PARTS includes
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsSoftPa.h"
+#include "PartsUtils.h"
+#include <map>
+
+#define DEBUG_TYPE "aarch64-parts-overhead-report"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+namespace {
+
+struct OverheadInstr {
+  std::string Kind;
+  std::string Opcode;
+  std::string Block;
+  unsigned LoopDepth;
+  unsigned Latency;
+  double Frequency;
+  double Cycles;
+};
+
+struct OverheadKind {
+  std::string Kind;
+  unsigned Count = 0;
+  double Cycles = 0;
+};
+
+struct OverheadFunction {
+  std::string Name;
+  double TotalCycles = 0;
+  double PartsCycles = 0;
+  std::vector<OverheadKind> Kinds;
+  std::vector<OverheadInstr> Instrs;
+};
+
+} // end anonymous namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(OverheadInstr)
+LLVM_YAML_IS_SEQUENCE_VECTOR(OverheadKind)
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<OverheadInstr> {
+  static void mapping(IO &io, OverheadInstr &I) {
+    io.mapRequired("Kind", I.Kind);
+    io.mapRequired("Opcode", I.Opcode);
+    io.mapRequired("Block", I.Block);
+    io.mapRequired("LoopDepth", I.LoopDepth);
+    io.mapRequired("Latency", I.Latency);
+    io.mapRequired("Frequency", I.Frequency);
+    io.mapRequired("Cycles", I.Cycles);
+  }
+};
+
+template <> struct MappingTraits<OverheadKind> {
+  static void mapping(IO &io, OverheadKind &K) {
+    io.mapRequired("Kind", K.Kind);
+    io.mapRequired("Count", K.Count);
+    io.mapRequired("Cycles", K.Cycles);
+  }
+};
+
+template <> struct MappingTraits<OverheadFunction> {
+  static void mapping(IO &io, OverheadFunction &F) {
+    io.mapRequired("Function", F.Name);
+    io.mapRequired("TotalCycles", F.TotalCycles);
+    io.mapRequired("PartsCycles", F.PartsCycles);
+    io.mapRequired("Kinds", F.Kinds);
+    io.mapRequired("Instrs", F.Instrs);
+  }
+};
+
+} // yaml
+} // llvm
+
+// Parallel codegen runs one pass instance per thread, the documents are written to the same file one at a time
+static ManagedStatic<sys::Mutex> ReportLock;
+static bool ReportCreated = false;
+
+namespace {
+ class PartsPassOverheadReport : public MachineFunctionPass {
+
+ public:
+   static char ID;
+
+   PartsPassOverheadReport() :
+       MachineFunctionPass(ID),
+       log(PARTS::PartsLog::getLogger(DEBUG_TYPE))
+   {
+     DEBUG_PA(log->enable());
+   }
+
+   StringRef getPassName() const override { return DEBUG_TYPE; }
+
+   void getAnalysisUsage(AnalysisUsage &AU) const override {
+     AU.addRequired<MachineBlockFrequencyInfo>();
+     AU.addRequired<MachineLoopInfo>();
+     AU.setPreservesAll();
+     MachineFunctionPass::getAnalysisUsage(AU);
+   }
+
+   bool runOnMachineFunction(MachineFunction &) override;
+
+ private:
+
+   PartsLog_ptr log;
+
+   DenseMap<const MachineInstr *, const char *> m_added;
+
+   /*! Record MI as added by PARTS, the first kind found for an instruction is kept */
+   void mark(const MachineInstr &MI, const char *kind) { m_added.insert({ &MI, kind }); }
+
+   void findAdded(const MachineBasicBlock &MBB);
+   /*! Mark an inline -parts-stats-inline counter increment starting at MI, returns false if MI is not one */
+   bool markInlineCounter(const MachineBasicBlock &MBB, const MachineInstr &MI);
+
+   static void write(const OverheadFunction &F);
+ };
+} // end anonymous namespace
+
+FunctionPass *llvm::createPartsPassOverheadReport() {
+  return new PartsPassOverheadReport();
+}
+
+char PartsPassOverheadReport::ID = 0;
+
+static bool isModifierMaterialization(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+    default:
+      return false;
+    case AArch64::MOVZXi:
+    case AArch64::MOVKXi:
+    case AArch64::MOVNXi:
+    case AArch64::ORRXri:
+      return true;
+    case AArch64::ADDXri:
+    case AArch64::SUBXri:
+      // The backward-edge modifier is built on top of SP
+      return MI.getOperand(1).isReg() && MI.getOperand(1).getReg() == AArch64::SP;
+  }
+}
+
+static bool isSoftPaCall(const MachineInstr &MI) {
+  if (MI.getOpcode() != AArch64::BL || !MI.getOperand(0).isGlobal())
+    return false;
+  const auto *callee = dyn_cast<Function>(MI.getOperand(0).getGlobal());
+  return callee != nullptr && PartsSoftPa::getHelperOp(*callee) != PartsSoftPa::NumOps;
+}
+
+static bool isPartsCounterCall(const MachineInstr &MI) {
+  if (MI.getOpcode() != AArch64::BL || !MI.getOperand(0).isGlobal())
+    return false;
+  return MI.getOperand(0).getGlobal()->getName().startswith("__parts_count_");
+}
+
+static bool savesOrRestoresLR(const MachineInstr &MI) {
+  return (MI.getOpcode() == AArch64::STRQpre || MI.getOpcode() == AArch64::LDRQpost) &&
+         MI.getOperand(1).getReg() == AArch64::LR;
+}
+
+static bool isScratchPair(const MachineInstr &MI, unsigned opCode) {
+  return MI.getOpcode() == opCode && MI.getOperand(1).getReg() == AArch64::X16 &&
+         MI.getOperand(2).getReg() == AArch64::X17;
+}
+
+bool PartsPassOverheadReport::markInlineCounter(const MachineBasicBlock &MBB, const MachineInstr &MI) {
+  // stp x16, x17, [sp, #-16]!; adrp x16, __parts_counters; ...; ldp x16, x17, [sp], #16
+  const auto next = std::next(MachineBasicBlock::const_iterator(MI));
+  if (!isScratchPair(MI, AArch64::STPXpre) || next == MBB.end() || next->getOpcode() != AArch64::ADRP ||
+      !next->getOperand(1).isGlobal() || next->getOperand(1).getGlobal() != PartsEventCount::getInlineCounters(
+          *MBB.getParent()->getFunction().getParent()))
+    return false;
+
+  for (auto it = MachineBasicBlock::const_iterator(MI); it != MBB.end(); ++it) {
+    mark(*it, "counter");
+    if (isScratchPair(*it, AArch64::LDPXpost))
+      break;
+  }
+  return true;
+}
+
+void PartsPassOverheadReport::findAdded(const MachineBasicBlock &MBB) {
+  for (auto it = MBB.begin(); it != MBB.end(); ++it) {
+    const auto &MI = *it;
+    // Skip the rest of an inline counter increment, already marked at its start
+    if (!MI.getFlag(MachineInstr::PartsInstr) || m_added.count(&MI) != 0)
+      continue;
+
+    switch (MI.getOpcode()) {
+      default:
+        break;
+      case AArch64::PACIA:
+      case AArch64::PACIB:
+      case AArch64::PACDA:
+      case AArch64::PACDB:
+        mark(MI, "pac");
+        continue;
+      case AArch64::AUTIA:
+      case AArch64::AUTIB:
+      case AArch64::AUTDA:
+      case AArch64::AUTDB:
+        mark(MI, "aut");
+        continue;
+      case AArch64::BLRAA:
+      case AArch64::BLRAB:
+      case AArch64::BRAA:
+      case AArch64::BRAB:
+        mark(MI, "auth-branch");
+        continue;
+      case AArch64::EORXri:
+      case AArch64::EORXrs:
+        // The -parts-dummy stand-ins for the PA instructions
+        mark(MI, "dummy");
+        continue;
+    }
+
+    if (isPartsCounterCall(MI) || savesOrRestoresLR(MI) || markInlineCounter(MBB, MI))
+      mark(MI, "counter");
+    else if (isSoftPaCall(MI))
+      mark(MI, "soft-pa");
+    else if (isModifierMaterialization(MI))
+      mark(MI, "modifier");
+    else
+      mark(MI, "move");
+  }
+}
+
+void PartsPassOverheadReport::write(const OverheadFunction &F) {
+  std::string buffer;
+  raw_string_ostream OS(buffer);
+  yaml::Output yout(OS);
+  yout << const_cast<OverheadFunction &>(F);
+  OS.flush();
+
+  sys::ScopedLock lock(*ReportLock);
+
+  std::error_code EC;
+  raw_fd_ostream out(PARTS::getOverheadReportFile(), EC, ReportCreated ? sys::fs::F_Append : sys::fs::F_None);
+  if (EC)
+    report_fatal_error("cannot open PARTS overhead report '" + PARTS::getOverheadReportFile() + "': " +
+                       EC.message(), false);
+  ReportCreated = true;
+
+  out << buffer;
+}
+
+bool PartsPassOverheadReport::runOnMachineFunction(MachineFunction &MF) {
+  DEBUG(dbgs() << getPassName() << ", function " << MF.getName() << '\n');
+
+  const auto &STI = MF.getSubtarget<AArch64Subtarget>();
+  const auto &MBFI = getAnalysis<MachineBlockFrequencyInfo>();
+  const auto &MLI = getAnalysis<MachineLoopInfo>();
+
+  TargetSchedModel schedModel;
+  schedModel.init(STI.getSchedModel(), &STI, STI.getInstrInfo());
+
+  m_added.clear();
+  for (const auto &MBB : MF)
+    findAdded(MBB);
+
+  OverheadFunction report;
+  report.Name = MF.getName();
+
+  const double entryFreq = MBFI.getEntryFreq();
+  std::map<std::string, OverheadKind> kinds;
+
+  for (const auto &MBB : MF) {
+    const double freq = entryFreq == 0 ? 1.0 : MBFI.getBlockFreq(&MBB).getFrequency() / entryFreq;
+
+    for (const auto &MI : MBB) {
+      if (MI.isMetaInstruction())
+        continue;
+
+      const auto latency = schedModel.computeInstrLatency(&MI);
+      const double cycles = freq * latency;
+      report.TotalCycles += cycles;
+
+      const auto added = m_added.find(&MI);
+      if (added == m_added.end())
+        continue;
+
+      report.PartsCycles += cycles;
+      report.Instrs.push_back({ added->second, STI.getInstrInfo()->getName(MI.getOpcode()),
+                                MBB.getFullName(), MLI.getLoopDepth(&MBB), latency, freq, cycles });
+
+      auto &kind = kinds[added->second];
+      kind.Kind = added->second;
+      kind.Count++;
+      kind.Cycles += cycles;
+    }
+  }
+
+  for (const auto &kind : kinds)
+    report.Kinds.push_back(kind.second);
+
+  log->inc(DEBUG_TYPE ".AddedInstrs", MF.getName(), (unsigned) report.Instrs.size())
+      << "estimated " << (unsigned) report.PartsCycles << " of " << (unsigned) report.TotalCycles
+      << " cycles added by PARTS\n";
+
+  write(report);
+  m_added.clear();
+  return false;
+}
@@ -0,0 +1,413 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PartsTypeInference.h"
+#include "PartsUtils.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineInstr.h"
+#include "llvm/CodeGen/PseudoSourceValue.h"
+#include "llvm/IR/Function.h"
+#include "llvm/PARTS/Parts.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+// Base register keys are tagged so they cannot collide with frame indices
+static constexpr int64_t BaseRegTag = INT64_C(1) << 32;
+
+static bool isStackBase(unsigned Reg) {
+  return Reg == AArch64::SP || Reg == AArch64::FP;
+}
+
+// PartsTypeMetadata is not default constructible, so DenseMap::operator[] is not an option
+template <typename MapT, typename KeyT>
+static void assign(MapT &map, const KeyT &key, const PartsTypeMetadata &PTMD) {
+  const auto it = map.find(key);
+  if (it != map.end())
+    it->second = PTMD;
+  else
+    map.insert({ key, PTMD });
+}
+
+PartsTypeInference::PartsTypeInference(const AArch64InstrInfo *TII, const TargetRegisterInfo *TRI) :
+    log(PartsLog::getLogger("PartsTypeInference")),
+    TII(TII),
+    TRI(TRI)
+{
+  DEBUG_PA(log->enable());
+}
+
+bool PartsTypeInference::State::operator==(const State &o) const {
+  if (Regs.size() != o.Regs.size() || Slots.size() != o.Slots.size())
+    return false;
+
+  for (const auto &R : Regs) {
+    const auto it = o.Regs.find(R.first);
+    if (it == o.Regs.end() || it->second != R.second)
+      return false;
+  }
+  for (const auto &S : Slots) {
+    const auto it = o.Slots.find(S.first);
+    if (it == o.Slots.end() || it->second != S.second)
+      return false;
+  }
+  return true;
+}
+
+void PartsTypeInference::State::meet(const State &o) {
+  SmallVector<unsigned, 8> deadRegs;
+  for (const auto &R : Regs) {
+    const auto it = o.Regs.find(R.first);
+    if (it == o.Regs.end() || it->second != R.second)
+      deadRegs.push_back(R.first);
+  }
+  for (const auto reg : deadRegs)
+    Regs.erase(reg);
+
+  SmallVector<SlotKey, 8> deadSlots;
+  for (const auto &S : Slots) {
+    const auto it = o.Slots.find(S.first);
+    if (it == o.Slots.end() || it->second != S.second)
+      deadSlots.push_back(S.first);
+  }
+  for (const auto &key : deadSlots)
+    Slots.erase(key);
+}
+
+PartsTypeInference::State PartsTypeInference::entryState(const MachineFunction &MF) const {
+  static const unsigned argRegs[] = {
+      AArch64::X0, AArch64::X1, AArch64::X2, AArch64::X3,
+      AArch64::X4, AArch64::X5, AArch64::X6, AArch64::X7
+  };
+
+  State S;
+  unsigned gpr = 0;
+
+  // Seed the pointer arguments, stop at the first argument that is not passed in a single X register
+  for (const auto &Arg : MF.getFunction().args()) {
+    const auto *Ty = Arg.getType();
+
+    if (gpr == array_lengthof(argRegs) || Arg.hasByValAttr() || Arg.hasStructRetAttr())
+      break;
+    if (!Ty->isPointerTy() && !(Ty->isIntegerTy() && Ty->getIntegerBitWidth() <= 64))
+      break;
+
+    if (Ty->isPointerTy())
+      assign(S.Regs, argRegs[gpr], PartsTypeMetadata::get(Ty));
+    gpr++;
+  }
+
+  return S;
+}
+
+void PartsTypeInference::clobberRegister(State &S, unsigned Reg) const {
+  for (MCRegAliasIterator AI(Reg, TRI, true); AI.isValid(); ++AI)
+    S.Regs.erase(*AI);
+
+  if (!isStackBase(Reg))
+    return;
+
+  // Offsets relative to a redefined SP/FP no longer refer to the same slots
+  SmallVector<SlotKey, 8> dead;
+  for (const auto &slot : S.Slots)
+    if (slot.first.first == BaseRegTag + Reg)
+      dead.push_back(slot.first);
+  for (const auto &key : dead)
+    S.Slots.erase(key);
+}
+
+void PartsTypeInference::setRegister(State &S, unsigned Reg, const Optional<PartsTypeMetadata> &PTMD) const {
+  clobberRegister(S, Reg);
+  if (PTMD && PTMD->isKnown())
+    assign(S.Regs, Reg, *PTMD);
+}
+
+void PartsTypeInference::clobberSlots(State &S, const MachineInstr &MI) const {
+  SmallVector<SlotKey, 8> dead;
+  bool hasFrameIndex = false;
+
+  // Frame index based slots written through this instruction
+  for (const auto *MMO : MI.memoperands()) {
+    const auto *PSV = MMO->getPseudoValue();
+    if (!MMO->isStore() || PSV == nullptr || PSV->kind() != PseudoSourceValue::FixedStack)
+      continue;
+
+    const int64_t FI = cast<FixedStackPseudoSourceValue>(PSV)->getFrameIndex();
+    const int64_t begin = MMO->getOffset();
+    const int64_t end = begin + MMO->getSize();
+    hasFrameIndex = true;
+    for (const auto &slot : S.Slots)
+      if (slot.first.first == FI && slot.first.second + 8 > begin && slot.first.second < end)
+        dead.push_back(slot.first);
+  }
+
+  // Base register relative slots written through this instruction
+  unsigned base;
+  int64_t offset;
+  unsigned width;
+  const bool stackBase = TII->getMemOpBaseRegImmOfsWidth(const_cast<MachineInstr &>(MI), base, offset, width, TRI) &&
+                         isStackBase(base);
+  if (stackBase) {
+    for (const auto &slot : S.Slots)
+      if (slot.first.first == BaseRegTag + base &&
+          slot.first.second + 8 > offset && slot.first.second < offset + (int64_t) width)
+        dead.push_back(slot.first);
+  }
+
+  for (const auto &key : dead)
+    S.Slots.erase(key);
+
+  // Without a frame index we cannot tell which other slots the store hits
+  if (!hasFrameIndex)
+    clobberAliasedSlots(S, *MI.getMF(), stackBase ? base : 0);
+}
+
+void PartsTypeInference::clobberAliasedSlots(State &S, const MachineFunction &MF, unsigned stackBase) const {
+  const auto &MFI = MF.getFrameInfo();
+  SmallVector<SlotKey, 8> dead;
+
+  for (const auto &slot : S.Slots) {
+    const auto key = slot.first.first;
+    if (key >= BaseRegTag) {
+      // Offsets from the same base were checked by the caller, offsets from the other one may overlap
+      if (key != BaseRegTag + stackBase)
+        dead.push_back(slot.first);
+    } else if (stackBase != 0 || !MFI.isSpillSlotObjectIndex((int) key)) {
+      // Only spill slots are safe from stores through pointers, their address is never taken
+      dead.push_back(slot.first);
+    }
+  }
+
+  for (const auto &key : dead)
+    S.Slots.erase(key);
+}
+
+bool PartsTypeInference::getSlotAccesses(const MachineInstr &MI, SmallVectorImpl<SlotAccess> &Accesses) const {
+  const auto opCode = MI.getOpcode();
+  int64_t scale = 8;
+  bool postIndexed = false;
+
+  switch (opCode) {
+    default:
+      return false;
+    case AArch64::LDRXui:
+    case AArch64::STRXui:
+    case AArch64::LDPXi:
+    case AArch64::STPXi:
+    case AArch64::LDPXpre:
+    case AArch64::STPXpre:
+      break;
+    case AArch64::LDURXi:
+    case AArch64::STURXi:
+    case AArch64::LDRXpre:
+    case AArch64::STRXpre:
+      scale = 1;
+      break;
+    case AArch64::LDRXpost:
+    case AArch64::STRXpost:
+      scale = 1;
+      postIndexed = true;
+      break;
+    case AArch64::LDPXpost:
+    case AArch64::STPXpost:
+      postIndexed = true;
+      break;
+  }
+
+  const auto numRegs = PartsUtils::getNumDataRegs(opCode);
+  const auto baseIdx = PartsUtils::getBaseOperandIdx(opCode);
+  const auto &baseOp = MI.getOperand(baseIdx);
+  const auto &immOp = MI.getOperand(baseIdx + 1);
+  if (!baseOp.isReg() || !immOp.isImm())
+    return false;
+
+  const int64_t offset = postIndexed ? 0 : immOp.getImm() * scale;
+  const int64_t increment = PartsUtils::isWriteback(opCode) ? immOp.getImm() * scale : 0;
+
+  SlotKey key;
+  bool isStack = true;
+  const auto *MMO = MI.hasOneMemOperand() ? *MI.memoperands_begin() : nullptr;
+  const auto *PSV = MMO != nullptr ? MMO->getPseudoValue() : nullptr;
+
+  if (numRegs == 1 && PSV != nullptr && PSV->kind() == PseudoSourceValue::FixedStack) {
+    key = SlotKey(cast<FixedStackPseudoSourceValue>(PSV)->getFrameIndex(), MMO->getOffset());
+  } else if (isStackBase(baseOp.getReg())) {
+    key = SlotKey(BaseRegTag + baseOp.getReg(), offset);
+  } else {
+    // Not a stack slot, we only track the contents of the stack frame
+    isStack = false;
+  }
+
+  for (unsigned i = 0; i < numRegs; i++)
+    Accesses.push_back({ MI.getOperand(PartsUtils::getDataOperandIdx(opCode, i)).getReg(), isStack,
+                         SlotKey(key.first, key.second + 8 * i), increment });
+
+  return true;
+}
+
+unsigned PartsTypeInference::getMoveSource(const MachineInstr &MI) const {
+  switch (MI.getOpcode()) {
+    default:
+      return 0;
+    case AArch64::ORRXrs:
+      // mov Xd, Xm
+      if (MI.getOperand(1).getReg() == AArch64::XZR && MI.getOperand(3).getImm() == 0)
+        return MI.getOperand(2).getReg();
+      return 0;
+    case AArch64::ADDXri:
+      // mov Xd, Xn (incl. SP)
+      if (MI.getOperand(2).isImm() && MI.getOperand(2).getImm() == 0 && MI.getOperand(3).getImm() == 0)
+        return MI.getOperand(1).getReg();
+      return 0;
+  }
+}
+
+void PartsTypeInference::transfer(State &S, const MachineInstr &MI, bool record) {
+  SmallVector<SlotAccess, 2> accesses;
+  getSlotAccesses(MI, accesses);
+
+  // Gather the facts before the instruction clobbers anything
+  SmallVector<Optional<PartsTypeMetadata>, 2> types;
+  for (unsigned i = 0; i < accesses.size(); i++) {
+    const auto &access = accesses[i];
+    Optional<PartsTypeMetadata> PTMD = PartsUtils::retrieveLaneType(MI, i);
+
+    if (!PTMD) {
+      if (MI.mayStore()) {
+        const auto it = S.Regs.find(access.Reg);
+        if (it != S.Regs.end())
+          PTMD = it->second;
+      } else if (access.IsStack) {
+        const auto it = S.Slots.find(access.Key);
+        if (it != S.Slots.end())
+          PTMD = it->second;
+      }
+    }
+    types.push_back(PTMD);
+  }
+
+  if (record)
+    for (unsigned i = 0; i < accesses.size(); i++)
+      if (types[i])
+        assign(Results, std::make_pair(&MI, i), *types[i]);
+
+  Optional<PartsTypeMetadata> moved;
+  const auto moveSrc = getMoveSource(MI);
+  if (moveSrc != 0) {
+    const auto it = S.Regs.find(moveSrc);
+    if (it != S.Regs.end())
+      moved = it->second;
+  }
+
+  // Apply the clobbers
+  for (const auto &MO : MI.operands()) {
+    if (MO.isRegMask()) {
+      SmallVector<unsigned, 8> dead;
+      for (const auto &R : S.Regs)
+        if (MO.clobbersPhysReg(R.first))
+          dead.push_back(R.first);
+      for (const auto reg : dead)
+        S.Regs.erase(reg);
+    } else if (MO.isReg() && MO.isDef() && MO.getReg() != 0) {
+      clobberRegister(S, MO.getReg());
+    }
+  }
+
+  if (MI.mayStore())
+    clobberSlots(S, MI);
+
+  // The callee may write to any local whose address escaped
+  if (MI.isCall())
+    clobberAliasedSlots(S, *MI.getMF(), 0);
+
+  // And finally the new facts
+  if (moveSrc != 0)
+    setRegister(S, MI.getOperand(0).getReg(), moved);
+
+  for (unsigned i = 0; i < accesses.size(); i++) {
+    if (MI.mayStore()) {
+      if (accesses[i].IsStack && types[i] && types[i]->isKnown()) {
+        auto key = accesses[i].Key;
+        // The writeback dropped the slots relative to the old base, record this one relative to the new base
+        if (key.first >= BaseRegTag)
+          key.second -= accesses[i].BaseIncrement;
+        assign(S.Slots, key, *types[i]);
+      }
+    } else {
+      setRegister(S, accesses[i].Reg, types[i]);
+    }
+  }
+}
+
+void PartsTypeInference::run(MachineFunction &MF) {
+  Results.clear();
+
+  ReversePostOrderTraversal<MachineFunction *> RPOT(&MF);
+  std::vector<Optional<State>> blockOut(MF.getNumBlockIDs());
+
+  auto computeIn = [&](MachineBasicBlock &MBB) {
+    Optional<State> in;
+    if (&MBB == &MF.front())
+      in = entryState(MF);
+
+    // EH pads are entered from the unwinder, assume nothing
+    if (MBB.isEHPad())
+      return State();
+
+    for (auto *pred : MBB.predecessors()) {
+      const auto &predOut = blockOut[pred->getNumber()];
+      // Predecessors that are not yet computed are optimistically skipped, later iterations fix this up
+      if (!predOut)
+        continue;
+      if (!in)
+        in = *predOut;
+      else
+        in->meet(*predOut);
+    }
+    return in ? *in : State();
+  };
+
+  bool changed = true;
+  unsigned iterations = 0;
+  while (changed) {
+    changed = false;
+    iterations++;
+
+    for (auto *MBB : RPOT) {
+      auto S = computeIn(*MBB);
+      for (const auto &MI : MBB->instrs())
+        transfer(S, MI, false);
+
+      auto &out = blockOut[MBB->getNumber()];
+      if (!out || *out != S) {
+        out = std::move(S);
+        changed = true;
+      }
+    }
+  }
+
+  for (auto *MBB : RPOT) {
+    auto S = computeIn(*MBB);
+    for (const auto &MI : MBB->instrs())
+      transfer(S, MI, true);
+  }
+
+  log->inc("PartsTypeInference.Iterations", MF.getName(), iterations);
+  DEBUG_PA(log->debug(MF.getName()) << "inferred " << Results.size() << " load/store types in "
+                                    << iterations << " iterations\n");
+}
+
+PartsTypeMetadata PartsTypeInference::lookup(const MachineInstr &MI, unsigned lane) const {
+  const auto it = Results.find(std::make_pair(&MI, lane));
+  if (it == Results.end())
+    return PartsTypeMetadata::getUnknown();
+  return it->second;
+}
@@ -0,0 +1,98 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PARTSTYPEINFERENCE_H
+#define LLVM_PARTSTYPEINFERENCE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "AArch64InstrInfo.h"
+#include "AArch64RegisterInfo.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/PARTS/PartsLog.h"
+
+namespace llvm {
+
+namespace PARTS {
+
+/*!
+ * Forward dataflow analysis that infers the PartsTypeMetadata of post-RA loads and stores that lack metadata.
+ *
+ * The state tracks the types held in physical registers and in stack slots. Slots are identified by their frame
+ * index when the memory operand has one, and by base register and byte offset otherwise. Control flow joins keep
+ * only facts that agree on all incoming paths, so loops and out-of-layout-order blocks are handled correctly.
+ *
+ * The analysis is computed once per function with run(), after which lookup() is a single map access.
+ */
+class PartsTypeInference {
+public:
+  PartsTypeInference(const AArch64InstrInfo *TII, const TargetRegisterInfo *TRI);
+
+  /*! Compute the inferred types for all loads and stores in MF */
+  void run(MachineFunction &MF);
+
+  /*!
+   * Get the inferred type for a load or store, i.e., the type of the loaded stack slot or of the stored register.
+   * For pairs, lane selects the register. Returns an unknown type if nothing could be inferred.
+   */
+  PartsTypeMetadata lookup(const MachineInstr &MI, unsigned lane = 0) const;
+
+private:
+  /*! (frame index or tagged base register, byte offset) */
+  typedef std::pair<int64_t, int64_t> SlotKey;
+
+  struct State {
+    DenseMap<unsigned, PartsTypeMetadata> Regs;
+    DenseMap<SlotKey, PartsTypeMetadata> Slots;
+
+    bool operator==(const State &o) const;
+    bool operator!=(const State &o) const { return !(*this == o); }
+    /*! Keep only the facts that are equal in both states */
+    void meet(const State &o);
+  };
+
+  struct SlotAccess {
+    unsigned Reg;
+    bool IsStack;
+    SlotKey Key;
+    /*! How much a writeback moves the base register, slots keyed on it shift by the same amount */
+    int64_t BaseIncrement;
+  };
+
+  PartsLog_ptr log;
+  const AArch64InstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+
+  DenseMap<std::pair<const MachineInstr *, unsigned>, PartsTypeMetadata> Results;
+
+  State entryState(const MachineFunction &MF) const;
+  void transfer(State &S, const MachineInstr &MI, bool record);
+  void clobberRegister(State &S, unsigned Reg) const;
+  void clobberSlots(State &S, const MachineInstr &MI) const;
+  /*!
+   * Drop the slots that a store without a frame index may write. stackBase is the SP or FP base of the store, or 0
+   * for a store through any other pointer or a call.
+   */
+  void clobberAliasedSlots(State &S, const MachineFunction &MF, unsigned stackBase) const;
+  void setRegister(State &S, unsigned Reg, const Optional<PartsTypeMetadata> &PTMD) const;
+
+  /*! Decode the 64-bit register accesses of a load or store, incl. pairs and writeback forms */
+  bool getSlotAccesses(const MachineInstr &MI, SmallVectorImpl<SlotAccess> &Accesses) const;
+  /*! Get the register moved by a plain register to register copy, or 0 */
+  unsigned getMoveSource(const MachineInstr &MI) const;
+};
+
+} // PARTS
+
+} // llvm
+
+#endif //LLVM_PARTSTYPEINFERENCE_H
@@ -10,6 +10,11 @@
 
 #include <llvm/IR/Constants.h>
 #include "PartsUtils.h"
+#include "AArch64Subtarget.h"
+#include "Utils/AArch64BaseInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
 
 #include "llvm/PARTS/Parts.h"
 #include "llvm/PARTS/PartsLog.h"
@@ -25,118 +30,12 @@ PartsUtils::PartsUtils(const TargetRegisterInfo *TRI, const TargetInstrInfo *TII
   DEBUG_PA(log->enable());
 };
 
-PartsTypeMetadata_ptr PartsUtils::inferPauthTypeIdStackBackwards(MachineFunction &MF,
-                                                                 MachineBasicBlock &MBB,
-                                                                 MachineInstr &MI, unsigned targetReg,
-                                                                 unsigned reg, int64_t imm) {
-  const auto fName = MF.getName();
-  DEBUG_PA(log->info(fName) << "trying to look for [" << TRI->getName(reg) << ", #" << imm << "]\n");
-
-  auto mbb = MBB.getReverseIterator();
-  auto MIi = MI.getReverseIterator();
-  MIi++;
-
-  while(true) {
-    // FIXME: This is potentially unsafe! iterator might not match execution order!
-
-    while (MIi != mbb->instr_rend()) {
-      if (isStore(*MIi)) {
-        if (MIi->getNumOperands() >= 3) {
-          auto Op1 = MIi->getOperand(1);
-          auto Op2 = MIi->getOperand(2);
-
-          if (Op1.isReg() && Op2.isImm() && Op1.getReg() == reg && Op2.getImm() == imm) {
-            // Found a store targeting the same location!
-            const auto PTMD = PartsTypeMetadata::retrieve(*MIi);
-            log->inc("PartsUtils.BackwardsLookupOk", true, fName) << "found matching store " << PTMD->toString() << "\n";
-            return PTMD;
-          }
-        }
-      }
-
-      MIi++;
-    }
-
-    mbb++;
-
-    if (mbb == MF.rend())
-      break;
-
-    // Do this update there, so we can start the first MBB iteration at MI
-    MIi = mbb->instr_rbegin();
-  }
-
-  log->inc("PartsUtils.BackwardsLookupFail", false, fName) << "failed to infer type_id\n";
-  return PartsTypeMetadata::getUnknown();
-}
-
-
-PartsTypeMetadata_ptr PartsUtils::inferPauthTypeIdRegBackwards(MachineFunction &MF,
-                                                               MachineBasicBlock &MBB,
-                                                               MachineInstr &MI,
-                                                               unsigned targetReg) {
-  const auto fName = MF.getName();
-  auto iter = MI.getIterator();
-
-  DEBUG_PA(log->info(fName) << "trying to look for " << TRI->getName(targetReg) << " load\n");
-
-  // Look through current MBB
-  log->error(fName) << __FUNCTION__ << ": backward MBB lookup UNIMPLEMENTED!!!!\n";
-  while (false && iter != MBB.begin()) {
-    iter--;
-
-    for (unsigned i = 0; i < iter->getNumOperands(); i++) {
-      const MachineOperand &MO = iter->getOperand(i);
-
-      if (MO.isReg()) {
-        if (MO.getReg() == targetReg) {
-          DEBUG_PA(log->info(fName) << "      used in " << TII->getName(iter->getOpcode()) << "\n");
-          // TODO: unimplemented!
-          //llvm_unreachable_internal("unimplemented");
-        }
-      }
-    }
-  }
-
-  // Check if this is the entry block, and if so, look at function arguments
-  if (MF.begin() == MBB.getIterator()) {
-    DEBUG_PA(log->info(fName) << "      trying to look at function args\n");
-    auto *FT = MF.getFunction().getFunctionType();
-    const auto numParams = FT->getNumParams();
-    if (numParams != 0) {
-      unsigned param_i = INT_MAX;
-
-      switch(targetReg) {
-        case AArch64::X0: param_i = 0; break;
-        case AArch64::X1: param_i = 1; break;
-        case AArch64::X2: param_i = 2; break;
-        case AArch64::X3: param_i = 3; break;
-        case AArch64::X4: param_i = 4; break;
-        case AArch64::X5: param_i = 5; break;
-        case AArch64::X6: param_i = 6; break;
-        default: break;
-      }
-
-      if (param_i < numParams) {
-        const auto PTMD = PartsTypeMetadata::get(FT->getParamType(param_i));
-        // TODO: Embedd type_id into instruction
-        log->inc("PartsUtils.ForwardLookupFunc", true, fName) << "      found matching operand(" << param_i <<
-                                                              "), using " << PTMD->toString() << "\n";
-        return PTMD;
-      }
-    }
-  }
-
-  log->inc("PartsUtils.ForwardsLookupFail", false, fName) << "      failed to infer type_id\n";
-  return PartsTypeMetadata::getUnknown();
+void PartsUtils::attach(LLVMContext &C, const PartsTypeMetadata &PTMD, MachineInstr *MI) {
+  MI->addOperand(MachineOperand::CreateMetadata(PTMD.getMDNode(C)));
 }
 
-void PartsUtils::attach(LLVMContext &C, PartsTypeMetadata_ptr PTMD, MachineInstr *MI) {
-  MI->addOperand(MachineOperand::CreateMetadata(PTMD->getMDNode(C)));
-}
-
-void PartsUtils::attach(LLVMContext &C, PartsTypeMetadata_ptr PTMD, MachineInstrBuilder *MIB) {
-  MIB->addMetadata(PTMD->getMDNode(C));
+void PartsUtils::attach(LLVMContext &C, const PartsTypeMetadata &PTMD, MachineInstrBuilder *MIB) {
+  MIB->addMetadata(PTMD.getMDNode(C));
 }
 
 bool PartsUtils::isLoadOrStore(const MachineInstr &MI) {
@@ -157,6 +56,10 @@ bool PartsUtils::isStore(const unsigned opCode) {
     default:
       return false;
     case AArch64::STRWpost:
+    case AArch64::STRXpre:
+    case AArch64::STRXpost:
+    case AArch64::STPXpre:
+    case AArch64::STPXpost:
     case AArch64::STURQi:
     case AArch64::STURXi:
     case AArch64::STURDi:
@@ -196,6 +99,10 @@ bool PartsUtils::isLoad(const unsigned opCode) {
     case AArch64::LDPXi:
     case AArch64::LDPDi:
     case AArch64::LDRWpost:
+    case AArch64::LDRXpre:
+    case AArch64::LDRXpost:
+    case AArch64::LDPXpre:
+    case AArch64::LDPXpost:
     case AArch64::LDURQi:
     case AArch64::LDURXi:
     case AArch64::LDURDi:
@@ -232,6 +139,113 @@ bool PartsUtils::isLoad(const unsigned opCode) {
   }
 }
 
+bool PartsUtils::isWriteback(const unsigned opCode) {
+  switch (opCode) {
+    default:
+      return false;
+    case AArch64::STRWpost:
+    case AArch64::LDRWpost:
+    case AArch64::STRXpre:
+    case AArch64::STRXpost:
+    case AArch64::LDRXpre:
+    case AArch64::LDRXpost:
+    case AArch64::STPXpre:
+    case AArch64::STPXpost:
+    case AArch64::LDPXpre:
+    case AArch64::LDPXpost:
+      return true;
+  }
+}
+
+unsigned PartsUtils::getNumDataRegs(const unsigned opCode) {
+  switch (opCode) {
+    default:
+      return 1;
+    case AArch64::STPQi:
+    case AArch64::STNPQi:
+    case AArch64::STPXi:
+    case AArch64::STPDi:
+    case AArch64::STNPXi:
+    case AArch64::STNPDi:
+    case AArch64::STPWi:
+    case AArch64::STPSi:
+    case AArch64::STNPWi:
+    case AArch64::STNPSi:
+    case AArch64::STPXpre:
+    case AArch64::STPXpost:
+    case AArch64::LDPXi:
+    case AArch64::LDPDi:
+    case AArch64::LDPQi:
+    case AArch64::LDNPQi:
+    case AArch64::LDNPXi:
+    case AArch64::LDNPDi:
+    case AArch64::LDPWi:
+    case AArch64::LDPSi:
+    case AArch64::LDNPWi:
+    case AArch64::LDNPSi:
+    case AArch64::LDPXpre:
+    case AArch64::LDPXpost:
+      return 2;
+  }
+}
+
+unsigned PartsUtils::getDataOperandIdx(const unsigned opCode, const unsigned lane) {
+  assert(lane < getNumDataRegs(opCode));
+  // Writeback variants define the updated base first, e.g., (Rn_wb, Rt, Rt2, Rn, imm)
+  return (isWriteback(opCode) ? 1 : 0) + lane;
+}
+
+unsigned PartsUtils::getBaseOperandIdx(const unsigned opCode) {
+  return (isWriteback(opCode) ? 1 : 0) + getNumDataRegs(opCode);
+}
+
+PartsTypeMetadata_opt PartsUtils::retrieveLaneType(const MachineInstr &MI, const unsigned lane) {
+  const auto numRegs = getNumDataRegs(MI.getOpcode());
+  assert(lane < numRegs);
+
+  if (numRegs == 1)
+    return PartsTypeMetadata::retrieve(MI);
+
+  // A single memory operand covers the whole pair and does not tell us the type of either lane
+  if (MI.memoperands_end() - MI.memoperands_begin() != numRegs)
+    return None;
+
+  const auto *MMO0 = MI.memoperands_begin()[0];
+  const auto *MMO1 = MI.memoperands_begin()[1];
+  const auto type0 = PartsTypeMetadata::retrieve(MMO0->getPartsType());
+  const auto type1 = PartsTypeMetadata::retrieve(MMO1->getPartsType());
+
+  if (!type0 || !type1)
+    return None;
+  if (*type0 == *type1)
+    return type0;
+
+  // Otherwise we need to know which memory operand is at the lower address, i.e., belongs to the first lane
+  if (MMO0->getPseudoValue() != MMO1->getPseudoValue())
+    return None;
+
+  int64_t offset0 = MMO0->getOffset();
+  int64_t offset1 = MMO1->getOffset();
+  if (MMO0->getValue() != MMO1->getValue()) {
+    // The paired accesses usually come from different GEPs, e.g., of two struct fields
+    if (MMO0->getValue() == nullptr || MMO1->getValue() == nullptr)
+      return None;
+
+    const auto &DL = MI.getMF()->getDataLayout();
+    int64_t base0, base1;
+    if (GetPointerBaseWithConstantOffset(MMO0->getValue(), base0, DL) !=
+        GetPointerBaseWithConstantOffset(MMO1->getValue(), base1, DL))
+      return None;
+    offset0 += base0;
+    offset1 += base1;
+  }
+  if (offset0 == offset1)
+    return None;
+
+  const bool swapped = offset0 > offset1;
+  return (lane == 0) != swapped ? type0 : type1;
+}
+
 void PartsUtils::moveTypeIdToReg(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned modReg,
                                  type_id_t type_id, const DebugLoc &DL) {
   moveTypeIdToReg(MBB, (MBB.instr_end() == MIi ? nullptr : &*MIi), modReg, type_id, DL);
@@ -241,26 +255,44 @@ void PartsUtils::moveTypeIdToReg(MachineBasicBlock &MBB, MachineBasicBlock::inst
 
 void PartsUtils::moveTypeIdToReg(MachineBasicBlock &MBB, MachineInstr *MIi, unsigned modReg,
                                  type_id_t type_id, const DebugLoc &DL) {
+  if (TargetRegisterInfo::isVirtualRegister(modReg)) {
+    // Let the pseudo expansion pick the shortest MOVZ/MOVK sequence
+    if (MIi == nullptr)
+      BuildMI(&MBB, DL, TII->get(AArch64::MOVi64imm), modReg).addImm(type_id).setMIFlag(MachineInstr::PartsInstr);
+    else
+      BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVi64imm), modReg).addImm(type_id).setMIFlag(MachineInstr::PartsInstr);
+    return;
+  }
+
   const auto t1 = type_id & UINT16_MAX;
   const auto t2 = (type_id >> 16) & UINT16_MAX;
   const auto t3 = (type_id >> 32) & UINT16_MAX;
   const auto t4 = (type_id >> 48) & UINT16_MAX;
 
   if (MIi == nullptr) {
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(0);
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(16);
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t3).addImm(32);
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t4).addImm(48);
+    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(16)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t3).addImm(32)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t4).addImm(48)
+        .setMIFlag(MachineInstr::PartsInstr);
   } else {
 
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(0);
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(16);
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t3).addImm(32);
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t4).addImm(48);
+    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(16)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t3).addImm(32)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t4).addImm(48)
+        .setMIFlag(MachineInstr::PartsInstr);
   }
 }
 
-void PartsUtils::createBeCfiModifier(MachineBasicBlock &MBB, MachineInstr *MIi, unsigned modReg, const DebugLoc &DL) {
+void PartsUtils::createBeCfiModifier(MachineBasicBlock &MBB, MachineInstr *MIi, unsigned modReg, const DebugLoc &DL,
+                                     int64_t SPOffset) {
   auto &F = MBB.getParent()->getFunction();
   auto type_id = PartsTypeMetadata::idFromType(F.getType());
 
@@ -268,17 +300,20 @@ void PartsUtils::createBeCfiModifier(MachineBasicBlock &MBB, MachineInstr *MIi,
   const auto t1 = ((type_id) % UINT16_MAX);
   const auto t2 = ((type_id << 16) % UINT16_MAX);
 
-  if (MIi == nullptr) {
-    BuildMI(&MBB, DL, TII->get(AArch64::ADDXri), modReg).addReg(AArch64::SP).addImm(0).addImm(0);
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(f1).addImm(16);
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(32);
-    BuildMI(&MBB, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(48);
-  } else {
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::ADDXri), modReg).addReg(AArch64::SP).addImm(0).addImm(0);
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(f1).addImm(16);
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(32);
-    BuildMI(MBB, MIi, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(48);
-  }
+  const auto loc = (MIi == nullptr ? MBB.end() : MachineBasicBlock::iterator(MIi));
+
+  // Only the low 16 bits of SP end up in the modifier, the rest is overwritten below
+  if (SPOffset == 0)
+    BuildMI(MBB, loc, DL, TII->get(AArch64::ADDXri), modReg).addReg(AArch64::SP).addImm(0).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
+  else
+    emitFrameOffset(MBB, loc, DL, modReg, AArch64::SP, (int) SPOffset, TII, MachineInstr::PartsInstr);
+  BuildMI(MBB, loc, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(f1).addImm(16)
+      .setMIFlag(MachineInstr::PartsInstr);
+  BuildMI(MBB, loc, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t1).addImm(32)
+      .setMIFlag(MachineInstr::PartsInstr);
+  BuildMI(MBB, loc, DL, TII->get(AArch64::MOVKXi), modReg).addReg(modReg).addImm(t2).addImm(48)
+      .setMIFlag(MachineInstr::PartsInstr);
 }
 
 void PartsUtils::insertPAInstr(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned ptrReg,
@@ -288,11 +323,14 @@ void PartsUtils::insertPAInstr(MachineBasicBlock &MBB, MachineBasicBlock::instr_
 
 void PartsUtils::insertPAInstr(MachineBasicBlock &MBB, MachineInstr *MIi, unsigned ptrReg,
                                unsigned modReg, const MCInstrDesc &MCID, const DebugLoc &DL) {
+  // The software helpers are calls, which cannot be placed after register allocation. AArch64PassConfig rejects
+  // the soft PA configurations that would need them here.
   if (!PARTS::useDummy()) {
+    assert(!PARTS::useSoftPa() && "soft PA cannot sign after register allocation");
     if (MIi == nullptr) {
-      BuildMI(&MBB, DL, MCID).addReg(ptrReg).addReg(modReg);
+      BuildMI(&MBB, DL, MCID, ptrReg).addReg(modReg).setMIFlag(MachineInstr::PartsInstr);
     } else {
-      BuildMI(MBB, MIi, DL, MCID, ptrReg).addReg(modReg);
+      BuildMI(MBB, MIi, DL, MCID, ptrReg).addReg(modReg).setMIFlag(MachineInstr::PartsInstr);
     }
   } else {
     addNops(MBB, MIi, ptrReg, modReg, DL);
@@ -326,17 +364,99 @@ void PartsUtils::autDataPointer(MachineBasicBlock &MBB, MachineBasicBlock::instr
 
 void PartsUtils::addNops(MachineBasicBlock &MBB, MachineInstr *MI, unsigned ptrReg, unsigned modReg, const DebugLoc &DL) {
   if (MI == nullptr) {
-    BuildMI(&MBB, DL, TII->get(AArch64::EORXri)).addReg(ptrReg).addReg(ptrReg).addImm(17);
-    BuildMI(&MBB, DL, TII->get(AArch64::EORXri)).addReg(ptrReg).addReg(ptrReg).addImm(37);
-    BuildMI(&MBB, DL, TII->get(AArch64::EORXri)).addReg(ptrReg).addReg(ptrReg).addImm(97);
-    BuildMI(&MBB, DL, TII->get(AArch64::EORXrs)).addReg(ptrReg).addReg(ptrReg).addReg(modReg).addImm(0);
+    BuildMI(&MBB, DL, TII->get(AArch64::EORXri)).addReg(ptrReg).addReg(ptrReg).addImm(17)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(&MBB, DL, TII->get(AArch64::EORXri)).addReg(ptrReg).addReg(ptrReg).addImm(37)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(&MBB, DL, TII->get(AArch64::EORXri)).addReg(ptrReg).addReg(ptrReg).addImm(97)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(&MBB, DL, TII->get(AArch64::EORXrs)).addReg(ptrReg).addReg(ptrReg).addReg(modReg).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
   } else {
-    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), ptrReg).addReg(ptrReg).addImm(17);
-    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), ptrReg).addReg(ptrReg).addImm(37);
-    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), ptrReg).addReg(ptrReg).addImm(97);
-    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXrs), ptrReg).addReg(ptrReg).addReg(modReg).addImm(0);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), ptrReg).addReg(ptrReg).addImm(17)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), ptrReg).addReg(ptrReg).addImm(37)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), ptrReg).addReg(ptrReg).addImm(97)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXrs), ptrReg).addReg(ptrReg).addReg(modReg).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
   }
 }
+
+unsigned PartsUtils::addNopsVirt(MachineBasicBlock &MBB, MachineInstr &MI, unsigned ptrReg, unsigned modReg,
+                                 const DebugLoc &DL) {
+  auto &MRI = MBB.getParent()->getRegInfo();
+
+  // EORXri defines a GPR64sp but reads a GPR64, so the chained values must fit both
+  for (const auto imm : { 17, 37, 97 }) {
+    const auto dst = MRI.createVirtualRegister(&AArch64::GPR64commonRegClass);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::EORXri), dst).addReg(ptrReg).addImm(imm).setMIFlag(MachineInstr::PartsInstr);
+    ptrReg = dst;
+  }
+  const auto dst = MRI.createVirtualRegister(&AArch64::GPR64RegClass);
+  BuildMI(MBB, MI, DL, TII->get(AArch64::EORXrs), dst).addReg(ptrReg).addReg(modReg).addImm(0)
+      .setMIFlag(MachineInstr::PartsInstr);
+  return dst;
+}
+
+unsigned PartsUtils::softPaCallVirt(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned ptrReg,
+                                    unsigned modReg, PartsSoftPa::Op op, const DebugLoc &DL) {
+  auto &MF = *MBB.getParent();
+  auto &MRI = MF.getRegInfo();
+  auto &M = *const_cast<Module *>(MF.getFunction().getParent());
+  const auto *mask = TRI->getCallPreservedMask(MF, CallingConv::C);
+
+  const auto helper = M.getFunction(PartsSoftPa::getHelperName(op));
+  assert(helper != nullptr && "soft PA helpers should be created before code generation");
+
+  // The call may land between argument copies and their call, or between a compare and its branch, so any
+  // physical register that is live here and clobbered by the call must be preserved
+  LivePhysRegs liveRegs(*TRI);
+  liveRegs.addLiveOuts(MBB);
+  for (auto I = MBB.instr_end(); I != MIi; )
+    liveRegs.stepBackward(*--I);
+
+  SmallVector<std::pair<unsigned, unsigned>, 8> saved;
+  for (const auto reg : liveRegs) {
+    if (MRI.isReserved(reg) || !MachineOperand::clobbersPhysReg(mask, reg))
+      continue;
+    // Save the widest live register only, this also covers its sub-registers
+    bool superLive = false;
+    for (MCSuperRegIterator super(reg, TRI); super.isValid() && !superLive; ++super)
+      superLive = liveRegs.contains(*super);
+    if (superLive)
+      continue;
+
+    const auto *RC = (reg == AArch64::NZCV ? &AArch64::GPR64RegClass : TRI->getMinimalPhysRegClass(reg));
+    const auto tmp = MRI.createVirtualRegister(RC);
+    BuildMI(MBB, MIi, DL, TII->get(TargetOpcode::COPY), tmp).addReg(reg).setMIFlag(MachineInstr::PartsInstr);
+    saved.push_back({ reg, tmp });
+  }
+
+  // A plain AAPCS64 call, %dst = helper(%ptr, %mod). The helper has no stack arguments, so it does not need a
+  // call frame of its own and can also be placed inside the call sequence of another call.
+  BuildMI(MBB, MIi, DL, TII->get(TargetOpcode::COPY), AArch64::X0).addReg(ptrReg).setMIFlag(MachineInstr::PartsInstr);
+  BuildMI(MBB, MIi, DL, TII->get(TargetOpcode::COPY), AArch64::X1).addReg(modReg).setMIFlag(MachineInstr::PartsInstr);
+  BuildMI(MBB, MIi, DL, TII->get(AArch64::BL))
+      .addGlobalAddress(helper)
+      .addRegMask(mask)
+      .addReg(AArch64::X0, RegState::Implicit)
+      .addReg(AArch64::X1, RegState::Implicit)
+      .addReg(AArch64::X0, RegState::ImplicitDefine)
+      .setMIFlag(MachineInstr::PartsInstr);
+
+  const auto dst = MRI.createVirtualRegister(&AArch64::GPR64RegClass);
+  BuildMI(MBB, MIi, DL, TII->get(TargetOpcode::COPY), dst).addReg(AArch64::X0).setMIFlag(MachineInstr::PartsInstr);
+
+  for (const auto &pair : saved)
+    BuildMI(MBB, MIi, DL, TII->get(TargetOpcode::COPY), pair.first).addReg(pair.second, RegState::Kill)
+        .setMIFlag(MachineInstr::PartsInstr);
+
+  MF.getFrameInfo().setHasCalls(true);
+  return dst;
+}
+
 void PartsUtils::addEventCallFunction(MachineBasicBlock &MBB, MachineInstr &MI,
                                       const DebugLoc &DL, Function *func) {
   if (PARTS::useRuntimeStats()) {
@@ -344,13 +464,88 @@ void PartsUtils::addEventCallFunction(MachineBasicBlock &MBB, MachineInstr &MI,
         .addReg(AArch64::SP, RegState::Define)
         .addReg(AArch64::LR)
         .addReg(AArch64::SP)
-        .addImm(-16);
+        .addImm(-16)
+        .setMIFlag(MachineInstr::PartsInstr);
     BuildMI(MBB, MI, DL, TII->get(AArch64::BL))
-        .addGlobalAddress(func);
+        .addGlobalAddress(func)
+        .setMIFlag(MachineInstr::PartsInstr);
     BuildMI(MBB, MI, DL, TII->get(AArch64::LDRQpost))
         .addReg(AArch64::SP, RegState::Define)
         .addReg(AArch64::LR)
         .addReg(AArch64::SP)
-        .addImm(16);
+        .addImm(16)
+        .setMIFlag(MachineInstr::PartsInstr);
+  }
+}
+
+void PartsUtils::addEventCount(MachineBasicBlock &MBB, MachineInstr &MI, const DebugLoc &DL,
+                               PartsEventCount::EventKind kind) {
+  if (!PARTS::useRuntimeStats())
+    return;
+
+  const auto &F = MBB.getParent()->getFunction();
+  auto &M = *const_cast<Module *>(F.getParent());
+
+  if (!PARTS::useRuntimeStatsInline()) {
+    addEventCallFunction(MBB, MI, DL, PartsEventCount::getCounterFunc(M, kind));
+    return;
   }
+
+  const auto counters = PartsEventCount::getInlineCounters(M);
+  // Functions without a slot are either excluded from PARTS or were created after the counters
+  if (counters == nullptr || !PartsEventCount::hasInlineCounters(F)) {
+    log->inc("PartsUtils.InlineCounterMissing", true, F.getName()) << "no inline counter slot\n";
+    return;
+  }
+
+  addInlineCounterIncrement(MBB, MI, DL, counters, PartsEventCount::getInlineCounterOffset(F, kind));
+}
+
+void PartsUtils::addInlineCounterIncrement(MachineBasicBlock &MBB, MachineInstr &MI, const DebugLoc &DL,
+                                           const GlobalValue *counters, uint64_t offset) {
+  const auto &STI = MBB.getParent()->getSubtarget<AArch64Subtarget>();
+  const auto addr = AArch64::X16;
+  const auto tmp = AArch64::X17;
+
+  // stp x16, x17, [sp, #-16]!
+  // The scratch registers are saved whether or not they hold a value here, hence the undef uses
+  BuildMI(MBB, MI, DL, TII->get(AArch64::STPXpre))
+      .addReg(AArch64::SP, RegState::Define)
+      .addReg(addr, RegState::Undef)
+      .addReg(tmp, RegState::Undef)
+      .addReg(AArch64::SP)
+      .addImm(-2)
+      .setMIFlag(MachineInstr::PartsInstr);
+  // adrp x16, counter; add x16, x16, :lo12:counter
+  BuildMI(MBB, MI, DL, TII->get(AArch64::ADRP), addr)
+      .addGlobalAddress(counters, offset, AArch64II::MO_PAGE)
+      .setMIFlag(MachineInstr::PartsInstr);
+  BuildMI(MBB, MI, DL, TII->get(AArch64::ADDXri), addr)
+      .addReg(addr)
+      .addGlobalAddress(counters, offset, AArch64II::MO_PAGEOFF | AArch64II::MO_NC)
+      .addImm(0)
+      .setMIFlag(MachineInstr::PartsInstr);
+
+  if (STI.hasLSE()) {
+    // mov x17, #1; stadd x17, [x16]
+    BuildMI(MBB, MI, DL, TII->get(AArch64::MOVZXi), tmp).addImm(1).addImm(0).setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::LDADDX), AArch64::XZR).addReg(tmp).addReg(addr)
+        .setMIFlag(MachineInstr::PartsInstr);
+  } else {
+    // ldr x17, [x16]; add x17, x17, #1; str x17, [x16]
+    BuildMI(MBB, MI, DL, TII->get(AArch64::LDRXui), tmp).addReg(addr).addImm(0).setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::ADDXri), tmp).addReg(tmp).addImm(1).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
+    BuildMI(MBB, MI, DL, TII->get(AArch64::STRXui)).addReg(tmp).addReg(addr).addImm(0)
+        .setMIFlag(MachineInstr::PartsInstr);
+  }
+
+  // ldp x16, x17, [sp], #16
+  BuildMI(MBB, MI, DL, TII->get(AArch64::LDPXpost))
+      .addReg(AArch64::SP, RegState::Define)
+      .addReg(addr, RegState::Define)
+      .addReg(tmp, RegState::Define)
+      .addReg(AArch64::SP)
+      .addImm(2)
+      .setMIFlag(MachineInstr::PartsInstr);
 }
@@ -13,11 +13,14 @@
 
 #include <memory>
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "AArch64.h"
 #include "AArch64RegisterInfo.h"
 #include "AArch64InstrInfo.h"
 #include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/PARTS/PartsEventCount.h"
 #include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsSoftPa.h"
 
 namespace llvm {
 
@@ -29,6 +32,17 @@ typedef std::shared_ptr<PartsUtils> PartsUtils_ptr;
 
 static inline unsigned getModifierReg() { return AArch64::X23; }
 
+/*!
+ * Get a register for a PA modifier. Before register allocation this is a fresh virtual register that the
+ * allocator is free to place, afterwards it falls back to the reserved modifier register. The virtual register
+ * excludes both XZR and SP, so it is valid as the modifier of the PA pseudos and of BLRAA alike.
+ */
+static inline unsigned getModifierReg(MachineFunction &MF) {
+  if (MF.getProperties().hasProperty(MachineFunctionProperties::Property::NoVRegs))
+    return getModifierReg();
+  return MF.getRegInfo().createVirtualRegister(&AArch64::GPR64commonRegClass);
+}
+
 class PartsUtils {
   PartsLog_ptr log;
 
@@ -48,19 +62,9 @@ public:
 
   inline bool checkIfRegInstrumentable(unsigned reg);
 
-  PartsTypeMetadata_ptr inferPauthTypeIdRegBackwards(MachineFunction &MF,
-                                                     MachineBasicBlock &MBB,
-                                                     MachineInstr &MI,
-                                                     unsigned targetReg);
-
-  PartsTypeMetadata_ptr inferPauthTypeIdStackBackwards(MachineFunction &MF,
-                                                       MachineBasicBlock &MBB,
-                                                       MachineInstr &MI,
-                                                       unsigned targetReg, unsigned reg, int64_t imm);
+  void attach(LLVMContext &C, const PartsTypeMetadata &PTMD, MachineInstr *MI);
 
-  void attach(LLVMContext &C, PartsTypeMetadata_ptr PTMD, MachineInstr *MI);
-
-  void attach(LLVMContext &C, PartsTypeMetadata_ptr PTMD, MachineInstrBuilder *MIB);
+  void attach(LLVMContext &C, const PartsTypeMetadata &PTMD, MachineInstrBuilder *MIB);
 
   void pacCodePointer(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned dstReg,
                       unsigned srcReg, unsigned modReg, type_id_t type_id, const DebugLoc &DL);
@@ -87,13 +91,36 @@ public:
 
   bool isStore(unsigned opCode);
 
+  /*! Check if a load or store also writes the updated address back to its base register */
+  static bool isWriteback(unsigned opCode);
+
+  /*! Get the number of registers moved by a load or store, i.e., two for pairs and one otherwise */
+  static unsigned getNumDataRegs(unsigned opCode);
+
+  /*! Get the operand index of the lane:th register moved by a load or store */
+  static unsigned getDataOperandIdx(unsigned opCode, unsigned lane);
+
+  /*! Get the operand index of the base register of a load or store */
+  static unsigned getBaseOperandIdx(unsigned opCode);
+
+  /*!
+   * Get the type of the lane:th register moved by a load or store, as given by a metadata operand or the memory
+   * operands. Pairs merged by the load/store optimizer carry one memory operand per lane, in no particular order.
+   */
+  static PartsTypeMetadata_opt retrieveLaneType(const MachineInstr &MI, unsigned lane);
+
   void moveTypeIdToReg(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned modReg,
                        type_id_t type_id, const DebugLoc &DL);
 
   void moveTypeIdToReg(MachineBasicBlock &MBB, MachineInstr *MI, unsigned modReg,
                        type_id_t type_id, const DebugLoc &DL);
 
-  void createBeCfiModifier(MachineBasicBlock &MBB, MachineInstr *MIi, unsigned modReg, const DebugLoc &DL);
+  /*!
+   * Create the backward-edge modifier from the function type and SP. SPOffset is added to the current SP, so that
+   * epilogues can recreate the modifier of the function entry.
+   */
+  void createBeCfiModifier(MachineBasicBlock &MBB, MachineInstr *MIi, unsigned modReg, const DebugLoc &DL,
+                           int64_t SPOffset = 0);
 
   void insertPAInstr(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned ptrReg,
                      unsigned modReg, const MCInstrDesc &MCID, const DebugLoc &DL);
@@ -103,11 +130,36 @@ public:
 
   void addNops(MachineBasicBlock &MBB, MachineInstr *MI, unsigned ptrReg, unsigned modReg, const DebugLoc &DL);
 
+  /*!
+   * SSA variant of addNops, returns the virtual register holding the resulting pointer.
+   */
+  unsigned addNopsVirt(MachineBasicBlock &MBB, MachineInstr &MI, unsigned ptrReg, unsigned modReg,
+                       const DebugLoc &DL);
+
+  /*!
+   * SSA variant of a PA instruction for -parts-soft-pa, calls the software PA helper before MIi and returns the
+   * virtual register holding the resulting pointer. Live physical registers, including NZCV, are preserved.
+   */
+  unsigned softPaCallVirt(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned ptrReg,
+                          unsigned modReg, PartsSoftPa::Op op, const DebugLoc &DL);
+
   void insertPAInstr(MachineBasicBlock &MBB, MachineBasicBlock::instr_iterator MIi, unsigned srcReg,
                      unsigned dstReg, unsigned modReg, const MCInstrDesc &MCID, const DebugLoc &DL);
 
   void addEventCallFunction(MachineBasicBlock &MBB, MachineInstr &MI,
                                    const DebugLoc &DL, Function *func);
+
+  /*!
+   * Count a runtime event before MI when -parts-stats is enabled, either by calling the __parts_count_* function
+   * or, with -parts-stats-inline, by incrementing the function's counter in the inline counter array.
+   */
+  void addEventCount(MachineBasicBlock &MBB, MachineInstr &MI, const DebugLoc &DL,
+                     PartsEventCount::EventKind kind);
+
+private:
+  /*! Increment the i64 at counters+offset, preserving all registers and flags */
+  void addInlineCounterIncrement(MachineBasicBlock &MBB, MachineInstr &MI, const DebugLoc &DL,
+                                 const GlobalValue *counters, uint64_t offset);
 };
 
 inline bool PartsUtils::registerFitsPointer(unsigned reg)
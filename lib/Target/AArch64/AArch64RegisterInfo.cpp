@@ -135,8 +135,9 @@ AArch64RegisterInfo::getReservedRegs(const MachineFunction &MF) const {
 
   assert(checkAllSuperRegsMarked(Reserved));
 
-  // pauth: Reserve register for PA modifier
-  markSuperRegs(Reserved, Pauth_ModifierReg);
+  // pauth: Reserve register for PA modifier used by post-RA instrumentation
+  if (PARTS::needsModifierReg())
+    markSuperRegs(Reserved, Pauth_ModifierReg);
 
   return Reserved;
 }
@@ -47,6 +47,14 @@ static cl::opt<bool>
                    cl::desc("Call nonlazybind functions via direct GOT load"),
                    cl::init(false), cl::Hidden);
 
+// Overrides the PAC/AUT latency of the scheduling model, e.g., to evaluate
+// the instrumentation on cores not yet modelled.
+static cl::opt<unsigned>
+    PAuthLatency("aarch64-pauth-latency",
+                 cl::desc("Latency of pointer authentication instructions, "
+                          "overriding the scheduling model"),
+                 cl::Hidden);
+
 AArch64Subtarget &
 AArch64Subtarget::initializeSubtargetDependencies(StringRef FS,
                                                   StringRef CPUString) {
@@ -232,6 +240,16 @@ void AArch64Subtarget::overrideSchedPolicy(MachineSchedPolicy &Policy,
   Policy.DisableLatencyHeuristic = DisableLatencySchedHeuristic;
 }
 
+void AArch64Subtarget::adjustSchedDependency(SUnit *Def, SUnit *Use,
+                                             SDep &Dep) const {
+  if (PAuthLatency.getNumOccurrences() == 0 || Dep.getKind() != SDep::Data ||
+      !Def->isInstr() || !AArch64InstrInfo::isPAuthInst(*Def->getInstr()))
+    return;
+
+  Def->Latency = PAuthLatency;
+  Dep.setLatency(PAuthLatency);
+}
+
 bool AArch64Subtarget::enableEarlyIfConversion() const {
   return EnableEarlyIfConvert;
 }
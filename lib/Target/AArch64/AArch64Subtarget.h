@@ -312,6 +312,9 @@ public:
   void overrideSchedPolicy(MachineSchedPolicy &Policy,
                            unsigned NumRegionInstrs) const override;
 
+  void adjustSchedDependency(SUnit *Def, SUnit *Use,
+                             SDep &Dep) const override;
+
   bool enableEarlyIfConversion() const override;
 
   std::unique_ptr<PBQPRAConstraint> getCustomPBQPConstraints() const override;
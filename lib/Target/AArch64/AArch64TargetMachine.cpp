@@ -165,6 +165,9 @@ extern "C" void LLVMInitializeAArch64Target() {
   initializeFalkorHWPFFixPass(*PR);
   initializeFalkorMarkStridedAccessesLegacyPass(*PR);
   initializeLDTLSCleanupPass(*PR);
+  initializePartsPassDpiPass(*PR);
+  initializePartsPassDpiPreRAPass(*PR);
+  initializePartsPassModifierOptPass(*PR);
 }
 
 //===----------------------------------------------------------------------===//
@@ -297,6 +300,15 @@ public:
       : TargetPassConfig(TM, PM) {
     if (TM.getOptLevel() != CodeGenOpt::None)
       substitutePass(&PostRASchedulerID, &PostMachineSchedulerID);
+
+    // The soft PA helpers are calls, which cannot be inserted after register
+    // allocation where BeCFI and the post-RA DPI pass sign their pointers.
+    if (PARTS::useSoftPa() && !PARTS::useDummy()) {
+      if (PARTS::useBeCfi())
+        report_fatal_error("-parts-soft-pa does not support -parts-becfi");
+      if (PARTS::useDpi() && !PARTS::useDpiPreRA())
+        report_fatal_error("-parts-soft-pa requires -parts-dpi-prera for -parts-dpi");
+    }
   }
 
   AArch64TargetMachine &getAArch64TargetMachine() const {
@@ -357,6 +369,11 @@ TargetPassConfig *AArch64TargetMachine::createPassConfig(PassManagerBase &PM) {
 }
 
 void AArch64PassConfig::addIRPasses() {
+  // The inline counters, their constructor and the soft PA helpers must exist
+  // before any function is selected, so that they are compiled with the module.
+  if (PARTS::useAny() && (PARTS::useRuntimeStatsInline() || PARTS::useSoftPa()))
+    addPass(createPartsPassEventCounters());
+
   // Always expand atomic operations, we don't deal with atomicrmw or cmpxchg
   // ourselves.
   addPass(createAtomicExpandPass());
@@ -489,6 +506,13 @@ void AArch64PassConfig::addPreRegAlloc() {
     // be register coaleascer friendly.
     addPass(&PeepholeOptimizerID);
   }
+
+  // PARTS forward-edge CFI uses a virtual modifier register, so it must run before register allocation
+  if (PARTS::useFeCfi())
+    addPass(createPartsPassCpi());
+  // Emit DPI as PA pseudos in SSA form so that the MachineScheduler can hide the PA latency
+  if (PARTS::useDpi() && PARTS::useDpiPreRA())
+    addPass(createPartsPassDpiPreRA());
 }
 
 void AArch64PassConfig::addPostRegAlloc() {
@@ -528,9 +552,13 @@ void AArch64PassConfig::addPreEmitPass() {
   if (PARTS::useAny()) {
     addPass(createPartsPassIntrinsics());
 
-    if (PARTS::useDpi())
+    if (PARTS::useDpi() && !PARTS::useDpiPreRA())
       addPass(createPartsPassDpi());
-    if (PARTS::useFeCfi())
-      addPass(createPartsPassCpi());
+    if (PARTS::useModifierOpt())
+      addPass(createPartsPassModifierOpt());
   }
+
+  // Also without PARTS, the uninstrumented report is the baseline for the overhead estimate
+  if (PARTS::useOverheadReport())
+    addPass(createPartsPassOverheadReport());
 }
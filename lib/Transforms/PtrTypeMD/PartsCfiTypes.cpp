@@ -0,0 +1,89 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Records the type_ids of all indirect calls in the module. Code pointers of
+// any other type are never authenticated, so PartsCpi and PauthMarkGlobals
+// can skip PACing them.
+//
+// Only run this on the whole program during full LTO, and directly before
+// PartsCpi, so that no later optimization changes the type of an indirect call.
+// A full LTO module is not necessarily the whole program, e.g., its code
+// pointers can be passed to a separately built library, so this is only done
+// with -parts-whole-program.
+//
+//===----------------------------------------------------------------------===//
+
+#include <set>
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
+#include "PartsPasses.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+#define DEBUG_TYPE "PartsCfiTypes"
+
+STATISTIC(NumCalledTypes, "Number of distinct type_ids called indirectly");
+
+namespace {
+
+struct PartsCfiTypes : public ModulePass {
+  static char ID;
+
+  PartsLog_ptr log;
+
+  PartsCfiTypes() : ModulePass(ID), log(PartsLog::getLogger(DEBUG_TYPE))
+  {
+    DEBUG_PA(log->enable());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // anonymous namespace
+
+char PartsCfiTypes::ID = 0;
+static RegisterPass<PartsCfiTypes> X("parts-cfi-types", "PARTS whole-program indirect call types");
+
+ModulePass *llvm::PARTS::createPartsCfiTypesPass() {
+  return new PartsCfiTypes();
+}
+
+bool PartsCfiTypes::runOnModule(Module &M) {
+  if (!PARTS::useFeCfi() || !PARTS::useWholeProgram())
+    return false;
+
+  std::set<type_id_t> type_ids;
+
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        CallSite CS(&I);
+        // Be conservative and include anything PartsCpi might instrument, even calls of constant expressions
+        if (!CS || CS.isInlineAsm() || CS.getCalledFunction() != nullptr)
+          continue;
+
+        type_ids.insert(PartsTypeMetadata::idFromType(CS.getCalledValue()->getType()));
+      }
+    }
+  }
+
+  NumCalledTypes += type_ids.size();
+  log->inc(DEBUG_TYPE ".CalledTypes", (unsigned) type_ids.size()) << "found " << (unsigned) type_ids.size()
+                                                                  << " indirectly called type_ids\n";
+
+  PartsTypeMetadata::setIndirectlyCalledIds(M, type_ids);
+  return true;
+}
@@ -9,18 +9,19 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include <llvm/PARTS/PartsIntr.h>
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/PARTS/PartsTypeMetadata.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/PARTS/Parts.h"
 #include "llvm/PARTS/PartsLog.h"
+#include "PartsPasses.h"
 
 using namespace llvm;
 using namespace llvm::PARTS;
@@ -40,12 +41,29 @@ struct PartsCpi : public FunctionPass {
   }
 
   bool runOnFunction(Function &F) override;
+  bool doFinalization(Module &M) override;
 
-  PartsTypeMetadata_ptr createCallMetadata(Function &F, Instruction &I);
+  PartsTypeMetadata createCallMetadata(Function &F, Instruction &I);
   void fixDirectFunctionArgs(Function &F, Instruction &I);
 
+  /*! Sign the function pointer V before I. The call is built here rather
+   * than with PartsIntr, which is not linked into the tools loading this
+   * plugin in a static build.
+   */
+  inline Value *pacCodePointer(Instruction &I, Value *V) {
+    Type *arg_types[] = { V->getType() };
+    auto pacIntr = Intrinsic::getDeclaration(I.getModule(), Intrinsic::pa_pacia, arg_types);
+    auto typeId = PartsTypeMetadata::get(V->getType()).getTypeIdConstant(I.getContext());
+    return IRBuilder<>(&I).CreateCall(pacIntr, { V, typeId });
+  }
+
   inline void replaceDirectFuncOperand(Function &F, Instruction &I, Value *O, CallInst *CI, unsigned i) {
-    auto paced_arg = PartsIntr::pac_pointer(F, I, O);
+    if (!PartsTypeMetadata::needsCodePointerPac(*F.getParent(), PartsTypeMetadata::idFromType(O->getType()))) {
+      log->inc(DEBUG_TYPE ".FunctionArgNeverCalled", true, F.getName()) << "not PACing function argument, its type is never called indirectly\n";
+      return;
+    }
+
+    auto paced_arg = pacCodePointer(I, O);
     CI->setOperand(i, paced_arg);
   }
 };
@@ -55,6 +73,10 @@ struct PartsCpi : public FunctionPass {
 char PartsCpi::ID = 0;
 static RegisterPass<PartsCpi> X("parts-fecfi-pass", "PARTS CFI pass");
 
+FunctionPass *llvm::PARTS::createPartsCpiPass() {
+  return new PartsCpi();
+}
+
 bool PartsCpi::runOnFunction(Function &F) {
   if (!PARTS::useFeCfi())
     return false;
@@ -67,7 +89,7 @@ bool PartsCpi::runOnFunction(Function &F) {
 
       const auto IOpcode = I.getOpcode();
 
-      PartsTypeMetadata_ptr MD = nullptr;
+      PartsTypeMetadata_opt MD;
 
       switch(IOpcode) {
         default:
@@ -80,10 +102,15 @@ bool PartsCpi::runOnFunction(Function &F) {
           auto VO = SI->getValueOperand();
           MD = PartsTypeMetadata::get(PO->getType());
 
+          if (isa<Function>(VO) && !PartsTypeMetadata::needsCodePointerPac(*F.getParent(), PartsTypeMetadata::idFromType(VO->getType()))) {
+            log->inc(DEBUG_TYPE ".StoreFunctionNeverCalled", true, F.getName()) << "ignoring store of function address, its type is never called indirectly\n";
+            break;
+          }
+
           if (isa<Function>(VO)) {
             log->inc(DEBUG_TYPE ".StoreFunction", true, F.getName()) << "PACing store of function address\n";
 
-            auto paced_arg = PartsIntr::pac_pointer(F, I, VO);
+            auto paced_arg = pacCodePointer(I, VO);
             SI->setOperand(0, paced_arg);
 
             break;
@@ -105,9 +132,9 @@ bool PartsCpi::runOnFunction(Function &F) {
 
           MD = createCallMetadata(F, I);
 
-          if (MD != nullptr) {
+          if (MD) {
             MD->attach(C, I);
-            log->inc(DEBUG_TYPE ".MetadataAdded", !MD->isIgnored()) << "adding metadata: " << MD->toString() << "\n";
+            log->inc(DEBUG_TYPE ".MetadataAdded", !MD->isIgnored()) << "adding metadata: " << *MD << "\n";
           } else {
             log->inc(DEBUG_TYPE ".MetadataMissing") << "missing metadata\n";
           }
@@ -139,6 +166,11 @@ bool PartsCpi::runOnFunction(Function &F) {
   return true;
 }
 
+bool PartsCpi::doFinalization(Module &M) {
+  PartsTypeMetadata::releaseTypeIdCache(M.getContext());
+  return false;
+}
+
 void PartsCpi::fixDirectFunctionArgs(Function &F, Instruction &I) {
   if (!PARTS::useFeCfi())
     return;
@@ -172,19 +204,25 @@ void PartsCpi::fixDirectFunctionArgs(Function &F, Instruction &I) {
   }
 }
 
-PartsTypeMetadata_ptr PartsCpi::createCallMetadata(Function &F, Instruction &I) {
+PartsTypeMetadata PartsCpi::createCallMetadata(Function &F, Instruction &I) {
   assert(isa<CallInst>(I));
 
-  PartsTypeMetadata_ptr MD;
-
   auto CI = dyn_cast<CallInst>(&I);
 
   if (CI->getCalledFunction() == nullptr) {
+    auto *callee = CI->getCalledValue();
+
+    // The pointer was already authenticated, e.g., by PartsIcp, so a plain branch will do
+    if (auto *II = dyn_cast<IntrinsicInst>(callee->stripPointerCasts())) {
+      if (II->getIntrinsicID() == Intrinsic::pa_autia) {
+        log->inc(DEBUG_TYPE ".AuthenticatedCall", true, F.getName()) << "      found call of authenticated pointer\n";
+        return PartsTypeMetadata::getIgnored();
+      }
+    }
+
     log->inc(DEBUG_TYPE ".IndirectCallMetadataFound", true, F.getName()) << "      found indirect call!!!!\n";
-    MD = PartsTypeMetadata::get(I.getOperand(0)->getType());
-  } else {
-    MD = PartsTypeMetadata::getIgnored();
+    return PartsTypeMetadata::get(callee->getType());
   }
 
-  return MD;
+  return PartsTypeMetadata::getIgnored();
 }
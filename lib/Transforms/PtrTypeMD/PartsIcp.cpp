@@ -0,0 +1,175 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Promotes indirect calls to direct calls when the whole program contains at
+// most two address-taken functions of the called type. The call pointer is
+// authenticated once and compared against the raw function addresses:
+//
+//   %auth = autia(%fp, type_id)
+//   if (%auth == @f1) call @f1 else if (%auth == @f2) call @f2 else call %auth
+//
+// The remaining indirect call goes through the already authenticated pointer,
+// so PartsCpi leaves it alone. A pointer that fails authentication never
+// matches a candidate and faults on the fallback call, like an authenticated
+// branch would.
+//
+// This is only meaningful during full LTO, where all address-taken functions
+// of the module are all address-taken functions of the program.
+//
+//===----------------------------------------------------------------------===//
+
+#include <map>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Transforms/Utils/CallPromotionUtils.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
+#include "PartsPasses.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+#define DEBUG_TYPE "PartsIcp"
+
+STATISTIC(NumPromotedCalls, "Number of indirect calls promoted to direct calls");
+STATISTIC(NumPromotedTargets, "Number of direct call targets added by indirect call promotion");
+
+namespace {
+
+struct PartsIcp : public ModulePass {
+  static char ID;
+
+  /*! Calls with more possible targets are left as they are */
+  static constexpr unsigned MaxTargets = 2;
+
+  PartsLog_ptr log;
+
+  PartsIcp() : ModulePass(ID), log(PartsLog::getLogger(DEBUG_TYPE))
+  {
+    DEBUG_PA(log->enable());
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  /*! Address-taken functions by the type_id of their pointer, buckets are only filled up to MaxTargets + 1 */
+  std::map<type_id_t, SmallVector<Function *, MaxTargets + 1>> m_targets;
+
+  void collectTargets(Module &M);
+  bool promote(Module &M, CallSite CS);
+};
+
+} // anonymous namespace
+
+char PartsIcp::ID = 0;
+static RegisterPass<PartsIcp> X("parts-icp-pass", "PARTS whole-program indirect call promotion");
+
+ModulePass *llvm::PARTS::createPartsIcpPass() {
+  return new PartsIcp();
+}
+
+bool PartsIcp::runOnModule(Module &M) {
+  if (!PARTS::useFeCfi() || !PARTS::useIcp() || skipModule(M))
+    return false;
+
+  collectTargets(M);
+
+  // Collect first, promotion splits blocks and adds new calls
+  std::vector<CallSite> calls;
+  for (auto &F : M) {
+    if (F.hasFnAttribute("no-parts"))
+      continue;
+
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        CallSite CS(&I);
+        if (CS && !CS.isInlineAsm() && !isa<Constant>(CS.getCalledValue()->stripPointerCasts()))
+          calls.push_back(CS);
+      }
+    }
+  }
+
+  bool changed = false;
+  for (auto CS : calls)
+    changed |= promote(M, CS);
+
+  m_targets.clear();
+  PartsTypeMetadata::releaseTypeIdCache(M.getContext());
+  return changed;
+}
+
+void PartsIcp::collectTargets(Module &M) {
+  m_targets.clear();
+
+  for (auto &F : M) {
+    if (F.isIntrinsic() || !F.hasAddressTaken())
+      continue;
+
+    auto &bucket = m_targets[PartsTypeMetadata::idFromType(F.getType())];
+    if (bucket.size() <= MaxTargets)
+      bucket.push_back(&F);
+  }
+}
+
+bool PartsIcp::promote(Module &M, CallSite CS) {
+  auto *I = CS.getInstruction();
+  auto *F = I->getFunction();
+  const auto PTMD = PartsTypeMetadata::get(CS.getCalledValue()->getType());
+
+  if (CS.isMustTailCall() || CS.hasOperandBundles()) {
+    log->inc(DEBUG_TYPE ".Unsupported", true, F->getName()) << "cannot promote " << *I << "\n";
+    return false;
+  }
+
+  auto found = m_targets.find(PTMD.getTypeId());
+  if (found == m_targets.end()) {
+    // The pointer can only come from outside of the program, e.g., from a shared library
+    log->inc(DEBUG_TYPE ".NoTargets", true, F->getName()) << "not promoting " << *I << "\n";
+    return false;
+  }
+  if (found->second.size() > MaxTargets) {
+    log->inc(DEBUG_TYPE ".TooManyTargets", true, F->getName()) << "not promoting " << *I << "\n";
+    return false;
+  }
+
+  auto &targets = found->second;
+  for (auto *target : targets) {
+    // A type_id collision could group functions of different types
+    if (target->getFunctionType() != CS.getFunctionType() || !isLegalToPromote(CS, target)) {
+      log->inc(DEBUG_TYPE ".TypeMismatch", true, F->getName()) << "not promoting " << *I << "\n";
+      return false;
+    }
+  }
+
+  // Authenticate once up front, the fallback then calls the authenticated pointer
+  auto calledValue = CS.getCalledValue();
+  Type *arg_types[] = { calledValue->getType() };
+  auto autIntr = Intrinsic::getDeclaration(&M, Intrinsic::pa_autia, arg_types);
+  IRBuilder<> Builder(I);
+  CS.setCalledFunction(Builder.CreateCall(autIntr, { calledValue, PTMD.getTypeIdConstant(M.getContext()) }));
+
+  for (auto *target : targets) {
+    promoteCallWithIfThenElse(CS, target);
+    ++NumPromotedTargets;
+  }
+
+  ++NumPromotedCalls;
+  log->inc(DEBUG_TYPE ".Promoted", true, F->getName()) << "promoted " << *I << " to "
+                                                       << (unsigned) targets.size() << " direct calls\n";
+  return true;
+}
@@ -0,0 +1,110 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Replaces the pa_* intrinsics with calls to the software PA helpers, see
+// PartsSoftPa.h. This lets the IR-level instrumentation run on targets, and
+// cores, without pointer authentication.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsSoftPa.h"
+#include "PartsPasses.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+#define DEBUG_TYPE "PartsLowerSoftPa"
+
+STATISTIC(NumSoftPaCalls, "Number of pa_* intrinsics replaced by software PA calls");
+
+namespace {
+
+struct PartsLowerSoftPa : public ModulePass {
+  static char ID;
+
+  PartsLog_ptr log;
+
+  PartsLowerSoftPa() : ModulePass(ID), log(PartsLog::getLogger(DEBUG_TYPE))
+  {
+    DEBUG_PA(log->enable());
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  static PartsSoftPa::Op getOp(Intrinsic::ID ID);
+};
+
+} // anonymous namespace
+
+char PartsLowerSoftPa::ID = 0;
+static RegisterPass<PartsLowerSoftPa> X("parts-lower-soft-pa", "PARTS software PA lowering");
+
+ModulePass *llvm::PARTS::createPartsLowerSoftPaPass() {
+  return new PartsLowerSoftPa();
+}
+
+PartsSoftPa::Op PartsLowerSoftPa::getOp(Intrinsic::ID ID) {
+  switch (ID) {
+    default:
+      return PartsSoftPa::NumOps;
+    case Intrinsic::pa_pacia:
+      return PartsSoftPa::PACIA;
+    case Intrinsic::pa_pacda:
+      return PartsSoftPa::PACDA;
+    case Intrinsic::pa_autia:
+      return PartsSoftPa::AUTIA;
+    case Intrinsic::pa_autda:
+      return PartsSoftPa::AUTDA;
+  }
+}
+
+bool PartsLowerSoftPa::runOnModule(Module &M) {
+  SmallVector<IntrinsicInst *, 64> calls;
+
+  for (auto &F : M) {
+    if (getOp(F.getIntrinsicID()) == PartsSoftPa::NumOps)
+      continue;
+
+    for (auto *U : F.users()) {
+      if (auto *II = dyn_cast<IntrinsicInst>(U))
+        calls.push_back(II);
+    }
+  }
+
+  if (calls.empty())
+    return false;
+
+  auto I64Ty = Type::getInt64Ty(M.getContext());
+
+  for (auto *II : calls) {
+    const auto op = getOp(II->getIntrinsicID());
+    IRBuilder<> B(II);
+
+    auto ptr = B.CreatePtrToInt(II->getArgOperand(0), I64Ty);
+    auto result = B.CreateCall(PartsSoftPa::getHelper(M, op), { ptr, II->getArgOperand(1) });
+
+    II->replaceAllUsesWith(B.CreateIntToPtr(result, II->getType(), II->getName()));
+    II->eraseFromParent();
+
+    ++NumSoftPaCalls;
+    log->inc(DEBUG_TYPE ".Lowered") << "lowered to " << PartsSoftPa::getHelperName(op) << "\n";
+  }
+
+  return true;
+}
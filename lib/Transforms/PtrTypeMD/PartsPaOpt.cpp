@@ -0,0 +1,288 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Removes redundant pa_* intrinsic calls before they reach the backend:
+//
+//  - aut(pac(p, m), m) is folded to p,
+//  - identical PACs and AUTs are CSE'd when one dominates the other,
+//  - loop-invariant PACs and AUTs are hoisted to the loop preheader,
+//  - PACs whose users all sit in a single colder block are sunk into it.
+//
+// The pa_* intrinsics never trap, a failed AUT only yields a poisoned pointer,
+// so moving them around does not change which paths fault.
+//
+//===----------------------------------------------------------------------===//
+
+#include <map>
+#include <tuple>
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "PartsPasses.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+#define DEBUG_TYPE "PartsPaOpt"
+
+namespace {
+
+struct PartsPaOpt : public FunctionPass {
+  static char ID;
+
+  PartsLog_ptr log;
+
+  PartsPaOpt() : FunctionPass(ID), log(PartsLog::getLogger(DEBUG_TYPE))
+  {
+    DEBUG_PA(log->enable());
+  }
+
+  bool runOnFunction(Function &F) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  DominatorTree *DT = nullptr;
+  LoopInfo *LI = nullptr;
+  BlockFrequencyInfo *BFI = nullptr;
+
+  bool foldAutOfPac(Function &F);
+  bool eliminateCommon(Function &F);
+  bool hoistInvariant(Function &F, Loop *L);
+  bool sinkColdPacs(Function &F);
+
+  static bool isPac(const IntrinsicInst *II);
+  static bool isAut(const IntrinsicInst *II);
+  /*! Get the PAC intrinsic that is undone by the given AUT intrinsic */
+  static Intrinsic::ID getMatchingPac(Intrinsic::ID aut);
+};
+
+} // anonymous namespace
+
+char PartsPaOpt::ID = 0;
+static RegisterPass<PartsPaOpt> X("parts-pa-opt", "PARTS redundant PAC/AUT elimination");
+
+FunctionPass *llvm::PARTS::createPartsPaOptPass() {
+  return new PartsPaOpt();
+}
+
+void PartsPaOpt::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<DominatorTreeWrapperPass>();
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<BlockFrequencyInfoWrapperPass>();
+  AU.setPreservesCFG();
+}
+
+bool PartsPaOpt::isPac(const IntrinsicInst *II) {
+  return II != nullptr &&
+         (II->getIntrinsicID() == Intrinsic::pa_pacia || II->getIntrinsicID() == Intrinsic::pa_pacda);
+}
+
+bool PartsPaOpt::isAut(const IntrinsicInst *II) {
+  return II != nullptr &&
+         (II->getIntrinsicID() == Intrinsic::pa_autia || II->getIntrinsicID() == Intrinsic::pa_autda);
+}
+
+Intrinsic::ID PartsPaOpt::getMatchingPac(Intrinsic::ID aut) {
+  switch (aut) {
+    default:
+      llvm_unreachable("not an AUT intrinsic");
+    case Intrinsic::pa_autia:
+      return Intrinsic::pa_pacia;
+    case Intrinsic::pa_autda:
+      return Intrinsic::pa_pacda;
+  }
+}
+
+bool PartsPaOpt::runOnFunction(Function &F) {
+  if (skipFunction(F))
+    return false;
+
+  DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  BFI = &getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI();
+
+  bool changed = false;
+
+  changed |= foldAutOfPac(F);
+  changed |= eliminateCommon(F);
+
+  // Inner loops first, so that invariants can bubble up through a whole loop nest
+  auto loops = LI->getLoopsInPreorder();
+  for (auto Li = loops.rbegin(), Le = loops.rend(); Li != Le; ++Li)
+    changed |= hoistInvariant(F, *Li);
+
+  // Hoisting can line up previously disjoint calls in the same preheader
+  changed |= eliminateCommon(F);
+  changed |= sinkColdPacs(F);
+
+  return changed;
+}
+
+bool PartsPaOpt::foldAutOfPac(Function &F) {
+  bool changed = false;
+
+  for (auto &BB : F) {
+    for (auto Ii = BB.begin(), Ie = BB.end(); Ii != Ie; ) {
+      auto *aut = dyn_cast<IntrinsicInst>(&*Ii++);
+      if (!isAut(aut))
+        continue;
+
+      auto *pac = dyn_cast<IntrinsicInst>(aut->getArgOperand(0)->stripPointerCasts());
+      if (pac == nullptr || pac->getIntrinsicID() != getMatchingPac(aut->getIntrinsicID()))
+        continue;
+      if (pac->getArgOperand(1) != aut->getArgOperand(1))
+        continue;
+
+      log->inc(DEBUG_TYPE ".AutOfPacFolded", true, F.getName()) << "folding " << *aut << "\n";
+
+      Value *raw = pac->getArgOperand(0);
+      if (raw->getType() != aut->getType())
+        raw = new BitCastInst(raw, aut->getType(), "", aut);
+
+      aut->replaceAllUsesWith(raw);
+      aut->eraseFromParent();
+      changed = true;
+    }
+  }
+
+  // Drop PACs that lost all their users to the folding above
+  for (auto &BB : F) {
+    for (auto Ii = BB.begin(), Ie = BB.end(); Ii != Ie; ) {
+      auto *pac = dyn_cast<IntrinsicInst>(&*Ii++);
+      if (isPac(pac) && pac->use_empty()) {
+        log->inc(DEBUG_TYPE ".DeadPacRemoved", true, F.getName()) << "removing " << *pac << "\n";
+        pac->eraseFromParent();
+        changed = true;
+      }
+    }
+  }
+
+  return changed;
+}
+
+bool PartsPaOpt::eliminateCommon(Function &F) {
+  typedef std::tuple<Intrinsic::ID, Value *, Value *> Key;
+  std::map<Key, SmallVector<IntrinsicInst *, 4>> available;
+
+  bool changed = false;
+
+  // Visiting in dominator tree pre-order guarantees that any dominating call has already been seen
+  for (auto *N : depth_first(DT->getRootNode())) {
+    auto *BB = N->getBlock();
+
+    for (auto Ii = BB->begin(), Ie = BB->end(); Ii != Ie; ) {
+      auto *II = dyn_cast<IntrinsicInst>(&*Ii++);
+      if (!isPac(II) && !isAut(II))
+        continue;
+
+      auto &candidates = available[Key(II->getIntrinsicID(), II->getArgOperand(0), II->getArgOperand(1))];
+
+      auto dominating = std::find_if(candidates.begin(), candidates.end(),
+                                     [&](IntrinsicInst *C) { return DT->dominates(C, II); });
+
+      if (dominating == candidates.end()) {
+        candidates.push_back(II);
+        continue;
+      }
+
+      log->inc(DEBUG_TYPE ".CommonRemoved", true, F.getName()) << "replacing " << *II << "\n";
+      II->replaceAllUsesWith(*dominating);
+      II->eraseFromParent();
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool PartsPaOpt::hoistInvariant(Function &F, Loop *L) {
+  if (L->getLoopPreheader() == nullptr)
+    return false;
+
+  bool changed = false;
+
+  for (auto *BB : L->blocks()) {
+    // Only hoist from the loop itself, the inner loops have already been handled
+    if (LI->getLoopFor(BB) != L)
+      continue;
+
+    for (auto Ii = BB->begin(), Ie = BB->end(); Ii != Ie; ) {
+      auto *II = dyn_cast<IntrinsicInst>(&*Ii++);
+      if (!isPac(II) && !isAut(II))
+        continue;
+
+      bool hoisted = false;
+      // makeLoopInvariant also pulls out any invariant operand computations, and relies on the
+      // intrinsics being speculatable
+      if (L->makeLoopInvariant(II, hoisted) && hoisted) {
+        log->inc(DEBUG_TYPE ".InvariantHoisted", true, F.getName()) << "hoisted " << *II << "\n";
+        changed = true;
+      }
+    }
+  }
+
+  return changed;
+}
+
+bool PartsPaOpt::sinkColdPacs(Function &F) {
+  bool changed = false;
+
+  for (auto &BB : F) {
+    for (auto Ii = BB.begin(), Ie = BB.end(); Ii != Ie; ) {
+      auto *pac = dyn_cast<IntrinsicInst>(&*Ii++);
+      if (!isPac(pac) || pac->use_empty())
+        continue;
+
+      BasicBlock *userBB = nullptr;
+      bool sinkable = true;
+
+      for (auto *U : pac->users()) {
+        auto *UI = cast<Instruction>(U);
+        if (isa<PHINode>(UI) || (userBB != nullptr && UI->getParent() != userBB)) {
+          sinkable = false;
+          break;
+        }
+        userBB = UI->getParent();
+      }
+
+      if (!sinkable || userBB == &BB)
+        continue;
+      // Never sink into a loop, even if the profile claims it is cold
+      if (LI->getLoopDepth(userBB) > LI->getLoopDepth(&BB))
+        continue;
+      if (!(BFI->getBlockFreq(userBB) < BFI->getBlockFreq(&BB)))
+        continue;
+
+      Instruction *firstUser = nullptr;
+      for (auto &I : *userBB) {
+        if (!is_contained(pac->users(), &I))
+          continue;
+        firstUser = &I;
+        break;
+      }
+      assert(firstUser != nullptr);
+
+      log->inc(DEBUG_TYPE ".ColdPacSunk", true, F.getName()) << "sinking " << *pac << " to " << userBB->getName() << "\n";
+      pac->moveBefore(firstUser);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
@@ -0,0 +1,40 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PARTSPASSES_H
+#define LLVM_PARTSPASSES_H
+
+namespace llvm {
+
+class FunctionPass;
+class ModulePass;
+
+namespace PARTS {
+
+FunctionPass *createPtrTypeMDPass();
+FunctionPass *createPartsCpiPass();
+ModulePass *createPauthMarkGlobalsPass();
+FunctionPass *createPauthPacMainPass();
+FunctionPass *createPartsPaOptPass();
+
+/*! Promote indirect calls that have at most two possible targets in the whole program */
+ModulePass *createPartsIcpPass();
+/*! Record the type_ids of the whole program's indirect calls, see PartsTypeMetadata::setIndirectlyCalledIds */
+ModulePass *createPartsCfiTypesPass();
+/*! Warn about distinct pointer types with the same type_id */
+ModulePass *createPartsTypeIdCollisionsPass();
+/*! Replace the pa_* intrinsics with calls to the software PA helpers */
+ModulePass *createPartsLowerSoftPaPass();
+
+} // PARTS
+
+} // llvm
+
+#endif //LLVM_PARTSPASSES_H
@@ -0,0 +1,89 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Adds the PARTS IR passes to the PassManagerBuilder pipelines when the plugin
+// is loaded, e.g., with opt -load, clang -Xclang -load, or llvm-lto2
+// -load-pass-plugin.
+//
+// Without LTO the instrumentation runs at the end of the per-module pipeline.
+// With full LTO it is deferred to link time, where the whole program is known:
+// indirect calls are first promoted before the LTO inliner runs, and, with
+// -parts-whole-program, the types that are never called indirectly are recorded
+// right before instrumentation.
+// ThinLTO instruments each module in its backend, without whole-program info.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/PARTS/Parts.h"
+#include "PartsPasses.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+static bool usePartsPipeline() {
+  return PARTS::usePipeline() && PARTS::useAny();
+}
+
+static void addPartsInstrumentation(const PassManagerBuilder &Builder, legacy::PassManagerBase &PM) {
+  PM.add(createPtrTypeMDPass());
+  PM.add(createPartsCpiPass());
+  PM.add(createPauthMarkGlobalsPass());
+  PM.add(createPauthPacMainPass());
+
+  if (Builder.OptLevel > 0)
+    PM.add(createPartsPaOptPass());
+
+  // Lower after PaOpt, which only understands the intrinsics
+  if (PARTS::useSoftPa())
+    PM.add(createPartsLowerSoftPaPass());
+}
+
+static void addPartsPasses(const PassManagerBuilder &Builder, legacy::PassManagerBase &PM) {
+  if (!usePartsPipeline())
+    return;
+
+  if (PARTS::useTypeIdCollisionCheck())
+    PM.add(createPartsTypeIdCollisionsPass());
+
+  // The module is instrumented later, either at link time or in the ThinLTO backend
+  if (Builder.PrepareForLTO || Builder.PrepareForThinLTO)
+    return;
+
+  addPartsInstrumentation(Builder, PM);
+}
+
+static void addPartsLTOEarlyPasses(const PassManagerBuilder &Builder, legacy::PassManagerBase &PM) {
+  if (!usePartsPipeline() || Builder.OptLevel == 0)
+    return;
+
+  PM.add(createPartsIcpPass());
+}
+
+static void addPartsLTOLastPasses(const PassManagerBuilder &Builder, legacy::PassManagerBase &PM) {
+  if (!usePartsPipeline())
+    return;
+
+  // Check the merged module, collisions between types of different modules only show up here
+  if (PARTS::useTypeIdCollisionCheck())
+    PM.add(createPartsTypeIdCollisionsPass());
+
+  if (PARTS::useWholeProgram())
+    PM.add(createPartsCfiTypesPass());
+  addPartsInstrumentation(Builder, PM);
+}
+
+static RegisterStandardPasses RegisterParts(PassManagerBuilder::EP_OptimizerLast, addPartsPasses);
+static RegisterStandardPasses RegisterPartsO0(PassManagerBuilder::EP_EnabledOnOptLevel0, addPartsPasses);
+static RegisterStandardPasses RegisterPartsLTOEarly(PassManagerBuilder::EP_FullLinkTimeOptimizationEarly,
+                                                    addPartsLTOEarlyPasses);
+static RegisterStandardPasses RegisterPartsLTOLast(PassManagerBuilder::EP_FullLinkTimeOptimizationLast,
+                                                   addPartsLTOLastPasses);
@@ -0,0 +1,143 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Reports distinct pointer types of a module that map to the same type_id.
+// Pointers of colliding types can be substituted for each other without
+// failing authentication. During LTO this checks the whole program.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/PARTS/Parts.h"
+#include "llvm/PARTS/PartsLog.h"
+#include "llvm/PARTS/PartsTypeIdHash.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
+#include "PartsPasses.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+#define DEBUG_TYPE "PartsTypeIdCollisions"
+
+STATISTIC(NumTypeIdCollisions, "Number of distinct types with a colliding type_id");
+
+namespace {
+
+/*! Warning about two distinct types of a module that share a type_id */
+class DiagnosticInfoPartsTypeIdCollision : public DiagnosticInfo {
+public:
+  DiagnosticInfoPartsTypeIdCollision(const Module &M, const Type &A, const Type &B, type_id_t type_id)
+      : DiagnosticInfo(getKindID(), DS_Warning), M(M), A(A), B(B), type_id(type_id) {}
+
+  void print(DiagnosticPrinter &DP) const override {
+    // The printer has no overload for types
+    std::string a_str, b_str;
+    raw_string_ostream a_os(a_str), b_os(b_str);
+    A.print(a_os);
+    B.print(b_os);
+    DP << M.getModuleIdentifier() << ": PARTS type_id collision (" << getTypeIdHashName(PARTS::getTypeIdHash())
+       << "): '" << a_os.str() << "' and '" << b_os.str() << "' both map to " << type_id;
+  }
+
+  static bool classof(const DiagnosticInfo *DI) { return DI->getKind() == getKindID(); }
+
+private:
+  const Module &M;
+  const Type &A;
+  const Type &B;
+  const type_id_t type_id;
+
+  static int getKindID() {
+    static const int KindID = getNextAvailablePluginDiagnosticKind();
+    return KindID;
+  }
+};
+
+struct PartsTypeIdCollisions : public ModulePass {
+  static char ID;
+
+  PartsLog_ptr log;
+
+  PartsTypeIdCollisions() : ModulePass(ID), log(PartsLog::getLogger(DEBUG_TYPE))
+  {
+    DEBUG_PA(log->enable());
+  }
+
+  bool runOnModule(Module &M) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesAll();
+  }
+
+private:
+  DenseMap<type_id_t, Type *> m_ids;
+  SmallPtrSet<Type *, 32> m_seen;
+
+  void check(const Module &M, Type *Ty);
+};
+
+} // anonymous namespace
+
+char PartsTypeIdCollisions::ID = 0;
+static RegisterPass<PartsTypeIdCollisions> X("parts-typeid-collisions-pass", "PARTS type_id collision detector");
+
+ModulePass *llvm::PARTS::createPartsTypeIdCollisionsPass() {
+  return new PartsTypeIdCollisions();
+}
+
+bool PartsTypeIdCollisions::runOnModule(Module &M) {
+  m_ids.clear();
+  m_seen.clear();
+
+  for (auto &GV : M.globals())
+    check(M, GV.getType());
+
+  for (auto &F : M) {
+    check(M, F.getType());
+
+    for (auto &A : F.args())
+      check(M, A.getType());
+
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        check(M, I.getType());
+        for (auto &O : I.operands())
+          check(M, O->getType());
+      }
+    }
+  }
+
+  log->inc(DEBUG_TYPE ".PointerTypes", (unsigned) m_ids.size()) << "checked " << (unsigned) m_ids.size()
+                                                                 << " pointer types\n";
+
+  m_ids.clear();
+  m_seen.clear();
+  return false;
+}
+
+void PartsTypeIdCollisions::check(const Module &M, Type *Ty) {
+  if (!Ty->isPointerTy() || !m_seen.insert(Ty).second)
+    return;
+
+  const auto type_id = PartsTypeMetadata::idFromType(Ty);
+  auto inserted = m_ids.insert({type_id, Ty});
+  if (inserted.second)
+    return;
+
+  ++NumTypeIdCollisions;
+  M.getContext().diagnose(DiagnosticInfoPartsTypeIdCollision(M, *inserted.first->second, *Ty, type_id));
+}
@@ -8,21 +8,32 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
+#include <vector>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/PARTS/PartsIntr.h>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/PARTS/Parts.h"
 #include "llvm/PARTS/PartsLog.h"
+#include "PartsPasses.h"
 #include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "PauthOptPauthMarkGlobals"
+
+STATISTIC(NumTableEntries, "Number of global pointers PACed from a table");
+STATISTIC(NumLazyGlobals, "Number of globals PACed on first use");
 #define TAG KYEL DEBUG_TYPE ": "
 
 //#undef DEBUG_PA
@@ -30,7 +41,7 @@ using namespace llvm;
 
 namespace {
 
-struct PauthMarkGlobals: public FunctionPass {
+struct PauthMarkGlobals: public ModulePass {
   static char ID; // Pass identification, replacement for typeid
 
   PartsLog_ptr log;
@@ -43,25 +54,69 @@ struct PauthMarkGlobals: public FunctionPass {
   unsigned fixed_cp = 0;
   bool need_fix_globals_call = false;
 
+  /*! (address of the pointer as i8**, type_id) of every global pointer that needs PACing */
+  typedef std::vector<std::pair<Constant *, PARTS::type_id_t>> PacTable;
+  PacTable code_entries;
+  PacTable data_entries;
+
+  /*! Guard and initializer of a lazily PACed global */
+  struct LazyInit {
+    GlobalVariable *guard;
+    Function *init;
+  };
+  DenseMap<const GlobalVariable *, LazyInit> lazy_globals;
+
   IRBuilder<> *builder;
 
   Function *funcFixGlobals = nullptr;
 
   PauthMarkGlobals() :
-      FunctionPass(ID),
+      ModulePass(ID),
       log(PartsLog::getLogger(DEBUG_TYPE))
   {
     DEBUG_PA(log->enable());
   }
 
-  bool doInitialization(Module &M) override;
-  bool runOnFunction(Function &M) override;
+  bool runOnModule(Module &M) override;
+  bool doFinalization(Module &M) override;
 
   bool handleGlobal(Module &M, GlobalVariable &GV);
 
 private:
+  /*!
+   * Emit __pauth_pac_globals and the lazy initializers. This runs from runOnModule rather than doInitialization: the
+   * legacy pass manager initializes every pass before running the -O pipeline, which would then drop or rewrite
+   * the tables before they are used.
+   */
+  bool pacGlobals(Module &M);
+
+  bool runOnFunction(Function &F);
+
   void writeTypeIds(Module &M, std::list<PARTS::type_id_t> &type_ids, const char *sectionName);
 
+  void addEntry(Module &M, Constant *addr, Type *ptrTy);
+
+  /*!
+   * Emit the entries as a constant { i8**, i64 } table sorted by type_id, and a loop that PACs each entry in place.
+   * This keeps the code size of __pauth_pac_globals constant regardless of the number of global pointers.
+   */
+  void emitPacLoop(Module &M, PacTable &entries, bool isCode, const char *sectionName);
+
+  /*!
+   * Check if all accesses to GV are loads and stores in instrumented functions of this module, so that the lazy
+   * initialization cannot be bypassed.
+   */
+  bool canInitLazily(const GlobalVariable &GV);
+
+  /*!
+   * Create a guard and an initializer that PACs the given entries of GV on first call. The guard is 0 before,
+   * 1 during, and 2 after initialization, threads racing for the initialization wait for the winner.
+   */
+  void createLazyInit(Module &M, GlobalVariable &GV, PacTable &code, PacTable &data);
+
+  /*! Make sure the lazily PACed globals accessed in F are initialized before use */
+  bool insertLazyInitChecks(Function &F);
+
 };
 
 } // anonymous namespace
@@ -69,10 +124,30 @@ private:
 char PauthMarkGlobals::ID = 0;
 static RegisterPass<PauthMarkGlobals> X("pauth-markglobals", "PAC argv for main call");
 
-bool PauthMarkGlobals::doInitialization(Module &M) {
+ModulePass *llvm::PARTS::createPauthMarkGlobalsPass() {
+  return new PauthMarkGlobals();
+}
+
+bool PauthMarkGlobals::runOnModule(Module &M) {
   if ( !(PARTS::useFeCfi() || PARTS::useDpi())) // We don't need to do anything unless we use PI
     return false;
 
+  auto changed = pacGlobals(M);
+
+  for (auto &F : M) {
+    if (!F.isDeclaration())
+      changed |= runOnFunction(F);
+  }
+
+  return changed;
+}
+
+bool PauthMarkGlobals::pacGlobals(Module &M) {
+  data_type_ids.clear();
+  code_type_ids.clear();
+  marked_data_pointers = marked_code_pointers = 0;
+  fixed_dp = fixed_cp = 0;
+
   auto &C = M.getContext();
 
   auto result = Type::getVoidTy(C);
@@ -85,9 +160,38 @@ bool PauthMarkGlobals::doInitialization(Module &M) {
   auto BB = BasicBlock::Create(M.getContext(), "entry", funcFixGlobals);
   IRBuilder<> localBuilder(BB);
   builder = &localBuilder;
-  for (auto GI = M.global_begin(); GI != M.global_end(); GI++) {
-    handleGlobal(M, *GI);
+  code_entries.clear();
+  data_entries.clear();
+  lazy_globals.clear();
+
+  // Collect first, the tables and guards added below must not be visited
+  std::vector<GlobalVariable *> globals;
+  for (auto &GV : M.globals())
+    globals.push_back(&GV);
+
+  for (auto GV : globals) {
+    const auto numCode = code_entries.size();
+    const auto numData = data_entries.size();
+
+    handleGlobal(M, *GV);
+
+    if (!PARTS::useLazyGlobals() || (numCode == code_entries.size() && numData == data_entries.size()))
+      continue;
+    if (!canInitLazily(*GV)) {
+      log->inc(DEBUG_TYPE ".LazyGlobalRejected", true) << "cannot lazily PAC " << GV->getName() << "\n";
+      continue;
+    }
+
+    // Move the new entries from the startup tables to the lazy initializer of this global
+    PacTable code(code_entries.begin() + numCode, code_entries.end());
+    PacTable data(data_entries.begin() + numData, data_entries.end());
+    code_entries.resize(numCode);
+    data_entries.resize(numData);
+    createLazyInit(M, *GV, code, data);
   }
+  builder = &localBuilder;
+  emitPacLoop(M, code_entries, true, "parts_pac_globals_code");
+  emitPacLoop(M, data_entries, false, "parts_pac_globals_data");
   builder->CreateRetVoid();
   builder = nullptr;
 
@@ -108,9 +212,16 @@ bool PauthMarkGlobals::doInitialization(Module &M) {
   return need_fix_globals_call;
 }
 
+bool PauthMarkGlobals::doFinalization(Module &M) {
+  PartsTypeMetadata::releaseTypeIdCache(M.getContext());
+  return false;
+}
+
 bool PauthMarkGlobals::runOnFunction(Function &F) {
+  const auto checked = !lazy_globals.empty() && insertLazyInitChecks(F);
+
   if (!(PARTS::useAny() && F.getName().equals("main")))
-    return false;
+    return checked;
 
   assert(F.getName().equals("main"));
 
@@ -146,23 +257,22 @@ bool PauthMarkGlobals::handleGlobal(Module &M, GlobalVariable &GV) {
     auto elementType = arrayType->getElementType();
 
     const auto isCodePtr = PartsTypeMetadata::TyIsCodePointer(elementType);
+    const auto isCalledCodePtr = isCodePtr &&
+        PartsTypeMetadata::needsCodePointerPac(M, PartsTypeMetadata::idFromType(elementType));
 
-    if ((PARTS::useDpi() && !isCodePtr) || (PARTS::useFeCfi() && isCodePtr)) {
+    if ((PARTS::useDpi() && !isCodePtr) || (PARTS::useFeCfi() && isCalledCodePtr)) {
       DEBUG_PA(log->debug() << "looking to PAC: " << GV << "\n");
 
       // Only PAC if feature enabled
 
       for (auto i = 0U; i < dyn_cast<User>(O)->getNumOperands(); i++) {
-        auto elPtr = builder->CreateGEP(&GV, {
+        Constant *idx[] = {
             ConstantInt::get(Type::getInt64Ty(C), 0),
             ConstantInt::get(Type::getInt64Ty(C), i),
-        });
-
-        auto loaded = builder->CreateLoad(elPtr);
-        auto paced = PartsIntr::pac_pointer(builder, M, loaded);
-        builder->CreateStore(paced, elPtr);
+        };
+        addEntry(M, ConstantExpr::getInBoundsGetElementPtr(GV.getValueType(), &GV, idx), elementType);
 
-        DEBUG_PA(log->debug() << "found array element, PACed " << paced << " with id " << PartsTypeMetadata::idFromType(elementType) << "\n");
+        DEBUG_PA(log->debug() << "found array element " << i << " with id " << PartsTypeMetadata::idFromType(elementType) << "\n");
 
         if (isCodePtr) {
           fixed_cp++;
@@ -180,29 +290,26 @@ bool PauthMarkGlobals::handleGlobal(Module &M, GlobalVariable &GV) {
 
     auto type_id = PartsTypeMetadata::idFromType(Ty);
 
-    if (PTMD->isCodePointer()) {
-      if (PARTS::useFeCfi()) {
+    if (PTMD.isCodePointer()) {
+      if (PARTS::useFeCfi() && PartsTypeMetadata::needsCodePointerPac(M, type_id)) {
         marked_code_pointers++;
         log->debug() << "mark as code pointer type_id=" << type_id << "\n";
       } else {
-        PTMD->setIgnored(true);
+        PTMD.setIgnored(true);
       }
     } else {
-      assert(PTMD->isDataPointer());
+      assert(PTMD.isDataPointer());
       if (PARTS::useDpi()) {
         marked_data_pointers++;
         log->green() << "mark as data pointer type_id=" << type_id << "\n";
       } else {
-        PTMD->setIgnored(true);
+        PTMD.setIgnored(true);
       }
     }
 
-    if (!PTMD->isIgnored()) {
-      log->debug() << "inserting new PAC call to global fixer function\n";
-
-      auto loaded = builder->CreateLoad(&GV);
-      auto paced = PartsIntr::pac_pointer(builder, M, loaded);
-      builder->CreateStore(paced, &GV);
+    if (!PTMD.isIgnored()) {
+      log->debug() << "adding global to the PAC table\n";
+      addEntry(M, &GV, Ty);
     }
     return true;
   }
@@ -221,3 +328,200 @@ void PauthMarkGlobals::writeTypeIds(Module &M, std::list<PARTS::type_id_t> &type
     g->setSection(sectionName);
   }
 }
+
+void PauthMarkGlobals::addEntry(Module &M, Constant *addr, Type *ptrTy) {
+  const auto PTMD = PartsTypeMetadata::get(ptrTy);
+  auto &entries = PTMD.isCodePointer() ? code_entries : data_entries;
+  auto I8PtrPtrTy = Type::getInt8PtrTy(M.getContext())->getPointerTo();
+
+  entries.emplace_back(ConstantExpr::getPointerCast(addr, I8PtrPtrTy), PTMD.getTypeId());
+}
+
+void PauthMarkGlobals::emitPacLoop(Module &M, PacTable &entries, bool isCode, const char *sectionName) {
+  if (entries.empty())
+    return;
+
+  auto &C = M.getContext();
+  auto I64Ty = Type::getInt64Ty(C);
+  auto I8PtrTy = Type::getInt8PtrTy(C);
+  auto entryTy = StructType::get(I8PtrTy->getPointerTo(), I64Ty);
+
+  // Grouping by type_id lets consecutive iterations reuse the same modifier
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const PacTable::value_type &a, const PacTable::value_type &b) { return a.second < b.second; });
+
+  std::vector<Constant *> elements;
+  elements.reserve(entries.size());
+  for (auto &entry : entries)
+    elements.push_back(ConstantStruct::get(entryTy, { entry.first, ConstantInt::get(I64Ty, entry.second) }));
+
+  auto tableTy = ArrayType::get(entryTy, elements.size());
+  auto table = new GlobalVariable(M, tableTy, true, GlobalValue::PrivateLinkage,
+                                  ConstantArray::get(tableTy, elements), "__pauth_pac_table");
+  table->setSection(sectionName);
+
+  NumTableEntries += entries.size();
+  log->inc(DEBUG_TYPE ".TableEntries", (unsigned) entries.size()) << "emitting " << entries.size() << " entries to "
+                                                       << sectionName << "\n";
+
+  // for (i = 0; i < n; i++) *table[i].addr = pac(*table[i].addr, table[i].type_id);
+  auto F = builder->GetInsertBlock()->getParent();
+  auto preheader = builder->GetInsertBlock();
+  auto loop = BasicBlock::Create(C, "pac_loop", F);
+  auto exit = BasicBlock::Create(C, "pac_exit", F);
+  builder->CreateBr(loop);
+
+  builder->SetInsertPoint(loop);
+  auto i = builder->CreatePHI(I64Ty, 2, "i");
+  i->addIncoming(ConstantInt::get(I64Ty, 0), preheader);
+
+  auto addr = builder->CreateLoad(builder->CreateInBoundsGEP(tableTy, table, { builder->getInt64(0), i, builder->getInt32(0) }));
+  auto type_id = builder->CreateLoad(builder->CreateInBoundsGEP(tableTy, table, { builder->getInt64(0), i, builder->getInt32(1) }));
+
+  Type *arg_types[] = { I8PtrTy };
+  auto pacIntr = Intrinsic::getDeclaration(&M, isCode ? Intrinsic::pa_pacia : Intrinsic::pa_pacda, arg_types);
+  auto paced = builder->CreateCall(pacIntr, { builder->CreateLoad(addr), type_id });
+  builder->CreateStore(paced, addr);
+
+  auto next = builder->CreateAdd(i, builder->getInt64(1), "i.next", true, true);
+  i->addIncoming(next, loop);
+  builder->CreateCondBr(builder->CreateICmpEQ(next, builder->getInt64(entries.size())), exit, loop);
+
+  builder->SetInsertPoint(exit);
+}
+
+bool PauthMarkGlobals::canInitLazily(const GlobalVariable &GV) {
+  // Other modules could access the global without going through our checks
+  if (!GV.hasLocalLinkage())
+    return false;
+
+  SmallVector<const Value *, 8> worklist;
+  SmallPtrSet<const Value *, 8> visited;
+  worklist.push_back(&GV);
+
+  while (!worklist.empty()) {
+    auto V = worklist.pop_back_val();
+    if (!visited.insert(V).second)
+      continue;
+
+    for (auto U : V->users()) {
+      if (auto CE = dyn_cast<ConstantExpr>(U)) {
+        if (CE->getOpcode() != Instruction::GetElementPtr && CE->getOpcode() != Instruction::BitCast)
+          return false;
+        worklist.push_back(CE);
+        continue;
+      }
+
+      auto I = dyn_cast<Instruction>(U);
+      if (I == nullptr || I->getFunction()->getFnAttribute("no-parts").getValueAsString() == "true")
+        return false;
+
+      if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I)) {
+        worklist.push_back(I);
+      } else if (auto SI = dyn_cast<StoreInst>(I)) {
+        if (SI->getValueOperand() == V)
+          return false;
+      } else if (!isa<LoadInst>(I)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void PauthMarkGlobals::createLazyInit(Module &M, GlobalVariable &GV, PacTable &code, PacTable &data) {
+  auto &C = M.getContext();
+  auto I32Ty = Type::getInt32Ty(C);
+
+  auto guard = new GlobalVariable(M, I32Ty, false, GlobalValue::InternalLinkage, ConstantInt::get(I32Ty, 0),
+                                  "__pauth_pac_guard." + GV.getName());
+  guard->setAlignment(4);
+
+  auto init = Function::Create(FunctionType::get(Type::getVoidTy(C), false), GlobalValue::InternalLinkage,
+                               "__pauth_pac_init." + GV.getName(), &M);
+  init->addFnAttr("no-parts", "true");
+  init->addFnAttr(Attribute::NoInline);
+  init->addFnAttr(Attribute::Cold);
+
+  auto entry = BasicBlock::Create(C, "entry", init);
+  auto wait = BasicBlock::Create(C, "wait", init);
+  auto done = BasicBlock::Create(C, "done", init);
+  auto first = BasicBlock::Create(C, "first", init);
+
+  IRBuilder<> localBuilder(entry);
+  builder = &localBuilder;
+
+  // if (cmpxchg(guard, 0, 1)) { pac entries; guard = 2; } else { while (guard != 2); }
+  auto cas = builder->CreateAtomicCmpXchg(guard, builder->getInt32(0), builder->getInt32(1),
+                                          AtomicOrdering::AcquireRelease, AtomicOrdering::Acquire);
+  builder->CreateCondBr(builder->CreateExtractValue(cas, 1), first, wait);
+
+  builder->SetInsertPoint(first);
+  emitPacLoop(M, code, true, "parts_pac_globals_code");
+  emitPacLoop(M, data, false, "parts_pac_globals_data");
+  builder->CreateAlignedStore(builder->getInt32(2), guard, 4)->setAtomic(AtomicOrdering::Release);
+  builder->CreateRetVoid();
+
+  builder->SetInsertPoint(wait);
+  auto state = builder->CreateAlignedLoad(guard, 4);
+  state->setAtomic(AtomicOrdering::Acquire);
+  builder->CreateCondBr(builder->CreateICmpEQ(state, builder->getInt32(2)), done, wait);
+
+  builder->SetInsertPoint(done);
+  builder->CreateRetVoid();
+
+  builder = nullptr;
+
+  ++NumLazyGlobals;
+  log->inc(DEBUG_TYPE ".LazyGlobals", true) << "lazily PACing " << GV.getName() << "\n";
+  lazy_globals[&GV] = LazyInit { guard, init };
+}
+
+bool PauthMarkGlobals::insertLazyInitChecks(Function &F) {
+  if (F.getFnAttribute("no-parts").getValueAsString() == "true")
+    return false;
+
+  const auto &DL = F.getParent()->getDataLayout();
+  SmallVector<std::pair<Instruction *, LazyInit>, 8> checks;
+
+  for (auto &BB : F) {
+    // One check per global and block is enough, later accesses in the block are already covered
+    SmallPtrSet<const GlobalVariable *, 4> checked;
+
+    for (auto &I : BB) {
+      Value *ptr = nullptr;
+      if (auto LI = dyn_cast<LoadInst>(&I))
+        ptr = LI->getPointerOperand();
+      else if (auto SI = dyn_cast<StoreInst>(&I))
+        ptr = SI->getPointerOperand();
+      else
+        continue;
+
+      auto GV = dyn_cast<GlobalVariable>(GetUnderlyingObject(ptr, DL, 0));
+      if (GV == nullptr)
+        continue;
+
+      auto lazy = lazy_globals.find(GV);
+      if (lazy != lazy_globals.end() && checked.insert(GV).second)
+        checks.emplace_back(&I, lazy->second);
+    }
+  }
+
+  MDBuilder MDB(F.getContext());
+
+  for (auto &check : checks) {
+    // if (guard != 2) init();
+    IRBuilder<> Builder(check.first);
+    auto state = Builder.CreateAlignedLoad(check.second.guard, 4);
+    state->setAtomic(AtomicOrdering::Acquire);
+    auto needsInit = Builder.CreateICmpNE(state, Builder.getInt32(2));
+
+    auto term = SplitBlockAndInsertIfThen(needsInit, check.first, false, MDB.createBranchWeights(1, 1 << 20));
+    IRBuilder<>(term).CreateCall(check.second.init);
+
+    log->inc(DEBUG_TYPE ".LazyGlobalChecks", true, F.getName()) << "checking " << check.second.guard->getName() << "\n";
+  }
+
+  return !checks.empty();
+}
@@ -18,6 +18,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/PARTS/Parts.h"
 #include "llvm/PARTS/PartsLog.h"
+#include "PartsPasses.h"
 
 using namespace llvm;
 
@@ -28,8 +29,6 @@ namespace {
 struct PauthPacMain: public FunctionPass {
   static char ID; // Pass identification, replacement for typeid
 
-  Function *funcFixMain = nullptr;
-
   PartsLog_ptr log;
 
   PauthPacMain() :
@@ -39,10 +38,16 @@ struct PauthPacMain: public FunctionPass {
     DEBUG_PA(log->enable());
   }
 
-  bool doInitialization(Module &M) override;
   bool doFinalization(Module &M) override;
 
   bool runOnFunction(Function &F) override;
+
+private:
+  /*!
+   * Declare __pauth_pac_main_args only once main is found. A declaration made in doInitialization would run before
+   * the rest of the -O pipeline, which then removes it as unused.
+   */
+  Constant *getFixMain(Module &M);
 };
 
 } // anonyous namespace
@@ -50,11 +55,12 @@ struct PauthPacMain: public FunctionPass {
 char PauthPacMain::ID = 0;
 static RegisterPass<PauthPacMain> X("pauth-pacmain", "PAC argv for main call");
 
-bool PauthPacMain::doInitialization(Module &M)
-{
-  if (!PARTS::useDpi())
-    return false;
+FunctionPass *llvm::PARTS::createPauthPacMainPass() {
+  return new PauthPacMain();
+}
 
+Constant *PauthPacMain::getFixMain(Module &M)
+{
   auto &C = M.getContext();
 
   Type* types[3];
@@ -66,12 +72,11 @@ bool PauthPacMain::doInitialization(Module &M)
   auto result = Type::getVoidTy(C);
 
   FunctionType* signature = FunctionType::get(result, params, false);
-  funcFixMain = Function::Create(signature, Function::ExternalLinkage, "__pauth_pac_main_args", &M);
-
-  return true;
+  return M.getOrInsertFunction("__pauth_pac_main_args", signature);
 }
 
 bool PauthPacMain::doFinalization(Module &M) {
+  PartsTypeMetadata::releaseTypeIdCache(M.getContext());
   return PARTS::useDpi();
 }
 
@@ -109,7 +114,11 @@ bool PauthPacMain::runOnFunction(Function &F) {
   ));
 
   IRBuilder<> Builder(&I);
-  Builder.CreateCall(funcFixMain, args);
+  Builder.CreateCall(getFixMain(*F.getParent()), args);
+
+  // Attributes inferred earlier in the pipeline no longer hold, argv is now passed on and PACed in place
+  for (auto kind : { Attribute::NoCapture, Attribute::ReadNone, Attribute::ReadOnly })
+    F.removeParamAttr(argv.getArgNo(), kind);
 
   DEBUG_PA(log->info() << "Adding call to __pauth_pac_main_args\n");
   return true;
@@ -12,7 +12,12 @@
 #include <llvm/PARTS/PartsIntr.h>
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
@@ -21,6 +26,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/PARTS/Parts.h"
 #include "llvm/PARTS/PartsLog.h"
+#include "PartsPasses.h"
 
 using namespace llvm;
 using namespace llvm::PARTS;
@@ -43,9 +49,25 @@ struct PtrTypeMDPass : public FunctionPass {
   }
 
   bool runOnFunction(Function &F) override;
+  bool doFinalization(Module &M) override;
 
-  PartsTypeMetadata_ptr createLoadMetadata(Function &F, Instruction &I);
-  PartsTypeMetadata_ptr createStoreMetadata(Function &F, Instruction &I);
+  PartsTypeMetadata createLoadMetadata(Function &F, Instruction &I);
+  PartsTypeMetadata createStoreMetadata(Function &F, Instruction &I);
+
+private:
+  /*! Cached isUnreachableSlot results for the allocas of the current function */
+  DenseMap<const AllocaInst *, bool> m_unreachableSlots;
+
+  /*! Skip instrumentation of I if it only accesses a stack slot the attacker cannot reach */
+  void applyEscapeAnalysis(Function &F, Instruction &I, PartsTypeMetadata &MD);
+
+  /*!
+   * Check if AI never escapes and is only accessed by loads and stores through GEPs and bitcasts.
+   *
+   * Being uncaptured is not enough on its own, a PHI or select could mix the slot with other memory, and then
+   * the same slot would be accessed both with and without instrumentation.
+   */
+  bool isUnreachableSlot(const AllocaInst *AI);
 };
 
 } // anonymous namespace
@@ -53,19 +75,25 @@ struct PtrTypeMDPass : public FunctionPass {
 char PtrTypeMDPass::ID = 0;
 static RegisterPass<PtrTypeMDPass> X("ptr-type-md-pass", "Pointer Type Metadata Pass");
 
+FunctionPass *llvm::PARTS::createPtrTypeMDPass() {
+  return new PtrTypeMDPass();
+}
+
 bool PtrTypeMDPass::runOnFunction(Function &F) {
   if (!PARTS::useDpi())
     return false;
 
   auto &C = F.getContext();
 
+  m_unreachableSlots.clear();
+
   for (auto &BB:F){
     for (auto &I: BB) {
       DEBUG_PA(log->debug() << F.getName() << "->" << BB.getName() << "->" << I << "\n");
 
       const auto IOpcode = I.getOpcode();
 
-      PartsTypeMetadata_ptr MD = nullptr;
+      PartsTypeMetadata_opt MD;
 
       switch(IOpcode) {
         case Instruction::Store:
@@ -78,9 +106,12 @@ bool PtrTypeMDPass::runOnFunction(Function &F) {
           break;
       }
 
-      if (MD != nullptr) {
+      if (MD && PARTS::useDpiEscapeAnalysis())
+        applyEscapeAnalysis(F, I, *MD);
+
+      if (MD) {
         MD->attach(C, I);
-        log->inc(DEBUG_TYPE ".MetadataAdded", !MD->isIgnored()) << "adding metadata: " << MD->toString() << "\n";
+        log->inc(DEBUG_TYPE ".MetadataAdded", !MD->isIgnored()) << "adding metadata: " << *MD << "\n";
       } else {
         log->inc(DEBUG_TYPE ".MetadataMissing") << "missing metadata\n";
       }
@@ -90,56 +121,126 @@ bool PtrTypeMDPass::runOnFunction(Function &F) {
   return true;
 }
 
-PartsTypeMetadata_ptr PtrTypeMDPass::createLoadMetadata(Function &F, Instruction &I) {
+bool PtrTypeMDPass::doFinalization(Module &M) {
+  PartsTypeMetadata::releaseTypeIdCache(M.getContext());
+  return false;
+}
+
+PartsTypeMetadata PtrTypeMDPass::createLoadMetadata(Function &F, Instruction &I) {
   assert(isa<LoadInst>(I));
 
   auto V = I.getOperand(0);
   assert(I.getType() == V->getType()->getPointerElementType());
 
-  PartsTypeMetadata_ptr MD = nullptr;
+  const Type *Ty = nullptr;
 
   if (isa<BitCastInst>(V)) {
     auto BC = dyn_cast<BitCastInst>(V);
-    MD = PartsTypeMetadata::get(BC->getSrcTy());
+    Ty = BC->getSrcTy();
     // FIXME: Ugly hack, will make all union types the same!!!
   } else {
-    MD = PartsTypeMetadata::get(V->getType()->getPointerElementType());
+    Ty = V->getType()->getPointerElementType();
   }
 
-  if (MD->isCodePointer()) {
+  auto MD = PartsTypeMetadata::get(Ty);
+
+  if (MD.isCodePointer()) {
     // Ignore all loaded function-pointers (at least for now)
-    MD->setIgnored(true);
-  } else if (MD->isDataPointer()) {
+    MD.setIgnored(true);
+  } else if (MD.isDataPointer()) {
     if (!PARTS::useDpi()) {
-      MD->setIgnored(true);
+      MD.setIgnored(true);
     }
   }
 
   return MD;
 }
 
-PartsTypeMetadata_ptr PtrTypeMDPass::createStoreMetadata(Function &F, Instruction &I) {
+PartsTypeMetadata PtrTypeMDPass::createStoreMetadata(Function &F, Instruction &I) {
   assert(isa<StoreInst>(I));
 
   auto V = I.getOperand(1);
   assert(I.getOperand(0)->getType() == V->getType()->getPointerElementType());
 
-  PartsTypeMetadata_ptr MD = nullptr;
+  const Type *Ty = nullptr;
 
   if (isa<BitCastInst>(V)) {
     auto BC = dyn_cast<BitCastInst>(V);
-    MD = PartsTypeMetadata::get(BC->getSrcTy());
+    Ty = BC->getSrcTy();
     // FIXME: Ugly hack, will make all union types the same!!!
   } else {
-    MD = PartsTypeMetadata::get(V->getType()->getPointerElementType());
+    Ty = V->getType()->getPointerElementType();
   }
 
-  if (MD->isCodePointer()) {
-    MD->setIgnored(true);
-  } else if (MD->isDataPointer()) {
+  auto MD = PartsTypeMetadata::get(Ty);
+
+  if (MD.isCodePointer()) {
+    MD.setIgnored(true);
+  } else if (MD.isDataPointer()) {
     if (!PARTS::useDpi())
-      MD->setIgnored(true);
+      MD.setIgnored(true);
   }
 
   return MD;
 }
+
+void PtrTypeMDPass::applyEscapeAnalysis(Function &F, Instruction &I, PartsTypeMetadata &MD) {
+  if (MD.isIgnored() || !MD.isDataPointer())
+    return;
+
+  const auto isStore = isa<StoreInst>(I);
+  const auto stat = std::string(DEBUG_TYPE ".EscapeAnalysis.") + (isStore ? "Store" : "Load");
+
+  auto ptr = isStore ? cast<StoreInst>(I).getPointerOperand() : cast<LoadInst>(I).getPointerOperand();
+  // No lookup limit, all accesses to a slot must reach the same conclusion
+  auto AI = dyn_cast<AllocaInst>(GetUnderlyingObject(ptr, F.getParent()->getDataLayout(), 0));
+
+  if (AI == nullptr || !isUnreachableSlot(AI)) {
+    log->inc(stat + "Instrumented", true, F.getName()) << "pointer may be attacker reachable\n";
+    return;
+  }
+
+  log->inc(stat + "Eliminated", true, F.getName()) << "skipping access to non-escaping " << AI->getName() << "\n";
+  MD.setIgnored(true);
+}
+
+bool PtrTypeMDPass::isUnreachableSlot(const AllocaInst *AI) {
+  auto cached = m_unreachableSlots.find(AI);
+  if (cached != m_unreachableSlots.end())
+    return cached->second;
+
+  bool unreachable = !PointerMayBeCaptured(AI, true, true);
+
+  SmallVector<const Value *, 8> worklist;
+  SmallPtrSet<const Value *, 8> visited;
+  worklist.push_back(AI);
+
+  while (unreachable && !worklist.empty()) {
+    auto V = worklist.pop_back_val();
+    if (!visited.insert(V).second)
+      continue;
+
+    for (auto U : V->users()) {
+      if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+        worklist.push_back(U);
+      } else if (isa<LoadInst>(U)) {
+        continue;
+      } else if (auto SI = dyn_cast<StoreInst>(U)) {
+        // Storing the slot address itself would let it escape
+        unreachable &= SI->getValueOperand() != V;
+      } else if (auto II = dyn_cast<IntrinsicInst>(U)) {
+        unreachable &= II->getIntrinsicID() == Intrinsic::lifetime_start ||
+                       II->getIntrinsicID() == Intrinsic::lifetime_end ||
+                       isa<DbgInfoIntrinsic>(II);
+      } else {
+        unreachable = false;
+      }
+
+      if (!unreachable)
+        break;
+    }
+  }
+
+  m_unreachableSlots[AI] = unreachable;
+  return unreachable;
+}
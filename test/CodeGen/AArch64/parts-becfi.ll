@@ -0,0 +1,101 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-becfi -tailcallopt -enable-tail-merge=false \
+; RUN:   -verify-machineinstrs < %s | FileCheck %s
+
+; LR is signed against SP at function entry and authenticated right before
+; each return, once SP is back at its entry value.
+
+declare i32 @ext(i32)
+declare void @use(i8*)
+declare fastcc void @callee_stack(i64, i64, i64, i64, i64, i64, i64, i64, i64)
+
+; A leaf function never spills LR, so it is left alone.
+; CHECK-LABEL: leaf:
+; CHECK-NOT: pacib
+; CHECK-NOT: autib
+; CHECK: ret
+define i32 @leaf(i32 %a) {
+  %b = add i32 %a, 1
+  ret i32 %b
+}
+
+; With shrink wrapping, the early return never spills LR and goes without
+; instrumentation, the signing happens at the save point.
+; CHECK-LABEL: shrink:
+; CHECK-NOT: pacib
+; CHECK: cbz w0, [[EXIT:.LBB[0-9_]+]]
+; CHECK: mov [[MOD:x[0-9]+]], sp
+; CHECK-NEXT: movk [[MOD]], #1234, lsl #16
+; CHECK-NEXT: movk [[MOD]], #{{[0-9]+}}, lsl #32
+; CHECK-NEXT: movk [[MOD]], #{{[0-9]+}}, lsl #48
+; CHECK-NEXT: pacib x30, [[MOD]]
+; CHECK-NEXT: str x30, [sp, #-16]!
+; CHECK: bl ext
+; CHECK: ldr x30, [sp], #16
+; CHECK-NEXT: mov [[MOD]], sp
+; CHECK-NEXT: movk [[MOD]], #1234, lsl #16
+; CHECK-NEXT: movk [[MOD]], #{{[0-9]+}}, lsl #32
+; CHECK-NEXT: movk [[MOD]], #{{[0-9]+}}, lsl #48
+; CHECK-NEXT: autib x30, [[MOD]]
+; CHECK-NEXT: [[EXIT]]:
+; CHECK-NOT: autib
+; CHECK: ret
+define i32 @shrink(i32 %a) {
+entry:
+  %c = icmp eq i32 %a, 0
+  br i1 %c, label %exit, label %work
+work:
+  %r = call i32 @ext(i32 %a)
+  %s = add i32 %r, 1
+  br label %exit
+exit:
+  %v = phi i32 [ 0, %entry ], [ %s, %work ]
+  ret i32 %v
+}
+
+; The callee pops the incoming stack arguments, so SP is 16 bytes above its
+; entry value at the tail call and the modifier compensates for it.
+; CHECK-LABEL: pops:
+; CHECK: mov [[MOD:x[0-9]+]], sp
+; CHECK: pacib x30, [[MOD]]
+; CHECK: add sp, sp, #112
+; CHECK-NEXT: sub [[MOD]], sp, #16
+; CHECK-NEXT: movk [[MOD]], #1234, lsl #16
+; CHECK-NEXT: movk [[MOD]], #{{[0-9]+}}, lsl #32
+; CHECK-NEXT: movk [[MOD]], #{{[0-9]+}}, lsl #48
+; CHECK-NEXT: autib x30, [[MOD]]
+; CHECK-NEXT: b callee_stack
+define fastcc void @pops(i64 %a, i64 %b, i64 %c, i64 %d, i64 %e, i64 %f, i64 %g, i64 %h, i64 %i, i64 %j, i64 %k) {
+  %r = call i32 @ext(i32 0)
+  tail call fastcc void @callee_stack(i64 %a, i64 %b, i64 %c, i64 %d, i64 %e, i64 %f, i64 %g, i64 %h, i64 %i)
+  ret void
+}
+
+; Every epilogue authenticates LR after the whole frame is torn down, right
+; before its terminator.
+; CHECK-LABEL: frame:
+; CHECK: pacib x30, [[MOD:x[0-9]+]]
+; CHECK: cbz
+; CHECK: ldp x29, x30, [sp, #80]
+; CHECK: add sp, sp, #96
+; CHECK-NEXT: mov [[MOD]], sp
+; CHECK: autib x30, [[MOD]]
+; CHECK-NEXT: ret
+; CHECK: ldp x29, x30, [sp, #80]
+; CHECK: add sp, sp, #96
+; CHECK-NEXT: mov [[MOD]], sp
+; CHECK: autib x30, [[MOD]]
+; CHECK-NEXT: ret
+define i32 @frame(i32 %a) #0 {
+  %buf = alloca [64 x i8]
+  %p = getelementptr [64 x i8], [64 x i8]* %buf, i64 0, i64 0
+  call void @use(i8* %p)
+  %c = icmp eq i32 %a, 0
+  br i1 %c, label %one, label %two
+one:
+  ret i32 1
+two:
+  %x = call i32 @ext(i32 %a)
+  ret i32 %x
+}
+
+attributes #0 = { "no-frame-pointer-elim"="true" }
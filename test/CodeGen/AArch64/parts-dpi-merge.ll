@@ -0,0 +1,54 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -O2 -parts-dpi -verify-machineinstrs < %s | FileCheck %s
+
+; At -O2 the load/store optimizer pairs the two field accesses. The PARTS
+; types stay on the merged memory operands, and each lane is instrumented
+; with the type of its own field.
+
+%struct.S = type { i64*, i32* }
+
+; CHECK-LABEL: copy:
+; CHECK: ldp [[A:x[0-9]+]], [[B:x[0-9]+]], [x1]
+; CHECK-NEXT: mov [[MOD:x[0-9]+]], #2222
+; CHECK-NEXT: autda [[B]], [[MOD]]
+; CHECK-NEXT: movk [[MOD]], #1111
+; CHECK-NEXT: autda [[A]], [[MOD]]
+; CHECK-NEXT: pacda [[A]], [[MOD]]
+; CHECK-NEXT: movk [[MOD]], #2222
+; CHECK-NEXT: pacda [[B]], [[MOD]]
+; CHECK-NEXT: stp [[A]], [[B]], [x0]
+define void @copy(%struct.S* %d, %struct.S* %s) {
+  %sa = getelementptr %struct.S, %struct.S* %s, i64 0, i32 0
+  %sb = getelementptr %struct.S, %struct.S* %s, i64 0, i32 1
+  %a = load i64*, i64** %sa, !PartsTypeMetadata !0
+  %b = load i32*, i32** %sb, !PartsTypeMetadata !1
+  %da = getelementptr %struct.S, %struct.S* %d, i64 0, i32 0
+  %db = getelementptr %struct.S, %struct.S* %d, i64 0, i32 1
+  store i64* %a, i64** %da, !PartsTypeMetadata !0
+  store i32* %b, i32** %db, !PartsTypeMetadata !1
+  ret void
+}
+
+; The same with the fields accessed in the opposite order, the lanes still
+; get the types of their own fields.
+
+; CHECK-LABEL: copy_swapped:
+; CHECK: ldp [[A:x[0-9]+]], [[B:x[0-9]+]], [x1]
+; CHECK-NEXT: mov [[MOD:x[0-9]+]], #2222
+; CHECK-NEXT: autda [[B]], [[MOD]]
+; CHECK-NEXT: movk [[MOD]], #1111
+; CHECK-NEXT: autda [[A]], [[MOD]]
+; CHECK: stp [[A]], [[B]], [x0]
+define void @copy_swapped(%struct.S* %d, %struct.S* %s) {
+  %sb = getelementptr %struct.S, %struct.S* %s, i64 0, i32 1
+  %sa = getelementptr %struct.S, %struct.S* %s, i64 0, i32 0
+  %b = load i32*, i32** %sb, !PartsTypeMetadata !1
+  %a = load i64*, i64** %sa, !PartsTypeMetadata !0
+  %db = getelementptr %struct.S, %struct.S* %d, i64 0, i32 1
+  %da = getelementptr %struct.S, %struct.S* %d, i64 0, i32 0
+  store i32* %b, i32** %db, !PartsTypeMetadata !1
+  store i64* %a, i64** %da, !PartsTypeMetadata !0
+  ret void
+}
+
+!0 = !{!"PartsTypeMetadata", i64 1111, i8 7}
+!1 = !{!"PartsTypeMetadata", i64 2222, i8 7}
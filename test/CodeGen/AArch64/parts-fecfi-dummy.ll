@@ -0,0 +1,20 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-fecfi -parts-dummy -verify-machineinstrs -O0 < %s \
+; RUN:   | FileCheck %s
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-fecfi -parts-dummy -verify-machineinstrs -O0 \
+; RUN:   -global-isel < %s | FileCheck %s
+
+; The dummy instrumentation replaces the authentication with a chain of EORs
+; on fresh virtual registers, which must be valid for the EOR immediate form.
+
+; CHECK-LABEL: call_fp:
+; CHECK: movk [[MOD:x[0-9]+]], #{{[0-9]+}}, lsl #48
+; CHECK: eor [[T0:x[0-9]+]], {{x[0-9]+}}, #0x
+; CHECK-NEXT: eor [[T1:x[0-9]+]], [[T0]], #0x
+; CHECK-NEXT: eor [[T2:x[0-9]+]], [[T1]], #0x
+; CHECK-NEXT: eor [[PTR:x[0-9]+]], [[T2]], [[MOD]]
+; CHECK-NEXT: blr [[PTR]]
+; CHECK-NOT: blraa
+define i32 @call_fp(i32 (i32)* %fp, i32 %a) {
+  %r = call i32 %fp(i32 %a)
+  ret i32 %r
+}
@@ -0,0 +1,16 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-fecfi -verify-machineinstrs -O0 < %s \
+; RUN:   | FileCheck %s
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-fecfi -verify-machineinstrs -O0 -global-isel < %s \
+; RUN:   | FileCheck %s
+
+; The indirect call authenticates with a modifier held in a register that
+; BLRAA accepts, so it can be neither XZR nor SP.
+
+; CHECK-LABEL: call_fp:
+; CHECK: mov [[MOD:x[0-9]+]], #{{[0-9]+}}
+; CHECK: movk [[MOD]], #{{[0-9]+}}, lsl #48
+; CHECK: blraa {{x[0-9]+}}, [[MOD]]
+define i32 @call_fp(i32 (i32)* %fp, i32 %a) {
+  %r = call i32 %fp(i32 %a)
+  ret i32 %r
+}
@@ -0,0 +1,64 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -O0 -global-isel -stop-after=irtranslator -o - %s \
+; RUN:   | FileCheck %s --check-prefix=IRT
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -O0 -global-isel -stop-after=instruction-select -o - %s \
+; RUN:   | FileCheck %s --check-prefix=SEL
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -O0 -global-isel -parts-dpi -parts-dpi-prera \
+; RUN:   -verify-machineinstrs -o - %s | FileCheck %s --check-prefix=DPI
+
+; GlobalISel carries the PARTS types like the other selectors do.
+
+; IRT: ![[IGNORED:[0-9]+]] = !{!"PartsTypeMetadata", i64 0, i8 8}
+; IRT: ![[FPTYPE:[0-9]+]] = !{!"PartsTypeMetadata", i64 -4951718257567179331, i8 3}
+; IRT: ![[DATA:[0-9]+]] = !{!"PartsTypeMetadata", i64 1234, i8 7}
+
+; The type of a load or store goes to its memory operand, and stays there
+; when the selector turns it into an LDR or STR.
+; IRT-LABEL: name: load_store
+; IRT: G_STORE %1(p0), %0(p0) :: (store 8 into %ir.p, !PartsTypeMetadata ![[DATA]])
+; IRT: G_LOAD %0(p0) :: (load 8 from %ir.p, !PartsTypeMetadata ![[DATA]])
+; SEL-LABEL: name: load_store
+; SEL: STRXui %1, %0, 0 :: (store 8 into %ir.p, !PartsTypeMetadata !{{[0-9]+}})
+; SEL: LDRXui %0, 0 :: (load 8 from %ir.p, !PartsTypeMetadata !{{[0-9]+}})
+; DPI-LABEL: load_store:
+; DPI: mov [[MOD:x[0-9]+]], #1234
+; DPI-NEXT: pacda x1, [[MOD]]
+; DPI-NEXT: str x1, [x0]
+; DPI-NEXT: ldr [[PTR:x[0-9]+]], [x0]
+; DPI-NEXT: mov [[MOD2:x[0-9]+]], #1234
+; DPI-NEXT: autda [[PTR]], [[MOD2]]
+define i64* @load_store(i64** %p, i64* %v) {
+  store i64* %v, i64** %p, !PartsTypeMetadata !2
+  %r = load i64*, i64** %p, !PartsTypeMetadata !2
+  ret i64* %r
+}
+
+; An indirect call gets the type of the called pointer, a direct call is
+; ignored.
+; IRT-LABEL: name: calls
+; IRT: BL @ext, csr_aarch64_aapcs, ![[IGNORED]],
+; IRT: BLR %0(p0), csr_aarch64_aapcs, ![[FPTYPE]],
+define i32 @calls(i32 (i32)* %fp) {
+  call void @ext()
+  %r = call i32 %fp(i32 1)
+  ret i32 %r
+}
+
+; The PA intrinsics on pointers select to the PARTS pseudos.
+; SEL-LABEL: name: intrinsics
+; SEL: [[SIGNED:%[0-9]+]]:gpr64 = PARTS_PACDA %0, %1
+; SEL: PARTS_AUTIA [[SIGNED]], %1
+define i8* @intrinsics(i8* %p, i64 %m) {
+  %a = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 %m)
+  %b = call i8* @llvm.pa.autia.p0i8(i8* %a, i64 %m)
+  ret i8* %b
+}
+
+declare i8* @llvm.pa.pacda.p0i8(i8*, i64)
+declare i8* @llvm.pa.autia.p0i8(i8*, i64)
+declare void @ext()
+
+; The call types, listed so that the MIR printer can refer to them by number
+!parts.test = !{!0, !1}
+!0 = !{!"PartsTypeMetadata", i64 0, i8 8}
+!1 = !{!"PartsTypeMetadata", i64 -4951718257567179331, i8 3}
+!2 = !{!"PartsTypeMetadata", i64 1234, i8 7}
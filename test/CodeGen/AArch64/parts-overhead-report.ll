@@ -0,0 +1,117 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-dpi -parts-overhead-report=%t.yaml \
+; RUN:   -verify-machineinstrs < %s -o /dev/null
+; RUN: FileCheck %s --input-file=%t.yaml
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-dpi -parts-dpi-prera \
+; RUN:   -parts-overhead-report=%t.prera.yaml -verify-machineinstrs < %s -o /dev/null
+; RUN: FileCheck %s --input-file=%t.prera.yaml
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a,+lse -parts-dpi -parts-stats -parts-stats-inline \
+; RUN:   -parts-overhead-report=%t.stats.yaml -verify-machineinstrs < %s -o /dev/null
+; RUN: FileCheck %s --check-prefix=STATS --input-file=%t.stats.yaml
+
+; Only the instructions PARTS emitted are reported. The constant pointer of
+; store_const is materialized by the program and feeds the PACDA, but it is
+; not PARTS overhead.
+
+; CHECK-LABEL: Function: store
+; CHECK-NEXT: TotalCycles:
+; CHECK-NEXT: PartsCycles: 2
+; CHECK-NEXT: Kinds:
+; CHECK-NEXT: - Kind: modifier
+; CHECK-NEXT: Count: 1
+; CHECK-NEXT: Cycles: 1
+; CHECK-NEXT: - Kind: pac
+; CHECK-NEXT: Count: 1
+; CHECK-NEXT: Cycles: 1
+; CHECK-NEXT: Instrs:
+; CHECK-NEXT: - Kind: modifier
+; CHECK-NEXT: Opcode: MOVZXi
+; CHECK-NEXT: Block: 'store:'
+; CHECK-NEXT: LoopDepth: 0
+; CHECK-NEXT: Latency: 1
+; CHECK-NEXT: Frequency: 1
+; CHECK-NEXT: Cycles: 1
+; CHECK-NEXT: - Kind: pac
+; CHECK-NEXT: Opcode: PACDA
+; CHECK: ...
+define void @store(i64** %p, i64* %q) {
+  store i64* %q, i64** %p, !PartsTypeMetadata !0
+  ret void
+}
+
+; CHECK-LABEL: Function: store_const
+; CHECK: PartsCycles: 2
+; CHECK: Instrs:
+; CHECK-NOT: ORRWri
+; CHECK: Opcode: MOVZXi
+; CHECK-NOT: ORRWri
+; CHECK: Opcode: PACDA
+; CHECK-NOT: Opcode
+; CHECK: ...
+define void @store_const(i64** %p) {
+  store i64* inttoptr (i64 4096 to i64*), i64** %p, !PartsTypeMetadata !0
+  ret void
+}
+
+; CHECK-LABEL: Function: load
+; CHECK: PartsCycles: 2
+; CHECK: Instrs:
+; CHECK-NEXT: - Kind: modifier
+; CHECK-NEXT: Opcode: MOVZXi
+; CHECK: - Kind: aut
+; CHECK-NEXT: Opcode: AUTDA
+; CHECK-NOT: Opcode
+; CHECK: ...
+
+; The inline counters around the authentication are reported as such.
+; STATS-LABEL: Function: load
+; STATS: Kinds:
+; STATS-NEXT: - Kind: aut
+; STATS-NEXT: Count: 1
+; STATS: - Kind: counter
+; STATS-NEXT: Count: 12
+; STATS: - Kind: modifier
+; STATS-NEXT: Count: 1
+; STATS: Instrs:
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: STPXpre
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: ADRP
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: ADDXri
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: MOVZXi
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: LDADDX
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: LDPXpost
+; STATS: - Kind: modifier
+; STATS: - Kind: aut
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: STPXpre
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: ADRP
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: ADDXri
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: MOVZXi
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: LDADDX
+; STATS: - Kind: counter
+; STATS-NEXT: Opcode: LDPXpost
+define i64* @load(i64** %p) {
+  %q = load i64*, i64** %p, !PartsTypeMetadata !0
+  ret i64* %q
+}
+
+; CHECK-LABEL: Function: plain
+; CHECK-NEXT: TotalCycles:
+; CHECK-NEXT: PartsCycles: 0
+; CHECK-NEXT: Kinds:{{ *$}}
+; CHECK-NEXT: Instrs:{{ *$}}
+; CHECK-NEXT: ...
+define i64* @plain(i64** %p) {
+  %q = load i64*, i64** %p
+  ret i64* %q
+}
+
+!0 = !{!"PartsTypeMetadata", i64 1111, i8 7}
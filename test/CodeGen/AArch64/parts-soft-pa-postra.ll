@@ -0,0 +1,36 @@
+; RUN: not llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-soft-pa -parts-becfi < %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=BECFI
+; RUN: not llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-soft-pa -parts-dpi < %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=DPI
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-soft-pa -parts-dpi -parts-dpi-prera \
+; RUN:     -verify-machineinstrs < %s | FileCheck %s --check-prefix=PRERA
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-soft-pa -parts-dummy -parts-becfi \
+; RUN:     -verify-machineinstrs < %s | FileCheck %s --check-prefix=DUMMY
+
+; BeCFI and the post-RA DPI pass sign after register allocation, where the
+; soft PA helpers cannot be called. Without -parts-dummy, llc must refuse
+; instead of quietly emitting the unsigned dummy sequence.
+
+; BECFI: LLVM ERROR: -parts-soft-pa does not support -parts-becfi
+; DPI: LLVM ERROR: -parts-soft-pa requires -parts-dpi-prera for -parts-dpi
+
+%struct.node = type { %struct.node*, i64 }
+
+declare void @other()
+
+; PRERA-LABEL: next:
+; PRERA: bl __parts_soft_autda
+; PRERA: __parts_soft_autda:
+; DUMMY-LABEL: next:
+; DUMMY-NOT: pacib
+; DUMMY: eor
+define %struct.node* @next(%struct.node** %pp) {
+  %p = load %struct.node*, %struct.node** %pp, !PartsTypeMetadata !0
+  call void @other()
+  %np = getelementptr inbounds %struct.node, %struct.node* %p, i64 0, i32 0
+  %n = load %struct.node*, %struct.node** %np
+  ret %struct.node* %n
+}
+
+; A known data pointer, see PartsTypeMetadata::Flags
+!0 = !{!"PartsTypeMetadata", i64 1234, i8 7}
@@ -0,0 +1,20 @@
+; RUN: not llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-soft-pa < %s 2>&1 | FileCheck %s
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-soft-pa -parts-dummy < %s \
+; RUN:   | FileCheck %s --check-prefix=DUMMY
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a < %s | FileCheck %s --check-prefix=PA
+
+; Without the IR lowering, -parts-soft-pa has no way to sign the pointer
+; after register allocation and must not quietly leave it unsigned.
+
+; CHECK: LLVM ERROR: PARTS PA pseudo left for expansion with -parts-soft-pa
+; DUMMY-LABEL: sign:
+; DUMMY-NOT: pacda
+; DUMMY: ret
+; PA-LABEL: sign:
+; PA: pacda x0, x1
+define i8* @sign(i8* %p, i64 %mod) {
+  %r = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 %mod)
+  ret i8* %r
+}
+
+declare i8* @llvm.pa.pacda.p0i8(i8*, i64)
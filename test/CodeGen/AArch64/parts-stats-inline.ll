@@ -0,0 +1,28 @@
+; RUN: llc -mtriple=aarch64-none-linux-gnu -mattr=+v8.3a -parts-dpi -parts-stats -parts-stats-inline -O0 \
+; RUN:     -verify-machineinstrs < %s \
+; RUN:   | FileCheck %s
+
+; The counter array and its constructor are created on IR, so the constructor
+; is compiled and registered like any other function.
+
+%struct.node = type { %struct.node*, i64 }
+
+; CHECK-LABEL: next:
+; CHECK: stp x16, x17, [sp, #-16]!
+; CHECK-NEXT: adrp x16, __parts_counters+{{[0-9]+}}
+; CHECK-NEXT: add x16, x16, :lo12:__parts_counters+{{[0-9]+}}
+; CHECK: ldp x16, x17, [sp], #16
+define %struct.node* @next(%struct.node* %n) {
+  %np = getelementptr inbounds %struct.node, %struct.node* %n, i64 0, i32 0
+  %next = load %struct.node*, %struct.node** %np
+  ret %struct.node* %next
+}
+
+; CHECK-LABEL: __parts_counters_ctor:
+; CHECK-NOT: __parts_counters+
+; CHECK: bl __parts_counters_register
+; CHECK: .section parts_counters,"aw",@progbits
+; CHECK: __parts_counters:
+; CHECK: .section .init_array,"aw",@init_array
+; CHECK-NEXT: .p2align 3
+; CHECK-NEXT: .xword __parts_counters_ctor
@@ -0,0 +1,80 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-dpi-escape-analysis \
+; RUN:   -ptr-type-md-pass -S | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -ptr-type-md-pass -S \
+; RUN:   | FileCheck %s --check-prefix=OFF
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-dpi-escape-analysis \
+; RUN:   -ptr-type-md-pass | llc -mattr=+v8.3a -parts-dpi -verify-machineinstrs | FileCheck %s --check-prefix=ASM
+; REQUIRES: loadable_module, aarch64-registered-target
+
+; Pointers kept in a stack slot that never escapes cannot be reached by an
+; attacker, their loads and stores are marked ignored. Every other data
+; pointer access is still instrumented.
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+declare void @clobber()
+declare void @escape(i64**)
+
+; CHECK-LABEL: define i64* @local(
+; CHECK: store i64* %p, i64** %slot, !PartsTypeMetadata [[IGNORED:![0-9]+]]
+; CHECK: load i64*, i64** %slot, !PartsTypeMetadata [[IGNORED]]
+; OFF-LABEL: define i64* @local(
+; OFF: store i64* %p, i64** %slot, !PartsTypeMetadata [[DATA:![0-9]+]]
+; OFF: load i64*, i64** %slot, !PartsTypeMetadata [[DATA]]
+; ASM-LABEL: local:
+; ASM-NOT: pacda
+; ASM-NOT: autda
+; ASM: ret
+define i64* @local(i64* %p) {
+  %slot = alloca i64*
+  store i64* %p, i64** %slot
+  call void @clobber()
+  %r = load i64*, i64** %slot
+  ret i64* %r
+}
+
+; CHECK-LABEL: define i64* @escaped(
+; CHECK: store i64* %p, i64** %slot, !PartsTypeMetadata [[DATA:![0-9]+]]
+; CHECK: load i64*, i64** %slot, !PartsTypeMetadata [[DATA]]
+; ASM-LABEL: escaped:
+; ASM: pacda
+; ASM: bl escape
+; ASM: autda
+define i64* @escaped(i64* %p) {
+  %slot = alloca i64*
+  store i64* %p, i64** %slot
+  call void @escape(i64** %slot)
+  %r = load i64*, i64** %slot
+  ret i64* %r
+}
+
+; Capture tracking treats volatile accesses as making the slot observable.
+; CHECK-LABEL: define void @volatile_slot(
+; CHECK: store volatile i64* %p, i64** %slot, !PartsTypeMetadata [[DATA]]
+define void @volatile_slot(i64* %p) {
+  %slot = alloca i64*
+  store volatile i64* %p, i64** %slot
+  ret void
+}
+
+; The slot may be mixed with the caller's memory through the select.
+; CHECK-LABEL: define void @selected(
+; CHECK: store i64* %p, i64** %addr, !PartsTypeMetadata [[DATA]]
+define void @selected(i64* %p, i64** %other, i1 %c) {
+  %slot = alloca i64*
+  %addr = select i1 %c, i64** %slot, i64** %other
+  store i64* %p, i64** %addr
+  ret void
+}
+
+; CHECK-LABEL: define void @heap(
+; CHECK: store i64* %p, i64** %q, !PartsTypeMetadata [[DATA]]
+define void @heap(i64* %p, i64** %q) {
+  store i64* %p, i64** %q
+  ret void
+}
+
+; CHECK-DAG: [[IGNORED]] = !{!"PartsTypeMetadata", i64 {{-?[0-9]+}}, i8 15}
+; CHECK-DAG: [[DATA]] = !{!"PartsTypeMetadata", i64 {{-?[0-9]+}}, i8 7}
+; OFF: [[DATA]] = !{!"PartsTypeMetadata", i64 {{-?[0-9]+}}, i8 7}
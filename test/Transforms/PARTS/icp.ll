@@ -0,0 +1,64 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-fecfi -parts-icp-pass -S | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-fecfi -parts-whole-program -parts-icp-pass -parts-cfi-types -parts-fecfi-pass -S | FileCheck %s --check-prefix=CPI
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-fecfi -parts-icp-pass -parts-cfi-types -parts-fecfi-pass -S | FileCheck %s --check-prefix=NOWP
+; REQUIRES: loadable_module
+
+@handler = global void (i32)* null
+@callback = global i32 (i8*)* null
+
+define void @one(i32 %x) {
+  ret void
+}
+
+define void @two(i32 %x) {
+  ret void
+}
+
+define i32 @never_called(i8* %p) {
+  ret i32 0
+}
+
+define void @init() {
+  store void (i32)* @one, void (i32)** @handler
+  store void (i32)* @two, void (i32)** @handler
+  store i32 (i8*)* @never_called, i32 (i8*)** @callback
+  ret void
+}
+
+; The pointer is authenticated once and compared against both candidates
+; CHECK-LABEL: @dispatch(
+; CHECK: %fp = load void (i32)*, void (i32)** @handler
+; CHECK: [[AUT:%.*]] = call void (i32)* @llvm.pa.autia.p0f_isVoidi32f(void (i32)* %fp, i64
+; CHECK-DAG: icmp eq void (i32)* [[AUT]], @one
+; CHECK-DAG: icmp eq void (i32)* [[AUT]], @two
+; CHECK-DAG: call void @one(i32 %x)
+; CHECK-DAG: call void @two(i32 %x)
+; CHECK-DAG: call void [[AUT]](i32 %x)
+define void @dispatch(i32 %x) {
+  %fp = load void (i32)*, void (i32)** @handler
+  call void %fp(i32 %x)
+  ret void
+}
+
+; Nothing of this type has its address taken in the module
+; CHECK-LABEL: @no_targets(
+; CHECK-NOT: @llvm.pa.
+; CHECK: call void %fp(i8* null)
+define void @no_targets(void (i8*)* %fp) {
+  call void %fp(i8* null)
+  ret void
+}
+
+; Only the type that is called indirectly is PACed at its address-take
+; CPI-LABEL: @init(
+; CPI: call void (i32)* @llvm.pa.pacia.p0f_isVoidi32f(void (i32)* @one
+; CPI: call void (i32)* @llvm.pa.pacia.p0f_isVoidi32f(void (i32)* @two
+; CPI-NOT: @llvm.pa.pacia
+; CPI: store i32 (i8*)* @never_called, i32 (i8*)** @callback
+
+; Without -parts-whole-program the module could pass any code pointer on, so all are PACed
+; NOWP-LABEL: @init(
+; NOWP: call void (i32)* @llvm.pa.pacia.p0f_isVoidi32f(void (i32)* @one
+; NOWP: call void (i32)* @llvm.pa.pacia.p0f_isVoidi32f(void (i32)* @two
+; NOWP: [[NC:%.*]] = call i32 (i8*)* @llvm.pa.pacia.p0f_i32p0i8f(i32 (i8*)* @never_called
+; NOWP: store i32 (i8*)* [[NC]], i32 (i8*)** @callback
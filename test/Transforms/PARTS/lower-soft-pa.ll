@@ -0,0 +1,49 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-lower-soft-pa -S | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-lower-soft-pa -S -mtriple=x86_64-unknown-linux-gnu | FileCheck %s
+; REQUIRES: loadable_module
+
+declare i8* @llvm.pa.pacda.p0i8(i8*, i64)
+declare i8* @llvm.pa.autda.p0i8(i8*, i64)
+declare void ()* @llvm.pa.pacia.p0f_isVoidf(void ()*, i64)
+declare void ()* @llvm.pa.autia.p0f_isVoidf(void ()*, i64)
+
+; CHECK: @__parts_soft_pa_keys = weak global [4 x i64]
+
+; CHECK-LABEL: @data(
+; CHECK-NOT: @llvm.pa.
+; CHECK: [[P:%.*]] = ptrtoint i8* %p to i64
+; CHECK: [[S:%.*]] = call i64 @__parts_soft_pacda(i64 [[P]], i64 42)
+; CHECK: [[PAC:%.*]] = inttoptr i64 [[S]] to i8*
+; CHECK: [[Q:%.*]] = ptrtoint i8* [[PAC]] to i64
+; CHECK: [[A:%.*]] = call i64 @__parts_soft_autda(i64 [[Q]], i64 42)
+; CHECK: [[AUT:%.*]] = inttoptr i64 [[A]] to i8*
+; CHECK: ret i8* [[AUT]]
+define i8* @data(i8* %p) {
+  %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %pac, i64 42)
+  ret i8* %aut
+}
+
+; CHECK-LABEL: @code(
+; CHECK-NOT: @llvm.pa.
+; CHECK: call i64 @__parts_soft_pacia(
+; CHECK: call i64 @__parts_soft_autia(
+; CHECK: call void %
+define void @code(void ()* %f, i64 %mod) {
+  %pac = call void ()* @llvm.pa.pacia.p0f_isVoidf(void ()* %f, i64 %mod)
+  %aut = call void ()* @llvm.pa.autia.p0f_isVoidf(void ()* %pac, i64 %mod)
+  call void %aut()
+  ret void
+}
+
+; CHECK: define linkonce_odr hidden i64 @__parts_soft_computepac(i64, i64, i64, i64) [[CATTR:#[0-9]+]]
+; CHECK: define linkonce_odr hidden i64 @__parts_soft_pacda(i64, i64) [[HATTR:#[0-9]+]]
+; CHECK: load i64, i64* getelementptr inbounds ([4 x i64], [4 x i64]* @__parts_soft_pa_keys, i64 0, i64 2)
+; CHECK: load i64, i64* getelementptr inbounds ([4 x i64], [4 x i64]* @__parts_soft_pa_keys, i64 0, i64 3)
+; CHECK: call i64 @__parts_soft_computepac(
+; CHECK: define linkonce_odr hidden i64 @__parts_soft_autda(i64, i64)
+; CHECK: define linkonce_odr hidden i64 @__parts_soft_pacia(i64, i64)
+; CHECK: define linkonce_odr hidden i64 @__parts_soft_autia(i64, i64)
+
+; CHECK: attributes [[CATTR]] = { noinline nounwind readnone "no-parts"="true" }
+; CHECK: attributes [[HATTR]] = { nounwind readonly "no-parts"="true" }
@@ -0,0 +1,58 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-lto2 run %t.bc -o %t.o -save-temps -O2 -mattr=+v8.3a -parts-fecfi -parts-whole-program \
+; RUN:   -load-pass-plugin=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext \
+; RUN:   -r %t.bc,one,plx -r %t.bc,never_called,plx -r %t.bc,init,plx -r %t.bc,dispatch,plx \
+; RUN:   -r %t.bc,handler,plx -r %t.bc,callback,plx -r %t.bc,ext,
+; RUN: llvm-dis %t.o.0.4.opt.bc -o - | FileCheck %s
+; RUN: llvm-lto2 run %t.bc -o %t.off.o -save-temps -O2 -mattr=+v8.3a -parts-fecfi -parts-pipeline=false \
+; RUN:   -load-pass-plugin=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext \
+; RUN:   -r %t.bc,one,plx -r %t.bc,never_called,plx -r %t.bc,init,plx -r %t.bc,dispatch,plx \
+; RUN:   -r %t.bc,handler,plx -r %t.bc,callback,plx -r %t.bc,ext,
+; RUN: llvm-dis %t.off.o.0.4.opt.bc -o - | FileCheck %s --check-prefix=OFF
+; REQUIRES: loadable_module, aarch64-registered-target
+
+; Loaded into the LTO backend, the plugin promotes the indirect call at
+; LTO-Early and instruments the merged module at LTO-Last.
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+@handler = global void (i32)* null
+@callback = global i32 (i8*)* null
+
+declare void @ext(i32)
+
+define void @one(i32 %x) {
+  call void @ext(i32 %x)
+  ret void
+}
+
+define i32 @never_called(i8* %p) {
+  ret i32 0
+}
+
+; Only the type that is called indirectly is PACed
+; CHECK-LABEL: define {{.*}}void @init(
+; CHECK: call void (i32)* @llvm.pa.pacia.p0f_isVoidi32f(void (i32)* @one
+; CHECK-NOT: @llvm.pa.pacia
+; CHECK: store i32 (i8*)* @never_called, i32 (i8*)** @callback
+; OFF-LABEL: define {{.*}}void @init(
+; OFF-NOT: @llvm.pa.
+define void @init() {
+  store void (i32)* @one, void (i32)** @handler
+  store i32 (i8*)* @never_called, i32 (i8*)** @callback
+  ret void
+}
+
+; CHECK-LABEL: define {{.*}}void @dispatch(
+; CHECK: [[AUT:%.*]] = call void (i32)* @llvm.pa.autia.p0f_isVoidi32f(void (i32)* %fp, i64
+; CHECK: icmp eq void (i32)* [[AUT]], @one
+; CHECK: call void [[AUT]](i32 %x)
+; OFF-LABEL: define {{.*}}void @dispatch(
+; OFF-NOT: @llvm.pa.
+; OFF: call void %fp(i32 %x)
+define void @dispatch(i32 %x) {
+  %fp = load void (i32)*, void (i32)** @handler
+  call void %fp(i32 %x)
+  ret void
+}
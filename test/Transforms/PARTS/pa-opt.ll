@@ -0,0 +1,159 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-pa-opt -S | FileCheck %s
+; REQUIRES: loadable_module
+
+declare i8* @llvm.pa.pacda.p0i8(i8*, i64)
+declare i8* @llvm.pa.autda.p0i8(i8*, i64)
+declare i8* @llvm.pa.pacia.p0i8(i8*, i64)
+declare i8* @llvm.pa.autia.p0i8(i8*, i64)
+declare void @use(i8*)
+
+; CHECK-LABEL: @fold_aut_of_pac(
+; CHECK-NOT: @llvm.pa.
+; CHECK: ret i8* %p
+define i8* @fold_aut_of_pac(i8* %p) {
+  %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %pac, i64 42)
+  ret i8* %aut
+}
+
+; The modifiers differ, so the AUT is expected to fail and must stay
+; CHECK-LABEL: @no_fold_modifier_mismatch(
+; CHECK: call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+; CHECK: call i8* @llvm.pa.autda.p0i8(i8* %pac, i64 43)
+define i8* @no_fold_modifier_mismatch(i8* %p) {
+  %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %pac, i64 43)
+  ret i8* %aut
+}
+
+; Instruction and data keys are not interchangeable
+; CHECK-LABEL: @no_fold_key_mismatch(
+; CHECK: call i8* @llvm.pa.pacia.p0i8(i8* %p, i64 42)
+; CHECK: call i8* @llvm.pa.autda.p0i8(i8* %pac, i64 42)
+define i8* @no_fold_key_mismatch(i8* %p) {
+  %pac = call i8* @llvm.pa.pacia.p0i8(i8* %p, i64 42)
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %pac, i64 42)
+  ret i8* %aut
+}
+
+; pac(aut(p)) is not an identity, p might not carry a valid PAC
+; CHECK-LABEL: @no_fold_pac_of_aut(
+; CHECK: call i8* @llvm.pa.autda.p0i8(i8* %p, i64 42)
+; CHECK: call i8* @llvm.pa.pacda.p0i8(i8* %aut, i64 42)
+define i8* @no_fold_pac_of_aut(i8* %p) {
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %p, i64 42)
+  %pac = call i8* @llvm.pa.pacda.p0i8(i8* %aut, i64 42)
+  ret i8* %pac
+}
+
+; CHECK-LABEL: @cse_pac(
+; CHECK: %pac1 = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+; CHECK-NOT: @llvm.pa.pacda
+; CHECK: store i8* %pac1, i8** %b
+define void @cse_pac(i8* %p, i8** %a, i8** %b) {
+  %pac1 = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  store i8* %pac1, i8** %a
+  %pac2 = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  store i8* %pac2, i8** %b
+  ret void
+}
+
+; Neither block dominates the other
+; CHECK-LABEL: @no_cse_siblings(
+; CHECK: then:
+; CHECK: call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+; CHECK: else:
+; CHECK: call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+define void @no_cse_siblings(i1 %c, i8* %p, i8** %a) {
+entry:
+  br i1 %c, label %then, label %else
+then:
+  %pac1 = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  store i8* %pac1, i8** %a
+  br label %exit
+else:
+  %pac2 = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  store i8* %pac2, i8** %a
+  br label %exit
+exit:
+  ret void
+}
+
+; CHECK-LABEL: @hoist_invariant_aut(
+; CHECK: entry:
+; CHECK-NEXT: %raw = load i8*, i8** %a
+; CHECK-NEXT: %aut = call i8* @llvm.pa.autda.p0i8(i8* %raw, i64 42)
+; CHECK: loop:
+; CHECK-NOT: @llvm.pa.
+; CHECK: exit:
+define void @hoist_invariant_aut(i8** %a, i32 %n) {
+entry:
+  %raw = load i8*, i8** %a
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %raw, i64 42)
+  call void @use(i8* %aut)
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+exit:
+  ret void
+}
+
+; The loaded pointer changes every iteration
+; CHECK-LABEL: @no_hoist_variant_aut(
+; CHECK: loop:
+; CHECK: call i8* @llvm.pa.autda.p0i8(i8* %raw, i64 42)
+define void @no_hoist_variant_aut(i8** %a, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %addr = getelementptr i8*, i8** %a, i32 %i
+  %raw = load i8*, i8** %addr
+  %aut = call i8* @llvm.pa.autda.p0i8(i8* %raw, i64 42)
+  call void @use(i8* %aut)
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+exit:
+  ret void
+}
+
+; CHECK-LABEL: @sink_cold_pac(
+; CHECK: entry:
+; CHECK-NOT: @llvm.pa.
+; CHECK: cold:
+; CHECK-NEXT: %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+; CHECK-NEXT: store i8* %pac, i8** %a
+define void @sink_cold_pac(i1 %c, i8* %p, i8** %a) {
+entry:
+  %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  br i1 %c, label %cold, label %exit, !prof !0
+cold:
+  store i8* %pac, i8** %a
+  br label %exit
+exit:
+  ret void
+}
+
+; Users in more than one block keep the PAC in place
+; CHECK-LABEL: @no_sink_multiple_blocks(
+; CHECK: entry:
+; CHECK-NEXT: %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+define void @no_sink_multiple_blocks(i1 %c, i8* %p, i8** %a) {
+entry:
+  %pac = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 42)
+  br i1 %c, label %cold, label %hot, !prof !0
+cold:
+  store i8* %pac, i8** %a
+  br label %exit
+hot:
+  store volatile i8* %pac, i8** %a
+  br label %exit
+exit:
+  ret void
+}
+
+!0 = !{!"branch_weights", i32 1, i32 1000}
@@ -0,0 +1,100 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-lazy-globals -pauth-markglobals -S \
+; RUN:   | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -pauth-markglobals -S \
+; RUN:   | FileCheck %s --check-prefix=EAGER
+; REQUIRES: loadable_module
+
+; With -parts-lazy-globals an internal global only accessed by loads and
+; stores in this module is PACed on first use. Each block that accesses it
+; checks the guard once. Globals that other code can reach are still PACed
+; at startup.
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+@x = global i64 0
+@lazy = internal global i64* @x
+@external = global i64* @x
+@escaped = internal global i64* @x
+
+; CHECK: [[GUARD:@__pauth_pac_guard.lazy]] = internal global i32 0, align 4
+; CHECK: [[LAZY_TABLE:@__pauth_pac_table[.0-9]*]] = private constant [1 x { i8**, i64 }]
+; CHECK-SAME: [{ i8**, i64 } { i8** bitcast (i64** @lazy to i8**), i64 {{-?[0-9]+}} }]
+; CHECK: [[TABLE:@__pauth_pac_table[.0-9]*]] = private constant [2 x { i8**, i64 }]
+; CHECK-SAME: @external
+; CHECK-SAME: @escaped
+
+; EAGER-NOT: @__pauth_pac_guard
+; EAGER: @__pauth_pac_table = private constant [3 x { i8**, i64 }]
+; EAGER-NOT: @__pauth_pac_init
+
+; CHECK-LABEL: define i64 @use(i1 %c)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: [[STATE:%.*]] = load atomic i32, i32* [[GUARD]] acquire, align 4
+; CHECK-NEXT: [[UNINIT:%.*]] = icmp ne i32 [[STATE]], 2
+; CHECK-NEXT: br i1 [[UNINIT]], label %[[INIT:.*]], label %[[CONT:.*]], !prof [[COLD:![0-9]+]]
+; CHECK: [[INIT]]:
+; CHECK-NEXT: call void @__pauth_pac_init.lazy()
+; CHECK-NEXT: br label %[[CONT]]
+; CHECK: [[CONT]]:
+; CHECK-NEXT: %p = load i64*, i64** @lazy
+; CHECK-NEXT: store i64* %p, i64** @lazy
+; CHECK-NEXT: %v = load i64, i64* %p
+; CHECK: again:
+; CHECK-NEXT: load atomic i32, i32* [[GUARD]] acquire
+; CHECK: call void @__pauth_pac_init.lazy()
+; CHECK: %p2 = load i64*, i64** @lazy
+; CHECK-NEXT: %e = load i64*, i64** @external
+; CHECK: out:
+; CHECK-NEXT: ret i64 %v
+define i64 @use(i1 %c) {
+entry:
+  %p = load i64*, i64** @lazy
+  store i64* %p, i64** @lazy
+  %v = load i64, i64* %p
+  br i1 %c, label %again, label %out
+
+again:
+  %p2 = load i64*, i64** @lazy
+  %e = load i64*, i64** @external
+  br label %out
+
+out:
+  ret i64 %v
+}
+
+; Storing the address of @escaped lets it be accessed unchecked.
+define void @leak(i64*** %out) {
+  store i64** @escaped, i64*** %out
+  ret void
+}
+
+; CHECK-LABEL: define i32 @main()
+; CHECK-NEXT: call void @__pauth_pac_globals()
+define i32 @main() {
+  ret i32 0
+}
+
+; CHECK-LABEL: define void @__pauth_pac_globals()
+; CHECK: [2 x { i8**, i64 }]* [[TABLE]],
+; CHECK-NOT: [[LAZY_TABLE]],
+; CHECK: ret void
+
+; The first caller PACs, the others wait until the guard reaches 2.
+; CHECK-LABEL: define internal void @__pauth_pac_init.lazy()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: [[CAS:%.*]] = cmpxchg i32* [[GUARD]], i32 0, i32 1 acq_rel acquire
+; CHECK-NEXT: [[WON:%.*]] = extractvalue { i32, i1 } [[CAS]], 1
+; CHECK-NEXT: br i1 [[WON]], label %first, label %wait
+; CHECK: wait:
+; CHECK-NEXT: [[STATE:%.*]] = load atomic i32, i32* [[GUARD]] acquire, align 4
+; CHECK-NEXT: [[READY:%.*]] = icmp eq i32 [[STATE]], 2
+; CHECK-NEXT: br i1 [[READY]], label %done, label %wait
+; CHECK: first:
+; CHECK: [1 x { i8**, i64 }]* [[LAZY_TABLE]],
+; CHECK: call i8* @llvm.pa.pacda.p0i8(
+; CHECK: store atomic i32 2, i32* [[GUARD]] release, align 4
+; CHECK-NEXT: ret void
+
+; CHECK: attributes #{{[0-9]+}} = { cold noinline "no-parts"="true" }
+; CHECK: [[COLD]] = !{!"branch_weights", i32 1, i32 1048576}
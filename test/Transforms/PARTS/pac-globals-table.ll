@@ -0,0 +1,76 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -pauth-markglobals -S \
+; RUN:   | FileCheck %s
+; REQUIRES: loadable_module
+
+; Global pointers are PACed at startup by one loop per table, however many
+; there are. The data table is sorted by type_id, so @r comes before @q and
+; consecutive entries share a modifier.
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+@x = global i64 0
+@y = global i32 0
+@p = global i64* @x
+@q = global i32* @y
+@r = global i64* @x
+@arr = global [2 x i32*] [i32* @y, i32* @y]
+@fp = global void ()* @f
+
+; CHECK: [[CODE:@__pauth_pac_table[.0-9]*]] = private constant [1 x { i8**, i64 }]
+; CHECK-SAME: [{ i8**, i64 } { i8** bitcast (void ()** @fp to i8**), i64 {{-?[0-9]+}} }]
+; CHECK-SAME: section "parts_pac_globals_code"
+; CHECK: [[DATA:@__pauth_pac_table[.0-9]*]] = private constant [5 x { i8**, i64 }]
+; CHECK-SAME: [{ i8**, i64 } { i8** bitcast (i64** @p to i8**), i64 -8191765227735112811 },
+; CHECK-SAME: { i8**, i64 } { i8** bitcast (i64** @r to i8**), i64 -8191765227735112811 },
+; CHECK-SAME: { i8**, i64 } { i8** bitcast (i32** @q to i8**), i64 -8185456244599606628 },
+; CHECK-SAME: { i8**, i64 } { i8** bitcast ([2 x i32*]* @arr to i8**), i64 -8185456244599606628 },
+; CHECK-SAME: { i8**, i64 } { i8** bitcast (i32** getelementptr inbounds ([2 x i32*], [2 x i32*]* @arr, i64 0, i64 1) to i8**), i64 -8185456244599606628 }]
+; CHECK-SAME: section "parts_pac_globals_data"
+
+define void @f() {
+  ret void
+}
+
+define void @call() {
+  %f = load void ()*, void ()** @fp
+  call void %f()
+  ret void
+}
+
+; CHECK-LABEL: define i32 @main()
+; CHECK-NEXT: call void @__pauth_pac_globals()
+define i32 @main() {
+  call void @call()
+  ret i32 0
+}
+
+; CHECK-LABEL: define void @__pauth_pac_globals()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: br label %[[CODE_LOOP:.*]]
+; CHECK: [[CODE_LOOP]]:
+; CHECK-NEXT: [[I:%.*]] = phi i64 [ 0, %entry ], [ [[NEXT:%.*]], %[[CODE_LOOP]] ]
+; CHECK-NEXT: [[ADDR_P:%.*]] = getelementptr inbounds [1 x { i8**, i64 }], [1 x { i8**, i64 }]* [[CODE]], i64 0, i64 [[I]], i32 0
+; CHECK-NEXT: [[ADDR:%.*]] = load i8**, i8*** [[ADDR_P]]
+; CHECK-NEXT: [[ID_P:%.*]] = getelementptr inbounds [1 x { i8**, i64 }], [1 x { i8**, i64 }]* [[CODE]], i64 0, i64 [[I]], i32 1
+; CHECK-NEXT: [[ID:%.*]] = load i64, i64* [[ID_P]]
+; CHECK-NEXT: [[PTR:%.*]] = load i8*, i8** [[ADDR]]
+; CHECK-NEXT: [[PACED:%.*]] = call i8* @llvm.pa.pacia.p0i8(i8* [[PTR]], i64 [[ID]])
+; CHECK-NEXT: store i8* [[PACED]], i8** [[ADDR]]
+; CHECK-NEXT: [[NEXT]] = add nuw nsw i64 [[I]], 1
+; CHECK-NEXT: [[DONE:%.*]] = icmp eq i64 [[NEXT]], 1
+; CHECK-NEXT: br i1 [[DONE]], label %[[CODE_EXIT:.*]], label %[[CODE_LOOP]]
+; CHECK: [[CODE_EXIT]]:
+; CHECK-NEXT: br label %[[DATA_LOOP:.*]]
+; CHECK: [[DATA_LOOP]]:
+; CHECK-NEXT: [[I:%.*]] = phi i64 [ 0, %[[CODE_EXIT]] ], [ [[NEXT:%.*]], %[[DATA_LOOP]] ]
+; CHECK: getelementptr inbounds [5 x { i8**, i64 }], [5 x { i8**, i64 }]* [[DATA]], i64 0, i64 [[I]], i32 0
+; CHECK: getelementptr inbounds [5 x { i8**, i64 }], [5 x { i8**, i64 }]* [[DATA]], i64 0, i64 [[I]], i32 1
+; CHECK: call i8* @llvm.pa.pacda.p0i8(
+; CHECK: [[NEXT]] = add nuw nsw i64 [[I]], 1
+; CHECK-NEXT: [[DONE:%.*]] = icmp eq i64 [[NEXT]], 5
+; CHECK-NEXT: br i1 [[DONE]], label %[[DATA_EXIT:.*]], label %[[DATA_LOOP]]
+; CHECK: [[DATA_EXIT]]:
+; CHECK-NEXT: ret void
+; CHECK-NOT: call i8* @llvm.pa.
+; CHECK: attributes #{{[0-9]+}} = { "constructor"="true" "no-parts"="true" }
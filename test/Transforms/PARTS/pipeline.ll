@@ -0,0 +1,44 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -O0 -S | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -O1 -S | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -O2 -S | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -O2 -parts-pipeline=false -S \
+; RUN:   | FileCheck %s --check-prefix=OFF
+; REQUIRES: loadable_module
+
+; The registered pipeline runs after the -O passes, the startup code it adds
+; must survive them.
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+%struct.node = type { %struct.node*, i64 }
+
+@head = global %struct.node* null
+@handler = global void (i32)* null
+
+declare void @callee(i32)
+declare void @use(%struct.node*, void (i32)*)
+
+; CHECK: @__pauth_pac_table{{.*}} @handler {{.*}} section "parts_pac_globals_code"
+; CHECK: @__pauth_pac_table{{.*}} @head {{.*}} section "parts_pac_globals_data"
+
+; CHECK-LABEL: define i32 @main(i32 %argc, i8** %argv)
+; CHECK-NEXT: call void @__pauth_pac_main_args(i32 %argc, i8** %argv, i64 {{-?[0-9]+}})
+; CHECK-NEXT: call void @__pauth_pac_globals()
+; CHECK: @llvm.pa.pacia
+; OFF-LABEL: define i32 @main(
+; OFF-NOT: @__pauth
+; OFF-NOT: @llvm.pa.
+; OFF: ret i32
+define i32 @main(i32 %argc, i8** %argv) {
+  store void (i32)* @callee, void (i32)** @handler
+  %h = load %struct.node*, %struct.node** @head
+  %f = load void (i32)*, void (i32)** @handler
+  call void @use(%struct.node* %h, void (i32)* %f)
+  ret i32 0
+}
+
+; CHECK: define void @__pauth_pac_globals()
+; CHECK: @llvm.pa.pacia.p0i8
+; CHECK: @llvm.pa.pacda.p0i8
+; CHECK: declare void @__pauth_pac_main_args(i32, i8**, i64)
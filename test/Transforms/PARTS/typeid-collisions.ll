@@ -0,0 +1,26 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -parts-typeid-collisions -O2 \
+; RUN:   -debug-pass=Structure -S -o /dev/null 2>&1 | FileCheck %s
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-fecfi -O2 -debug-pass=Structure \
+; RUN:   -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=OFF
+; REQUIRES: loadable_module
+
+; With -parts-typeid-collisions the registered pipeline checks all pointer
+; types of the module before they are instrumented. None of the distinct
+; types below share a type_id, so no collision is reported.
+
+; CHECK: PARTS type_id collision detector
+; CHECK: Pointer Type Metadata Pass
+; CHECK-NOT: warning:
+; OFF-NOT: PARTS type_id collision detector
+
+%struct.node = type { %struct.node*, i64 }
+
+@head = global %struct.node* null
+@handler = global void (i32)* null
+
+define void @f(i64* %a, i32* %b, i8** %c, %struct.node* %n, void (i32)* %fp) {
+  store %struct.node* %n, %struct.node** @head
+  store void (i32)* %fp, void (i32)** @handler
+  call void %fp(i32 0)
+  ret void
+}
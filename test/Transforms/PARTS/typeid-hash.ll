@@ -0,0 +1,34 @@
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -ptr-type-md-pass -S \
+; RUN:   | FileCheck %s --check-prefix=SHA3
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-typeid-hash=sha3 -ptr-type-md-pass -S \
+; RUN:   | FileCheck %s --check-prefix=SHA3
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-typeid-hash=md5 -ptr-type-md-pass -S \
+; RUN:   | FileCheck %s --check-prefix=MD5
+; RUN: opt < %s -load=%llvmshlibdir/LLVMPtrTypeMDPass%shlibext -parts-dpi -parts-typeid-hash=xxhash -ptr-type-md-pass \
+; RUN:   -S | FileCheck %s --check-prefix=XXHASH
+; REQUIRES: loadable_module
+
+; The type_ids only depend on the hash function and the printed type, so
+; they are the same on every host. Each hash gives different type_ids, and
+; thus different modifiers, for the same types.
+
+; SHA3: load i64*, i64** %p, !PartsTypeMetadata [[I64:![0-9]+]]
+; SHA3: load i32*, i32** %q, !PartsTypeMetadata [[I32:![0-9]+]]
+; SHA3-DAG: [[I64]] = !{!"PartsTypeMetadata", i64 -8191765227735112811, i8 7}
+; SHA3-DAG: [[I32]] = !{!"PartsTypeMetadata", i64 -8185456244599606628, i8 7}
+
+; MD5: load i64*, i64** %p, !PartsTypeMetadata [[I64:![0-9]+]]
+; MD5: load i32*, i32** %q, !PartsTypeMetadata [[I32:![0-9]+]]
+; MD5-DAG: [[I64]] = !{!"PartsTypeMetadata", i64 136561576112241267, i8 7}
+; MD5-DAG: [[I32]] = !{!"PartsTypeMetadata", i64 7588316195459820974, i8 7}
+
+; XXHASH: load i64*, i64** %p, !PartsTypeMetadata [[I64:![0-9]+]]
+; XXHASH: load i32*, i32** %q, !PartsTypeMetadata [[I32:![0-9]+]]
+; XXHASH-DAG: [[I64]] = !{!"PartsTypeMetadata", i64 -5854793963296097438, i8 7}
+; XXHASH-DAG: [[I32]] = !{!"PartsTypeMetadata", i64 -1924427190104602964, i8 7}
+
+define i64* @load(i64** %p, i32** %q) {
+  %a = load i64*, i64** %p
+  %b = load i32*, i32** %q
+  ret i64* %a
+}
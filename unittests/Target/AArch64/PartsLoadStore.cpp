@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks the operand layouts DPI assumes for paired and writeback loads and
+// stores, as produced by the AArch64 load/store optimizer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AArch64PARTS/PartsUtils.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+namespace {
+
+TEST(PartsLoadStore, SingleRegister) {
+  for (auto opCode : { AArch64::LDRXui, AArch64::STRXui, AArch64::LDURXi, AArch64::STURXi }) {
+    EXPECT_FALSE(PartsUtils::isWriteback(opCode));
+    EXPECT_EQ(1u, PartsUtils::getNumDataRegs(opCode));
+    EXPECT_EQ(0u, PartsUtils::getDataOperandIdx(opCode, 0));
+    EXPECT_EQ(1u, PartsUtils::getBaseOperandIdx(opCode));
+  }
+}
+
+TEST(PartsLoadStore, Pair) {
+  for (auto opCode : { AArch64::LDPXi, AArch64::STPXi }) {
+    EXPECT_FALSE(PartsUtils::isWriteback(opCode));
+    EXPECT_EQ(2u, PartsUtils::getNumDataRegs(opCode));
+    EXPECT_EQ(0u, PartsUtils::getDataOperandIdx(opCode, 0));
+    EXPECT_EQ(1u, PartsUtils::getDataOperandIdx(opCode, 1));
+    EXPECT_EQ(2u, PartsUtils::getBaseOperandIdx(opCode));
+  }
+}
+
+TEST(PartsLoadStore, Writeback) {
+  for (auto opCode : { AArch64::LDRXpre, AArch64::LDRXpost, AArch64::STRXpre, AArch64::STRXpost }) {
+    EXPECT_TRUE(PartsUtils::isWriteback(opCode));
+    EXPECT_EQ(1u, PartsUtils::getNumDataRegs(opCode));
+    EXPECT_EQ(1u, PartsUtils::getDataOperandIdx(opCode, 0));
+    EXPECT_EQ(2u, PartsUtils::getBaseOperandIdx(opCode));
+  }
+}
+
+TEST(PartsLoadStore, WritebackPair) {
+  for (auto opCode : { AArch64::LDPXpre, AArch64::LDPXpost, AArch64::STPXpre, AArch64::STPXpost }) {
+    EXPECT_TRUE(PartsUtils::isWriteback(opCode));
+    EXPECT_EQ(2u, PartsUtils::getNumDataRegs(opCode));
+    EXPECT_EQ(1u, PartsUtils::getDataOperandIdx(opCode, 0));
+    EXPECT_EQ(2u, PartsUtils::getDataOperandIdx(opCode, 1));
+    EXPECT_EQ(3u, PartsUtils::getBaseOperandIdx(opCode));
+  }
+}
+
+} // end anonymous namespace
@@ -0,0 +1,151 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs the PARTS-enabled AArch64 backend on many modules from parallel
+// threads, the way in-process ThinLTO backends and parallel LTO codegen do.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/PARTS/PartsTypeMetadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+namespace {
+
+const char *PartsIR =
+    "declare i8* @llvm.pa.pacda.p0i8(i8*, i64)\n"
+    "declare void @use(i8**)\n"
+    "define i8* @roundtrip(i8** %slot, i8* %p) {\n"
+    "  store i8* %p, i8** %slot\n"
+    "  %q = load i8*, i8** %slot\n"
+    "  ret i8* %q\n"
+    "}\n"
+    "define i8* @signed(i8* %p) {\n"
+    "  %s = call i8* @llvm.pa.pacda.p0i8(i8* %p, i64 1234)\n"
+    "  ret i8* %s\n"
+    "}\n"
+    "define void @nonleaf(i8* %p) {\n"
+    "  %slot = alloca i8*\n"
+    "  store i8* %p, i8** %slot\n"
+    "  call void @use(i8** %slot)\n"
+    "  ret void\n"
+    "}\n";
+
+/*! Sets a boolean cl::opt for the duration of a test */
+class ScopedBoolOption {
+  cl::opt<bool> *Opt;
+  bool Old;
+
+public:
+  ScopedBoolOption(StringRef Name, bool Value) {
+    Opt = static_cast<cl::opt<bool> *>(cl::getRegisteredOptions()[Name]);
+    assert(Opt != nullptr && "option not registered");
+    Old = *Opt;
+    Opt->setValue(Value);
+  }
+  ~ScopedBoolOption() { Opt->setValue(Old); }
+};
+
+const Target *getAArch64Target() {
+  LLVMInitializeAArch64TargetInfo();
+  LLVMInitializeAArch64Target();
+  LLVMInitializeAArch64TargetMC();
+  LLVMInitializeAArch64AsmPrinter();
+
+  std::string Error;
+  return TargetRegistry::lookupTarget("aarch64--", Error);
+}
+
+/*! Compile one module in its own context, returns the emitted assembly */
+std::string compileModule(const Target *T) {
+  LLVMContext Context;
+  SMDiagnostic Err;
+  auto M = parseAssemblyString(PartsIR, Err, Context);
+  if (!M)
+    return "";
+
+  // Attach the type metadata that the PtrTypeMD pass would normally add
+  for (auto &F : *M)
+    for (auto &BB : F)
+      for (auto &I : BB)
+        if (auto LI = dyn_cast<LoadInst>(&I))
+          PartsTypeMetadata::get(LI->getType()).attach(Context, I);
+        else if (auto SI = dyn_cast<StoreInst>(&I))
+          PartsTypeMetadata::get(SI->getValueOperand()->getType()).attach(Context, I);
+
+  std::unique_ptr<TargetMachine> TM(T->createTargetMachine(
+      "aarch64--", "generic", "+v8.3a", TargetOptions(), None, None, CodeGenOpt::Default));
+  M->setDataLayout(TM->createDataLayout());
+
+  SmallString<1024> Asm;
+  raw_svector_ostream OS(Asm);
+  legacy::PassManager PM;
+  if (TM->addPassesToEmitFile(PM, OS, TargetMachine::CGFT_AssemblyFile))
+    return "";
+  PM.run(*M);
+
+  return Asm.str();
+}
+
+TEST(PartsParallel, ConcurrentCodegen) {
+#if LLVM_ENABLE_THREADS
+  const Target *T = getAArch64Target();
+  ASSERT_NE(T, nullptr);
+
+  ScopedBoolOption Dpi("parts-dpi", true);
+  ScopedBoolOption BeCfi("parts-becfi", true);
+
+  const unsigned NumThreads = 8;
+  const unsigned ModulesPerThread = 16;
+
+  // Reference output from a single thread
+  const auto Expected = compileModule(T);
+  ASSERT_NE(Expected.find("pacda"), std::string::npos);
+
+  std::atomic<unsigned> Mismatches(0);
+  std::vector<std::thread> Threads;
+
+  for (unsigned t = 0; t < NumThreads; t++) {
+    Threads.emplace_back([&]() {
+      for (unsigned m = 0; m < ModulesPerThread; m++) {
+        // Every module must come out exactly as when compiled alone
+        if (compileModule(T) != Expected)
+          Mismatches++;
+      }
+    });
+  }
+
+  for (auto &Thread : Threads)
+    Thread.join();
+
+  EXPECT_EQ(0u, Mismatches.load());
+#endif
+}
+
+} // end anonymous namespace
@@ -0,0 +1,108 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks how the scheduling models cost the v8.3a PA instructions. Calls end
+// a scheduling region, so the resources of an authenticated branch cannot be
+// observed from a lit test.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AArch64Subtarget.h"
+#include "AArch64TargetMachine.h"
+#include "llvm/MC/MCSchedule.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include "gtest/gtest.h"
+#include <map>
+
+using namespace llvm;
+
+namespace {
+
+std::unique_ptr<TargetMachine> createTargetMachine(StringRef CPU) {
+  auto TT(Triple::normalize("aarch64--"));
+
+  LLVMInitializeAArch64TargetInfo();
+  LLVMInitializeAArch64Target();
+  LLVMInitializeAArch64TargetMC();
+
+  std::string Error;
+  const Target *TheTarget = TargetRegistry::lookupTarget(TT, Error);
+
+  return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(
+      TT, CPU, "+v8.3a", TargetOptions(), None, None, CodeGenOpt::Default));
+}
+
+const MCSchedClassDesc *getSchedClass(const MCSubtargetInfo &STI, const MCInstrInfo &MII, unsigned opCode) {
+  const auto &model = STI.getSchedModel();
+  return model.getSchedClassDesc(MII.get(opCode).getSchedClass());
+}
+
+/*! The cycles the sched class holds each processor resource, including the groups the resources belong to */
+std::map<unsigned, unsigned> getResourceCycles(const MCSubtargetInfo &STI, const MCSchedClassDesc *SC) {
+  std::map<unsigned, unsigned> cycles;
+  for (auto *WPR = STI.getWriteProcResBegin(SC); WPR != STI.getWriteProcResEnd(SC); ++WPR)
+    cycles[WPR->ProcResourceIdx] += WPR->Cycles;
+  return cycles;
+}
+
+int getLatency(const MCSubtargetInfo &STI, const MCSchedClassDesc *SC) {
+  int latency = 0;
+  for (unsigned i = 0; i < SC->NumWriteLatencyEntries; ++i)
+    latency = std::max(latency, STI.getWriteLatencyEntry(SC, i)->Cycles);
+  return latency;
+}
+
+class PartsPauthSched : public ::testing::TestWithParam<const char *> {};
+
+TEST_P(PartsPauthSched, AuthBranchUsesBranchAndPacUnits) {
+  auto TM = createTargetMachine(GetParam());
+  ASSERT_TRUE(TM);
+  const auto &STI = *TM->getMCSubtargetInfo();
+  const auto &MII = *TM->getMCInstrInfo();
+  ASSERT_TRUE(STI.getSchedModel().hasInstrSchedModel());
+
+  const auto *BLRAA = getSchedClass(STI, MII, AArch64::BLRAA);
+  const auto *AUTDA = getSchedClass(STI, MII, AArch64::AUTDA);
+  const auto *PACIA = getSchedClass(STI, MII, AArch64::PACIA);
+  const auto *B = getSchedClass(STI, MII, AArch64::B);
+  ASSERT_TRUE(BLRAA->isValid() && AUTDA->isValid() && PACIA->isValid() && B->isValid());
+
+  EXPECT_EQ(5, getLatency(STI, AUTDA));
+  EXPECT_EQ(5, getLatency(STI, PACIA));
+  EXPECT_EQ(5, getLatency(STI, BLRAA));
+
+  // An authenticated branch is both a PAC computation and a branch
+  const auto pac = getResourceCycles(STI, AUTDA);
+  const auto branch = getResourceCycles(STI, B);
+  const auto authBranch = getResourceCycles(STI, BLRAA);
+
+  unsigned pacCycles = 0, authBranchCycles = 0;
+  for (const auto &entry : pac) {
+    EXPECT_EQ(1u, authBranch.count(entry.first)) << STI.getSchedModel().getProcResource(entry.first)->Name;
+    pacCycles += entry.second;
+  }
+  for (const auto &entry : authBranch)
+    authBranchCycles += entry.second;
+  // The branch has to take something on top of the PAC, even where the model gives branches no resources
+  EXPECT_GT(authBranchCycles, pacCycles);
+
+  bool usesBranchUnit = branch.empty();
+  for (const auto &entry : branch)
+    usesBranchUnit |= authBranch.count(entry.first) != 0;
+  EXPECT_TRUE(usesBranchUnit);
+}
+
+INSTANTIATE_TEST_CASE_P(Models, PartsPauthSched,
+                        ::testing::Values("cortex-a53", "cortex-a57", "cyclone", "falkor", "kryo", "exynos-m1",
+                                          "thunderx", "thunderx2t99"), );
+
+} // end anonymous namespace
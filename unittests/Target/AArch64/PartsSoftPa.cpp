@@ -0,0 +1,138 @@
+//===----------------------------------------------------------------------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks the software PA used by -parts-soft-pa, both the reference
+// implementation and the IR emitted for the helpers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/PARTS/PartsSoftPa.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+namespace {
+
+const uint64_t KeyHi = 0xec2802d4e0a488e9ULL;
+const uint64_t KeyLo = 0x84be85ce9804e94bULL;
+
+const uint64_t CodePtr = 0x0000aaaabbbb1230ULL;
+const uint64_t DataPtr = 0x2a00ffff12345678ULL;
+
+// QARMA-64 with sigma2 and five rounds, from the QARMA paper and QEMU's pauth_computepac
+TEST(PartsSoftPa, ComputePacKnownAnswer) {
+  const uint64_t data = 0xfb623599da6e8127ULL;
+  const uint64_t modifier = 0x477d469dec0b8762ULL;
+  const uint64_t key0 = 0x84be85ce9804e94bULL;
+  const uint64_t key1 = 0xec2802d4e0a488e9ULL;
+  const uint64_t expected = 0xc003b93999b33765ULL;
+
+  EXPECT_EQ(expected, PartsSoftPa::computePac(data, modifier, key0, key1));
+
+  LLVMContext C;
+  IRBuilder<> B(C);
+  auto CI = dyn_cast<ConstantInt>(PartsSoftPa::emitComputePac(B, B.getInt64(data), B.getInt64(modifier),
+                                                               B.getInt64(key0), B.getInt64(key1)));
+  ASSERT_NE(nullptr, CI);
+  EXPECT_EQ(expected, CI->getZExtValue());
+}
+
+TEST(PartsSoftPa, RoundTrip) {
+  for (const auto isData : { false, true }) {
+    const uint64_t ptrs[] = { CodePtr, DataPtr & ~(0xffULL << 56), 0xffffffff00001000ULL };
+    for (const auto ptr : ptrs) {
+      const auto signedPtr = PartsSoftPa::addPac(ptr, 42, KeyHi, KeyLo, isData);
+      EXPECT_NE(ptr, signedPtr);
+      EXPECT_EQ(ptr & 0xffffffffffffULL, signedPtr & 0xffffffffffffULL);
+      EXPECT_EQ(ptr & (1ULL << 55), signedPtr & (1ULL << 55));
+      EXPECT_EQ(ptr, PartsSoftPa::auth(signedPtr, 42, KeyHi, KeyLo, isData));
+    }
+  }
+}
+
+TEST(PartsSoftPa, KeepsDataTag) {
+  const auto signedPtr = PartsSoftPa::addPac(DataPtr, 42, KeyHi, KeyLo, true);
+  EXPECT_EQ(DataPtr >> 56, signedPtr >> 56);
+  EXPECT_EQ(DataPtr, PartsSoftPa::auth(signedPtr, 42, KeyHi, KeyLo, true));
+}
+
+TEST(PartsSoftPa, WrongModifierFails) {
+  const auto code = PartsSoftPa::addPac(CodePtr, 42, KeyHi, KeyLo, false);
+  EXPECT_EQ(CodePtr | (1ULL << 61), PartsSoftPa::auth(code, 43, KeyHi, KeyLo, false));
+
+  const auto data = PartsSoftPa::addPac(DataPtr, 42, KeyHi, KeyLo, true);
+  EXPECT_EQ(DataPtr | (1ULL << 53), PartsSoftPa::auth(data, 43, KeyHi, KeyLo, true));
+}
+
+TEST(PartsSoftPa, WrongKeyFails) {
+  const auto code = PartsSoftPa::addPac(CodePtr, 42, KeyHi, KeyLo, false);
+  EXPECT_NE(CodePtr, PartsSoftPa::auth(code, 42, KeyHi, KeyLo ^ 1, false));
+}
+
+TEST(PartsSoftPa, NonCanonicalFails) {
+  const auto ptr = CodePtr | (1ULL << 50);
+  const auto signedPtr = PartsSoftPa::addPac(ptr, 42, KeyHi, KeyLo, false);
+  EXPECT_EQ(CodePtr | (1ULL << 61), PartsSoftPa::auth(signedPtr, 42, KeyHi, KeyLo, false));
+}
+
+TEST(PartsSoftPa, CodeSelectBit) {
+  // Bit 55, not bit 63, picks the address range, so a code pointer with the two differing never authenticates
+  const auto ptr = CodePtr | (1ULL << 55);
+  const auto signedPtr = PartsSoftPa::addPac(ptr, 42, KeyHi, KeyLo, false);
+  EXPECT_EQ(1ULL << 55, signedPtr & (1ULL << 55));
+  EXPECT_NE(ptr, PartsSoftPa::auth(signedPtr, 42, KeyHi, KeyLo, false));
+}
+
+TEST(PartsSoftPa, IRMatchesReference) {
+  LLVMContext C;
+  IRBuilder<> B(C);
+
+  const uint64_t inputs[] = { 0, CodePtr, DataPtr, ~0ULL };
+  for (const auto data : inputs) {
+    auto V = PartsSoftPa::emitComputePac(B, B.getInt64(data), B.getInt64(42), B.getInt64(KeyHi), B.getInt64(KeyLo));
+    auto CI = dyn_cast<ConstantInt>(V);
+    ASSERT_NE(nullptr, CI);
+    EXPECT_EQ(PartsSoftPa::computePac(data, 42, KeyHi, KeyLo), CI->getZExtValue());
+  }
+}
+
+TEST(PartsSoftPa, Helpers) {
+  LLVMContext C;
+  Module M("soft-pa", C);
+
+  // A declaration left by an earlier pass gets its body filled in
+  auto I64Ty = Type::getInt64Ty(C);
+  M.getOrInsertFunction(PartsSoftPa::getHelperName(PartsSoftPa::AUTDA), I64Ty, I64Ty, I64Ty);
+
+  PartsSoftPa::createHelpers(M);
+
+  for (unsigned op = 0; op < PartsSoftPa::NumOps; op++) {
+    auto F = M.getFunction(PartsSoftPa::getHelperName(static_cast<PartsSoftPa::Op>(op)));
+    ASSERT_NE(nullptr, F);
+    EXPECT_FALSE(F->isDeclaration());
+    EXPECT_EQ(op, static_cast<unsigned>(PartsSoftPa::getHelperOp(*F)));
+    EXPECT_EQ(F, PartsSoftPa::getHelper(M, static_cast<PartsSoftPa::Op>(op)));
+  }
+  EXPECT_NE(nullptr, M.getGlobalVariable("__parts_soft_pa_keys"));
+
+  std::string errors;
+  raw_string_ostream OS(errors);
+  EXPECT_FALSE(verifyModule(M, &OS)) << OS.str();
+}
+
+} // end anonymous namespace
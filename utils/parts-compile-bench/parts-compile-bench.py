@@ -0,0 +1,335 @@
+#!/usr/bin/env python
+#
+# Measures how the compile time and memory use of the PARTS passes scale with
+# the size of the input.
+#
+# For each point of a grid of function counts and function sizes this
+# generates a pointer-heavy module: linked lists of structs with function
+# pointer members, pointer globals, pointer loads and stores, and indirect
+# calls. With --stress-size, llvm-stress functions are linked in as filler.
+# The module is then run through
+#
+#    opt -load LLVMPtrTypeMDPass <PARTS IR passes>
+#    llc -mtriple=aarch64 -parts-*
+#    llc -mtriple=aarch64              (the uninstrumented baseline)
+#
+# with -time-passes, and the per-pass wall time, the total time and the peak
+# RSS of each step are written to a JSON file, together with instructions per
+# second and bytes of RSS per instruction. Comparing the files of two commits
+# shows scaling regressions.
+#
+# Example usage:
+#    > parts-compile-bench.py --bindir build/bin \
+#          --plugin build/lib/LLVMPtrTypeMDPass.so -o before.json
+#    > parts-compile-bench.py --bindir build/bin \
+#          --plugin build/lib/LLVMPtrTypeMDPass.so -o after.json \
+#          --functions 16,256 --size 8,64 --repeat 3
+#
+# The parts-compile-bench build target runs this with the tools of the build
+# tree, and writes parts-compile-bench.json into the build directory.
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import platform
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# The IR passes of the plugin, in the order the PARTS pipeline runs them
+OPT_PASSES = ['-ptr-type-md-pass', '-parts-fecfi-pass', '-pauth-markglobals',
+              '-pauth-pacmain']
+PARTS_FLAGS = ['-parts-dpi', '-parts-fecfi', '-parts-becfi']
+LLC_FLAGS = ['-mtriple=aarch64-linux-gnu', '-mattr=+v8.3a', '-filetype=obj']
+
+NUM_TYPES = 8
+
+
+def generate_module(num_functions, size):
+    """Generate a pointer-heavy module as textual IR."""
+    out = []
+    for k in range(NUM_TYPES):
+        node = '%%struct.node%d' % k
+        out.append('%s = type { %s*, i8*, i64, void (%s*)* }' %
+                   (node, node, node))
+    out.append('')
+
+    for k in range(NUM_TYPES):
+        node = '%%struct.node%d' % k
+        out.append('@head%d = global %s* null' % (k, node))
+        out.append('@table%d = global [1 x void (%s*)*] '
+                   '[void (%s*)* @handler%d]' % (k, node, node, k))
+    out.append('')
+
+    for k in range(NUM_TYPES):
+        node = '%%struct.node%d' % k
+        out.append('define void @handler%d(%s* %%n) {' % (k, node))
+        out.append('  %%p = getelementptr inbounds %s, %s* %%n, i32 0, i32 2'
+                   % (node, node))
+        out.append('  store i64 %d, i64* %%p' % k)
+        out.append('  ret void')
+        out.append('}')
+        out.append('')
+
+    for i in range(num_functions):
+        k = i % NUM_TYPES
+        node = '%%struct.node%d' % k
+        fptr = 'void (%s*)*' % node
+        out.append('define void @walk%d(%s* %%head, i8* %%data) {' %
+                   (i, node))
+        out.append('entry:')
+        out.append('  br label %loop')
+        out.append('loop:')
+        out.append('  %%n = phi %s* [ %%head, %%entry ], [ %%next%d, %%body ]'
+                   % (node, size - 1))
+        out.append('  %%done = icmp eq %s* %%n, null' % node)
+        out.append('  br i1 %done, label %exit, label %body')
+        out.append('body:')
+        cur = '%n'
+        for j in range(size):
+            out.append('  %%nextp%d = getelementptr inbounds %s, %s* %s, '
+                       'i32 0, i32 0' % (j, node, node, cur))
+            out.append('  %%next%d = load %s*, %s** %%nextp%d' %
+                       (j, node, node, j))
+            out.append('  %%datap%d = getelementptr inbounds %s, %s* %s, '
+                       'i32 0, i32 1' % (j, node, node, cur))
+            out.append('  store i8* %%data, i8** %%datap%d' % j)
+            out.append('  %%fp%d = getelementptr inbounds %s, %s* %s, '
+                       'i32 0, i32 3' % (j, node, node, cur))
+            out.append('  %%f%d = load %s, %s* %%fp%d' % (j, fptr, fptr, j))
+            out.append('  call void %%f%d(%s* %%next%d)' % (j, node, j))
+            out.append('  store %s* %%next%d, %s** @head%d' % (node, j, node, k))
+            cur = '%%next%d' % j
+        if i > 0:
+            out.append('  call void @walk%d(%s* %s, i8* %%data)' %
+                       (i - 1, '%%struct.node%d' % ((i - 1) % NUM_TYPES),
+                        'null'))
+        out.append('  br label %loop')
+        out.append('exit:')
+        out.append('  ret void')
+        out.append('}')
+        out.append('')
+
+    return '\n'.join(out)
+
+
+def count_instructions(ir):
+    """Count the instructions in the function bodies of textual IR."""
+    count = 0
+    in_function = False
+    for line in ir.splitlines():
+        line = line.strip()
+        if line.startswith('define '):
+            in_function = True
+        elif line == '}':
+            in_function = False
+        elif in_function and line and not line.startswith(';') and \
+                not line.endswith(':'):
+            count += 1
+    return count
+
+
+# A -time-passes row, e.g. "0.0010 ( 25.0%)   0.0010 ( 25.0%)  Some Pass"
+TIMER_ROW = re.compile(r'^\s*((?:[0-9.]+\s+\(\s*[0-9.]+%\)\s+)+)(.*\S)\s*$')
+TIMER_VALUE = re.compile(r'([0-9.]+)\s+\(\s*[0-9.]+%\)')
+
+
+def parse_time_passes(text):
+    """Get the wall time of each pass from the -time-passes report."""
+    passes = {}
+    in_report = False
+    for line in text.splitlines():
+        if 'Pass execution timing report' in line:
+            in_report = True
+            continue
+        if not in_report:
+            continue
+        if line.startswith('===') and passes:
+            break
+        match = TIMER_ROW.match(line)
+        if not match or match.group(2) == 'Total':
+            continue
+        # The wall time is the last column, passes may run more than once
+        wall = float(TIMER_VALUE.findall(match.group(1))[-1])
+        passes[match.group(2)] = passes.get(match.group(2), 0.0) + wall
+    return passes
+
+
+def run(cmd, verbose):
+    """Run cmd, returning its stderr, wall time and resource usage."""
+    if verbose:
+        print(' '.join(cmd), file=sys.stderr)
+    with tempfile.TemporaryFile() as err:
+        start = time.time()
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL
+                                if hasattr(subprocess, 'DEVNULL')
+                                else open(os.devnull, 'w'), stderr=err)
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.time() - start
+        # Decode like subprocess does, a signal gives a negative return code
+        if os.WIFSIGNALED(status):
+            proc.returncode = -os.WTERMSIG(status)
+        else:
+            proc.returncode = os.WEXITSTATUS(status)
+        err.seek(0)
+        stderr = err.read().decode('utf-8', 'replace')
+    if proc.returncode < 0:
+        sys.stderr.write(stderr)
+        raise RuntimeError('%s killed by signal %d' % (cmd[0], -proc.returncode))
+    if proc.returncode != 0:
+        sys.stderr.write(stderr)
+        raise RuntimeError('%s failed with exit code %d' % (cmd[0], proc.returncode))
+    return stderr, wall, usage
+
+
+def measure(cmd, instructions, repeat, verbose):
+    """Run cmd repeat times and keep the fastest run."""
+    best = None
+    for _ in range(repeat):
+        stderr, wall, usage = run(cmd + ['-time-passes'], verbose)
+        if best is not None and wall >= best['wall_seconds']:
+            continue
+        # ru_maxrss is in kilobytes on Linux and in bytes on macOS
+        rss = usage.ru_maxrss * (1 if sys.platform == 'darwin' else 1024)
+        best = {
+            'wall_seconds': wall,
+            'user_seconds': usage.ru_utime,
+            'system_seconds': usage.ru_stime,
+            'peak_rss_bytes': rss,
+            'instructions_per_second': instructions / wall if wall else 0.0,
+            'rss_bytes_per_instruction':
+                float(rss) / instructions if instructions else 0.0,
+            'passes': parse_time_passes(stderr),
+        }
+    return best
+
+
+def get_label(args):
+    if args.label:
+        return args.label
+    try:
+        src = os.path.dirname(os.path.abspath(__file__))
+        return subprocess.check_output(
+            ['git', '-C', src, 'rev-parse', '--short', 'HEAD'],
+            stderr=open(os.devnull, 'w')).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+
+
+def parse_list(value):
+    return [int(v) for v in value.split(',') if v]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Measure the compile-time scaling of the PARTS passes.')
+    parser.add_argument('--bindir', required=True,
+                        help='directory with opt, llc, llvm-stress and '
+                             'llvm-link')
+    parser.add_argument('--plugin', required=True,
+                        help='path to the LLVMPtrTypeMDPass plugin')
+    parser.add_argument('-o', '--output', required=True,
+                        help='JSON file to write the results to')
+    parser.add_argument('--functions', type=parse_list, default='16,64,256',
+                        help='comma separated function counts '
+                             '(default: %(default)s)')
+    parser.add_argument('--size', type=parse_list, default='8,64',
+                        help='comma separated numbers of pointer operations '
+                             'per function (default: %(default)s)')
+    parser.add_argument('--stress-size', type=int, default=0,
+                        help='link in one llvm-stress function of this size '
+                             'per generated function (default: off)')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='runs per step, the fastest is kept')
+    parser.add_argument('--label', help='label for the results, e.g., the '
+                                        'commit (default: git HEAD)')
+    parser.add_argument('--keep', action='store_true',
+                        help='keep the generated modules')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    args = parser.parse_args()
+
+    def tool(name):
+        return os.path.join(args.bindir, name)
+
+    workdir = tempfile.mkdtemp(prefix='parts-compile-bench-')
+    results = []
+    try:
+        for num_functions in args.functions:
+            for size in args.size:
+                name = 'f%d-s%d' % (num_functions, size)
+                module = os.path.join(workdir, name + '.ll')
+                with open(module, 'w') as f:
+                    f.write(generate_module(num_functions, size))
+
+                if args.stress_size > 0:
+                    stress = []
+                    for seed in range(num_functions):
+                        path = os.path.join(workdir,
+                                            '%s-stress%d.ll' % (name, seed))
+                        subprocess.check_call(
+                            [tool('llvm-stress'), '-size',
+                             str(args.stress_size), '-seed', str(seed),
+                             '-o', path])
+                        stress.append(path)
+                    linked = os.path.join(workdir, name + '-linked.ll')
+                    subprocess.check_call([tool('llvm-link'), '-S', '-o',
+                                           linked, module] + stress)
+                    module = linked
+
+                with open(module) as f:
+                    instructions = count_instructions(f.read())
+
+                instrumented = os.path.join(workdir, name + '-parts.bc')
+                opt_cmd = [tool('opt'), '-load', args.plugin] + \
+                    PARTS_FLAGS + OPT_PASSES + ['-o', instrumented, module]
+                llc_cmd = [tool('llc')] + LLC_FLAGS + PARTS_FLAGS + \
+                    ['-o', os.devnull, instrumented]
+                baseline_cmd = [tool('llc')] + LLC_FLAGS + \
+                    ['-o', os.devnull, module]
+
+                steps = {}
+                steps['opt'] = measure(opt_cmd, instructions, args.repeat,
+                                       args.verbose)
+                steps['llc'] = measure(llc_cmd, instructions, args.repeat,
+                                       args.verbose)
+                steps['llc-baseline'] = measure(baseline_cmd, instructions,
+                                                args.repeat, args.verbose)
+
+                print('%-12s %8d instructions  opt %7.3fs  llc %7.3fs  '
+                      'baseline %7.3fs  peak %6.1f MiB' % (
+                          name, instructions, steps['opt']['wall_seconds'],
+                          steps['llc']['wall_seconds'],
+                          steps['llc-baseline']['wall_seconds'],
+                          steps['llc']['peak_rss_bytes'] / 1048576.0))
+
+                results.append({
+                    'name': name,
+                    'functions': num_functions,
+                    'size': size,
+                    'stress_size': args.stress_size,
+                    'instructions': instructions,
+                    'steps': steps,
+                })
+    finally:
+        if args.keep:
+            print('modules kept in %s' % workdir)
+        else:
+            shutil.rmtree(workdir)
+
+    with open(args.output, 'w') as f:
+        json.dump({
+            'label': get_label(args),
+            'timestamp': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+            'host': platform.node(),
+            'results': results,
+        }, f, indent=2, sort_keys=True)
+        f.write('\n')
+
+
+if __name__ == '__main__':
+    main()
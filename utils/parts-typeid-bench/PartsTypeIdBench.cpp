@@ -0,0 +1,120 @@
+//===- PartsTypeIdBench - Benchmark the PARTS type_id hash functions ------===//
+//
+// Author: Hans Liljestrand <hans@liljestrand.dev>
+// Copyright (c) 2018 Secure Systems Group, Aalto University <ssg.aalto.fi>
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program generates a set of pointer types that resemble those of a C
+// program, and measures the type_id generation throughput of each of the
+// -parts-typeid-hash backends. It also reports the type_id collisions within
+// the generated set.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/PARTS/PartsTypeIdHash.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::PARTS;
+
+static cl::opt<unsigned>
+  NumTypes( "types"
+          , cl::desc("Number of distinct pointer types to hash.")
+          , cl::init(100000)
+          );
+
+static cl::opt<unsigned>
+  NumIterations( "iterations"
+               , cl::desc("Number of times each type is hashed.")
+               , cl::init(10)
+               );
+
+/// Create NumTypes distinct pointer types: pointers to structs with a few
+/// fields, and pointers to functions that take and return such pointers.
+static std::vector<std::string> createTypeStrings(LLVMContext &C) {
+  std::vector<std::string> Strings;
+  Strings.reserve(NumTypes);
+
+  Type *Scalars[] = {Type::getInt8Ty(C), Type::getInt32Ty(C),
+                     Type::getInt64Ty(C), Type::getDoubleTy(C)};
+  SmallVector<Type *, 64> Pointers;
+
+  for (unsigned I = 0; Strings.size() < NumTypes; ++I) {
+    SmallVector<Type *, 8> Fields;
+    for (unsigned F = 0; F < 2 + I % 6; ++F)
+      Fields.push_back(F % 3 == 2 && !Pointers.empty()
+                           ? Pointers[(I + F) % Pointers.size()]
+                           : Scalars[(I + F) % 4]);
+
+    Type *Ty = StructType::create(C, Fields, "struct.S" + std::to_string(I))
+                   ->getPointerTo();
+    if (I % 3 == 2)
+      Ty = FunctionType::get(Ty, {Pointers[I % Pointers.size()], Ty}, false)
+               ->getPointerTo();
+
+    if (Pointers.size() < 64)
+      Pointers.push_back(Ty);
+
+    std::string S;
+    raw_string_ostream OS(S);
+    Ty->print(OS);
+    Strings.push_back(OS.str());
+  }
+
+  return Strings;
+}
+
+static void benchmark(TimerGroup &Group, TypeIdHash Hash,
+                      const std::vector<std::string> &Strings) {
+  const auto Name = getTypeIdHashName(Hash);
+  DenseSet<uint64_t> Ids;
+  uint64_t Sum = 0;
+
+  Timer Hashing(Name, Name, Group);
+  Hashing.startTimer();
+  for (unsigned It = 0; It < NumIterations; ++It)
+    for (auto &S : Strings)
+      Sum += hashTypeId(Hash, S);
+  Hashing.stopTimer();
+  volatile uint64_t DontOptimizeOut = Sum; (void)DontOptimizeOut;
+
+  for (auto &S : Strings)
+    Ids.insert(hashTypeId(Hash, S));
+
+  outs() << Name << ": " << Strings.size() - Ids.size()
+         << " type_id collisions among " << Strings.size() << " types\n";
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  LLVMContext C;
+  const auto Strings = createTypeStrings(C);
+
+  size_t Bytes = 0;
+  for (auto &S : Strings)
+    Bytes += S.size();
+  outs() << "hashing " << Strings.size() << " types (" << Bytes
+         << " bytes) " << NumIterations << " times\n";
+
+  {
+    TimerGroup Group("parts-typeid", "PARTS type_id hash benchmark");
+    benchmark(Group, TypeIdHash::SHA3, Strings);
+    benchmark(Group, TypeIdHash::MD5, Strings);
+    benchmark(Group, TypeIdHash::XXHash, Strings);
+  }
+
+  return 0;
+}